@@ -6,6 +6,7 @@ XPREFIX=${XPREFIX:-$DEF_XPREFIX}
 OUT_DIR=${OUT_DIR:-out}
 PROJ_NAME=${PROJ_NAME:-test}
 CODE_ORG=${CODE_ORG-C0000}
+LD_OPTS=${LD_OPTS-}
 
 _CC_=$XPREFIX-gcc
 _LD_=$XPREFIX-ld
@@ -19,9 +20,15 @@ BARE_OPTS="-ffreestanding -nostartfiles -nostdlib -fno-builtin -fno-stack-protec
 FAST_OPTS=${FAST_OPTS-"-ffp-contract=fast -ffast-math"}
 
 $_CC_ $BARE_OPTS $FAST_OPTS -fno-inline -O3 -march=rv32g -c $PROJ_NAME.c -o $OUT_DIR/$PROJ_NAME.o $*
-$_LD_ --section-start=.text=$CODE_ORG -nostdlib $OUT_DIR/$PROJ_NAME.o -o $OUT_DIR/$PROJ_NAME.elf
-$_OBJCOPY_ -O binary $OUT_DIR/$PROJ_NAME.elf $OUT_DIR/$PROJ_NAME.bin
+$_LD_ --section-start=.text=$CODE_ORG $LD_OPTS -nostdlib $OUT_DIR/$PROJ_NAME.o -o $OUT_DIR/$PROJ_NAME.elf
 $_OBJDUMP_ -d $OUT_DIR/$PROJ_NAME.elf > $OUT_DIR/$PROJ_NAME.txt
+
+# the loader takes the .elf as is, MINION_PACK=1 also packages it as a MINION 1 file
+if [ "${MINION_PACK-0}" != "1" ]; then
+	exit 0
+fi
+
+$_OBJCOPY_ -O binary $OUT_DIR/$PROJ_NAME.elf $OUT_DIR/$PROJ_NAME.bin
 $_READELF_ -s --wide $OUT_DIR/$PROJ_NAME.elf | tail -n +5 > $OUT_DIR/$PROJ_NAME.info
 cat $OUT_DIR/$PROJ_NAME.info | awk '$4 == "FUNC" {print $2 " " $3 " " $8}' > $OUT_DIR/$PROJ_NAME.func
 cat $OUT_DIR/$PROJ_NAME.info | awk '$8 == ".text" {print "$code " $2}' > $OUT_DIR/$PROJ_NAME.code
@@ -39,6 +46,11 @@ cat $OUT_DIR/$PROJ_NAME.sdata >> $HEAD_FILE
 cat $OUT_DIR/$PROJ_NAME.gp >> $HEAD_FILE
 echo '$funcs' $NUM_FUNC >> $HEAD_FILE
 cat $OUT_DIR/$PROJ_NAME.func >> $HEAD_FILE
-echo '$bin' $CODE_SIZE >> $HEAD_FILE
+# the loader uses the payload in place, so the $bin line is padded to start it 8-byte aligned
+BIN_LINE="\$bin $CODE_SIZE"
+HEAD_SIZE=`wc -c < $HEAD_FILE | awk '{print $1}'`
+PAD=$(( (8 - (HEAD_SIZE + ${#BIN_LINE} + 1) % 8) % 8 ))
+while [ $PAD -gt 0 ]; do BIN_LINE="$BIN_LINE "; PAD=$((PAD - 1)); done
+echo "$BIN_LINE" >> $HEAD_FILE
 
 cat $HEAD_FILE $OUT_DIR/$PROJ_NAME.bin > $OUT_DIR/$PROJ_NAME.minion
@@ -12,8 +12,14 @@ mkdir -p $OUT_DIR
 $ZIG version
 
 $ZIG build-exe -target riscv32-freestanding -mcpu=generic_rv32+m+d -OReleaseSafe $PROJ_NAME.zig -femit-bin=$OUT_DIR/$PROJ_NAME.elf -T test_zig.ld $*
-$_OBJCOPY_ -O binary $OUT_DIR/$PROJ_NAME.elf $OUT_DIR/$PROJ_NAME.bin
 $_OBJDUMP_ -d $OUT_DIR/$PROJ_NAME.elf > $OUT_DIR/$PROJ_NAME.txt
+
+# the loader takes the .elf as is, MINION_PACK=1 also packages it as a MINION 1 file
+if [ "${MINION_PACK-0}" != "1" ]; then
+	exit 0
+fi
+
+$_OBJCOPY_ -O binary $OUT_DIR/$PROJ_NAME.elf $OUT_DIR/$PROJ_NAME.bin
 $_READELF_ -s -S --wide $OUT_DIR/$PROJ_NAME.elf | tail -n +5 > $OUT_DIR/$PROJ_NAME.info
 
 cat $OUT_DIR/$PROJ_NAME.info | awk '$4 == "FUNC" {print $2 " " $3 " " $8}' > $OUT_DIR/$PROJ_NAME.func
@@ -32,6 +38,11 @@ cat $OUT_DIR/$PROJ_NAME.sdata >> $HEAD_FILE
 
 echo '$funcs' $NUM_FUNC >> $HEAD_FILE
 cat $OUT_DIR/$PROJ_NAME.func >> $HEAD_FILE
-echo '$bin' $CODE_SIZE >> $HEAD_FILE
+# the loader uses the payload in place, so the $bin line is padded to start it 8-byte aligned
+BIN_LINE="\$bin $CODE_SIZE"
+HEAD_SIZE=`wc -c < $HEAD_FILE | awk '{print $1}'`
+PAD=$(( (8 - (HEAD_SIZE + ${#BIN_LINE} + 1) % 8) % 8 ))
+while [ $PAD -gt 0 ]; do BIN_LINE="$BIN_LINE "; PAD=$((PAD - 1)); done
+echo "$BIN_LINE" >> $HEAD_FILE
 
 cat $HEAD_FILE $OUT_DIR/$PROJ_NAME.bin > $OUT_DIR/$PROJ_NAME.minion
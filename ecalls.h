@@ -8,6 +8,33 @@ enum {
 	ECALL_STRLEN,
 	ECALL_MATH,
 
+	/* values in a0/fa0, results in a0/fa0 */
+	ECALL_PUTINT,
+	ECALL_PUTHEX,
+	ECALL_PUTF32,
+	ECALL_SINF,
+	ECALL_COSF,
+	ECALL_POWF,
+	ECALL_MATHV, /* a0: EMATH_*, a1: dst, a2: x, a3: y (pow, muladd), a4: count */
+	ECALL_CMDFLUSH, /* runs the commands queued in the MINION_CMD ring, which is also drained on return to the host */
+
+	/* file access under the host sandbox directory, same order and registers as MINION_FS_* */
+	ECALL_FOPEN,
+	ECALL_FREAD,
+	ECALL_FWRITE,
+	ECALL_FCLOSE,
+	ECALL_FSTAT,
+	ECALL_FMMAP,
+	ECALL_FMUNMAP,
+
+	/* ECALL_ASYNC runs another ecall on a host worker, completions land in the ring given by the host */
+	ECALL_ASYNC,
+	ECALL_AWAIT,
+
+	/* a0: hart, a1: entry(arg, hart), a2: arg; join returns what entry returned */
+	ECALL_HART_START,
+	ECALL_HART_JOIN,
+
 	ECALL_MAX
 };
 
@@ -20,10 +47,26 @@ enum {
 	EMATH_SIN,
 	EMATH_COS,
 	EMATH_POW,
+	EMATH_EXP,
+	EMATH_LOG,
+	EMATH_SQRT,
+	EMATH_RSQRT,
+	EMATH_MULADD, /* x * y + the value already in dst */
 
 	EMATH_MAX
 };
 
+enum {
+	EFILE_READ = 0,
+	EFILE_WRITE,
+	EFILE_APPEND
+};
+
+enum {
+	EFILE_MAP_RO = 0,
+	EFILE_MAP_COW
+};
+
 typedef struct _EMATH_ARGS {
 	int32_t func;
 	float x;
@@ -4,7 +4,77 @@
 
 #include "minion.h"
 
-static int s_silentFlg = 0;
+#if defined(_WIN32)
+#	define MINION_NO_MMAP
+#	define MINION_NO_THREADS
+#endif
+
+#include <time.h>
+
+#ifndef MINION_NO_MMAP
+#	include <sys/mman.h>
+#	include <sys/stat.h>
+#	include <fcntl.h>
+#	include <unistd.h>
+#endif
+
+/* template for new cfgs, only read after startup: instances carry their own copy */
+static MINION_LOG s_defLog = { NULL, NULL, MINION_LOG_MSG, 0 };
+
+#if defined(__GNUC__) || defined(__clang__)
+#	define MINION_LOAD_ACQ(_p) __atomic_load_n((_p), __ATOMIC_ACQUIRE)
+#	define MINION_STORE_REL(_p, _v) __atomic_store_n((_p), (_v), __ATOMIC_RELEASE)
+#	define MINION_FENCE() __atomic_thread_fence(__ATOMIC_SEQ_CST)
+#	define MINION_ATOMIC_INC(_p) __atomic_add_fetch((_p), 1, __ATOMIC_RELAXED)
+#	define MINION_ATOMIC_DEC(_p) __atomic_sub_fetch((_p), 1, __ATOMIC_ACQ_REL)
+#	define MINION_SPIN_LOCK(_p) while (__atomic_exchange_n((_p), 1, __ATOMIC_ACQUIRE)) {}
+#	define MINION_SPIN_UNLOCK(_p) __atomic_store_n((_p), 0, __ATOMIC_RELEASE)
+#	define MINION_LOAD_ACQ64(_p) __atomic_load_n((_p), __ATOMIC_ACQUIRE)
+#	define MINION_STORE_REL64(_p, _v) __atomic_store_n((_p), (_v), __ATOMIC_RELEASE)
+#	define MINION_ATOMIC_CAS(_p, _old, _new) minion_atomic_cas((uint32_t*)(_p), (uint32_t)(_old), (uint32_t)(_new))
+static int minion_atomic_cas(uint32_t* p, uint32_t old, uint32_t val) {
+	return __atomic_compare_exchange_n(p, &old, val, 0, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+}
+#elif defined(_MSC_VER)
+#	include <intrin.h>
+/* Interlocked* are full barriers, stronger than acquire/release but correct on every target */
+#	define MINION_LOAD_ACQ(_p) ((uint32_t)_InterlockedOr((volatile long*)(_p), 0))
+#	define MINION_STORE_REL(_p, _v) _InterlockedExchange((volatile long*)(_p), (long)(_v))
+#	define MINION_FENCE() minion_fence()
+#	define MINION_ATOMIC_INC(_p) ((uint32_t)_InterlockedIncrement((volatile long*)(_p)))
+#	define MINION_ATOMIC_DEC(_p) ((uint32_t)_InterlockedDecrement((volatile long*)(_p)))
+#	define MINION_SPIN_LOCK(_p) while (_InterlockedExchange((volatile long*)(_p), 1)) {}
+#	define MINION_SPIN_UNLOCK(_p) _InterlockedExchange((volatile long*)(_p), 0)
+#	define MINION_LOAD_ACQ64(_p) ((uint64_t)_InterlockedCompareExchange64((volatile __int64*)(_p), 0, 0))
+#	define MINION_STORE_REL64(_p, _v) minion_store64((volatile __int64*)(_p), (__int64)(_v))
+#	define MINION_ATOMIC_CAS(_p, _old, _new) (_InterlockedCompareExchange((volatile long*)(_p), (long)(_new), (long)(_old)) == (long)(_old))
+static void minion_fence(void) {
+	volatile long f = 0;
+	_InterlockedExchange(&f, 1);
+}
+/* no 64-bit exchange on 32-bit x86, a CAS loop works everywhere */
+static void minion_store64(volatile __int64* p, __int64 val) {
+	__int64 old = *p;
+	while (_InterlockedCompareExchange64(p, val, old) != old) {
+		old = *p;
+	}
+}
+#else
+#	ifndef MINION_NO_THREADS
+#		error "no atomics for this compiler, build with MINION_NO_THREADS"
+#	endif
+/* single-threaded only: instances sharing a cfg must not run on different threads */
+#	define MINION_LOAD_ACQ(_p) (*(volatile uint32_t*)(_p))
+#	define MINION_STORE_REL(_p, _v) (*(volatile uint32_t*)(_p) = (_v))
+#	define MINION_FENCE()
+#	define MINION_ATOMIC_INC(_p) (++*(_p))
+#	define MINION_ATOMIC_DEC(_p) (--*(_p))
+#	define MINION_SPIN_LOCK(_p)
+#	define MINION_SPIN_UNLOCK(_p)
+#	define MINION_LOAD_ACQ64(_p) (*(volatile uint64_t*)(_p))
+#	define MINION_STORE_REL64(_p, _v) (*(volatile uint64_t*)(_p) = (_v))
+#	define MINION_ATOMIC_CAS(_p, _old, _new) (*(_p) == (_old) ? (*(_p) = (_new), 1) : 0)
+#endif
 
 static const char* skip_space(const char* pStr) {
 	while (1) {
@@ -46,7 +116,7 @@ static uint32_t u32_hex(const char* pStr, size_t len) {
 			const char* p = pStr + len - 1;
 			int s = 0;
 			while (p >= p0) {
-				static char tbl[] = { 0, '0', 'a' - 10, 0, 'A' - 10, 0, 0, 0 };
+				static const char tbl[] = { 0, '0', 'a' - 10, 0, 'A' - 10, 0, 0, 0 };
 				char c = *p;
 				uint32_t d = 0;
 				int i0 = (c >= '0' && c <= '9');
@@ -64,34 +134,81 @@ static uint32_t u32_hex(const char* pStr, size_t len) {
 	return val;
 }
 
+static void log_v(const MINION_LOG* pLog, int level, const char* pFmt, va_list argLst) {
+	if (pLog->fn) {
+		char buf[512];
+		vsnprintf(buf, sizeof(buf), pFmt, argLst);
+		pLog->fn(pLog->pUser, level, buf);
+	} else {
+		vfprintf(level <= MINION_LOG_ERR ? stderr : stdout, pFmt, argLst);
+	}
+}
+
+/* an instance that failed to init has no cold block and logs through the default */
+static const MINION_LOG* ctx_log(const MINION* pMi) {
+	return pMi && pMi->pCold ? &pMi->pCold->log : &s_defLog;
+}
+
+void minion_log(MINION* pMi, int level, const char* pFmt, ...) {
+	const MINION_LOG* pLog = ctx_log(pMi);
+	va_list argLst;
+	if (level > pLog->level) return;
+	va_start(argLst, pFmt);
+	log_v(pLog, level, pFmt, argLst);
+	va_end(argLst);
+}
+
 void minion_err(MINION* pMi, const char* pFmt, ...) {
+	const MINION_LOG* pLog = ctx_log(pMi);
 	va_list argLst;
+	if (pLog->level < MINION_LOG_ERR) return;
 	va_start(argLst, pFmt);
-	if (!s_silentFlg) vfprintf(stderr, pFmt, argLst);
+	log_v(pLog, MINION_LOG_ERR, pFmt, argLst);
 	va_end(argLst);
 }
 
 void minion_msg(MINION* pMi, const char* pFmt, ...) {
+	const MINION_LOG* pLog = ctx_log(pMi);
 	va_list argLst;
+	if (pLog->level < MINION_LOG_MSG) return;
 	va_start(argLst, pFmt);
-	if (!s_silentFlg) vfprintf(stdout, pFmt, argLst);
+	log_v(pLog, MINION_LOG_MSG, pFmt, argLst);
 	va_end(argLst);
 }
 
+/* no instance at hand (loading, cfg setup): goes to the default log */
 void minion_sys_err(const char* pFmt, ...) {
 	va_list argLst;
+	if (s_defLog.level < MINION_LOG_ERR) return;
 	va_start(argLst, pFmt);
-	if (!s_silentFlg) vfprintf(stderr, pFmt, argLst);
+	log_v(&s_defLog, MINION_LOG_ERR, pFmt, argLst);
 	va_end(argLst);
 }
 
 void minion_sys_msg(const char* pFmt, ...) {
 	va_list argLst;
+	if (s_defLog.level < MINION_LOG_MSG) return;
 	va_start(argLst, pFmt);
-	if (!s_silentFlg) vfprintf(stdout, pFmt, argLst);
+	log_v(&s_defLog, MINION_LOG_MSG, pFmt, argLst);
 	va_end(argLst);
 }
 
+void* minion_mem_alloc(const MINION_ALLOCATOR* pAlloc, size_t size) {
+	if (pAlloc && pAlloc->alloc_fn) {
+		return pAlloc->alloc_fn(pAlloc->pUser, size);
+	}
+	return malloc(size);
+}
+
+void minion_mem_free(const MINION_ALLOCATOR* pAlloc, void* p) {
+	if (!p) return;
+	if (pAlloc && pAlloc->free_fn) {
+		pAlloc->free_fn(pAlloc->pUser, p);
+	} else {
+		free(p);
+	}
+}
+
 void minion_reset_sp(MINION* pMi) {
 	if (pMi) {
 		minion_set_sp(pMi, pMi->codeOrg);
@@ -110,6 +227,174 @@ int minion_is_mapped_vptr(uint32_t vptr) {
 	return ((vptr & MINION_VPTR_TAG_MASK) == MINION_VPTR_TAG);
 }
 
+int minion_is_io_vptr(uint32_t vptr) {
+	return ((vptr & MINION_VPTR_TAG_MASK) == MINION_IO_TAG);
+}
+
+static MINION_IO_REGION* io_region_sub(MINION* pMi, uint32_t vptr, uint32_t* pOffs) {
+	MINION_IO_REGION* pIO = &pMi->pCfg->ioMap[(vptr >> MINION_VPTR_BITS) & 0xF];
+	uint32_t size = MINION_LOAD_ACQ(&pIO->size);
+	uint32_t offs = vptr - pIO->vptr;
+	if (size == 0 || offs >= size) {
+		return NULL;
+	}
+	*pOffs = offs;
+	return pIO;
+}
+
+static uint32_t io_load(MINION* pMi, uint32_t vptr, int size) {
+	uint32_t offs = 0;
+	MINION_IO_REGION* pIO = io_region_sub(pMi, vptr, &offs);
+	if (!pIO) return 0;
+	if (pIO->flags & MINION_IO_FIFO) {
+		if (offs == MINION_IO_FIFO_DATA) {
+			if (pIO->fifoInPos < pIO->fifoInCount) {
+				return pIO->pFifoIn[pIO->fifoInPos++];
+			}
+		} else if (offs == MINION_IO_FIFO_AVAIL) {
+			return pIO->fifoInCount - pIO->fifoInPos;
+		}
+	}
+	if (pIO->read_fn) {
+		return pIO->read_fn(pMi, pIO, offs, size);
+	}
+	return 0;
+}
+
+static void io_store(MINION* pMi, uint32_t vptr, uint32_t val, int size) {
+	uint32_t offs = 0;
+	MINION_IO_REGION* pIO = io_region_sub(pMi, vptr, &offs);
+	if (!pIO) return;
+	if (size < 4) {
+		val &= (1U << (size * 8)) - 1;
+	}
+	if (pIO->flags & MINION_IO_FIFO) {
+		if (offs == MINION_IO_FIFO_DATA && pIO->fifoOutPos < pIO->fifoOutCap) {
+			pIO->pFifoOut[pIO->fifoOutPos++] = val;
+			return;
+		}
+	}
+	if (pIO->write_fn) {
+		pIO->write_fn(pMi, pIO, offs, val, size);
+	}
+}
+
+static void* mod_span(MINION_CFG* pCfg, uint32_t vptr, uint32_t len) {
+	int i;
+	for (i = 0; i < pCfg->nmods; ++i) {
+		uint32_t offs = vptr - pCfg->mods[i].org;
+		if (offs < pCfg->mods[i].size && len <= pCfg->mods[i].size - offs) {
+			return (uint8_t*)pCfg->mods[i].pMem + offs;
+		}
+	}
+	return NULL;
+}
+
+typedef int32_t (*NATIVE_I0)(void);
+typedef int32_t (*NATIVE_I1)(int32_t);
+typedef int32_t (*NATIVE_I2)(int32_t, int32_t);
+typedef int32_t (*NATIVE_I3)(int32_t, int32_t, int32_t);
+typedef int32_t (*NATIVE_I4)(int32_t, int32_t, int32_t, int32_t);
+typedef void (*NATIVE_V0)(void);
+typedef void (*NATIVE_V1)(int32_t);
+typedef void (*NATIVE_V2)(int32_t, int32_t);
+typedef void (*NATIVE_V3)(int32_t, int32_t, int32_t);
+typedef void (*NATIVE_V4)(int32_t, int32_t, int32_t, int32_t);
+typedef float (*NATIVE_F1)(float);
+typedef float (*NATIVE_F2)(float, float);
+typedef double (*NATIVE_D1)(double);
+typedef double (*NATIVE_D2)(double, double);
+
+static void native_i0(MINION* pMi, const MINION_NATIVE* pNat) {
+	pMi->regs[10] = ((NATIVE_I0)pNat->fn)();
+}
+
+static void native_i1(MINION* pMi, const MINION_NATIVE* pNat) {
+	pMi->regs[10] = ((NATIVE_I1)pNat->fn)(pMi->regs[10]);
+}
+
+static void native_i2(MINION* pMi, const MINION_NATIVE* pNat) {
+	pMi->regs[10] = ((NATIVE_I2)pNat->fn)(pMi->regs[10], pMi->regs[11]);
+}
+
+static void native_i3(MINION* pMi, const MINION_NATIVE* pNat) {
+	pMi->regs[10] = ((NATIVE_I3)pNat->fn)(pMi->regs[10], pMi->regs[11], pMi->regs[12]);
+}
+
+static void native_i4(MINION* pMi, const MINION_NATIVE* pNat) {
+	pMi->regs[10] = ((NATIVE_I4)pNat->fn)(pMi->regs[10], pMi->regs[11], pMi->regs[12], pMi->regs[13]);
+}
+
+static void native_v0(MINION* pMi, const MINION_NATIVE* pNat) {
+	(void)pMi;
+	((NATIVE_V0)pNat->fn)();
+}
+
+static void native_v1(MINION* pMi, const MINION_NATIVE* pNat) {
+	((NATIVE_V1)pNat->fn)(pMi->regs[10]);
+}
+
+static void native_v2(MINION* pMi, const MINION_NATIVE* pNat) {
+	((NATIVE_V2)pNat->fn)(pMi->regs[10], pMi->regs[11]);
+}
+
+static void native_v3(MINION* pMi, const MINION_NATIVE* pNat) {
+	((NATIVE_V3)pNat->fn)(pMi->regs[10], pMi->regs[11], pMi->regs[12]);
+}
+
+static void native_v4(MINION* pMi, const MINION_NATIVE* pNat) {
+	((NATIVE_V4)pNat->fn)(pMi->regs[10], pMi->regs[11], pMi->regs[12], pMi->regs[13]);
+}
+
+static void native_f1(MINION* pMi, const MINION_NATIVE* pNat) {
+	minion_set_freg_s(pMi, 10, ((NATIVE_F1)pNat->fn)(minion_get_freg_s(pMi, 10)));
+}
+
+static void native_f2(MINION* pMi, const MINION_NATIVE* pNat) {
+	minion_set_freg_s(pMi, 10, ((NATIVE_F2)pNat->fn)(minion_get_freg_s(pMi, 10), minion_get_freg_s(pMi, 11)));
+}
+
+static void native_d1(MINION* pMi, const MINION_NATIVE* pNat) {
+	pMi->fregs[10] = ((NATIVE_D1)pNat->fn)(pMi->fregs[10]);
+}
+
+static void native_d2(MINION* pMi, const MINION_NATIVE* pNat) {
+	pMi->fregs[10] = ((NATIVE_D2)pNat->fn)(pMi->fregs[10], pMi->fregs[11]);
+}
+
+/* 'u' and 'p' travel in the same registers as 'i' and are folded into it before the lookup */
+static const struct {
+	const char* pSig;
+	MINION_NATIVE_RAW_FN invoke;
+} s_nativeShapes[] = {
+	{ "i()", native_i0 },
+	{ "i(i)", native_i1 },
+	{ "i(ii)", native_i2 },
+	{ "i(iii)", native_i3 },
+	{ "i(iiii)", native_i4 },
+	{ "v()", native_v0 },
+	{ "v(i)", native_v1 },
+	{ "v(ii)", native_v2 },
+	{ "v(iii)", native_v3 },
+	{ "v(iiii)", native_v4 },
+	{ "f(f)", native_f1 },
+	{ "f(ff)", native_f2 },
+	{ "d(d)", native_d1 },
+	{ "d(dd)", native_d2 }
+};
+
+/* jalr into the thunk range: one indirect call, then straight back to ra */
+static void native_thunk(MINION* pMi, uint32_t inat) {
+	MINION_CFG* pCfg = pMi->pCfg;
+	if (inat >= (uint32_t)pCfg->nnatives) {
+		minion_err(pMi, "unbound native import @ %X\n", pMi->pc);
+		pMi->faultFlags |= 1;
+		return;
+	}
+	pCfg->natives[inat].invoke(pMi, &pCfg->natives[inat]);
+	pMi->pc = (uint32_t)pMi->regs[1];
+}
+
 void* minion_resolve_vptr(MINION* pMi, uint32_t vptr) {
 	void* p = NULL;
 	if (vptr < pMi->codeOrg && vptr > 4) {
@@ -119,34 +404,142 @@ void* minion_resolve_vptr(MINION* pMi, uint32_t vptr) {
 		}
 	} else if (minion_is_mapped_vptr(vptr)) {
 		int vidx = (vptr >> MINION_VPTR_BITS) & 0xF;
-		if (pMi->memMap[vidx].size > 0) {
-			uint32_t offs = vptr - pMi->memMap[vidx].vptr;
-			if (offs < pMi->memMap[vidx].size) {
-				p = (uint8_t*)pMi->memMap[vidx].p + offs;
+		uint32_t size = MINION_LOAD_ACQ(&pMi->pCfg->memMap[vidx].size);
+		if (size > 0) {
+			uint32_t offs = vptr - pMi->pCfg->memMap[vidx].vptr;
+			if (offs < size) {
+				p = (uint8_t*)pMi->pCfg->memMap[vidx].p + offs;
 			}
 		}
 	} else if (vptr >= pMi->codeOrg) {
 		uint32_t offs = vptr - pMi->codeOrg;
 		if (offs < pMi->binSize) {
 			p = (uint8_t*)pMi->pBinMem + offs;
+		} else if (pMi->pCfg->nmods > 0) {
+			p = mod_span(pMi->pCfg, vptr, 1);
 		}
 	}
 	return p;
 }
 
+void* minion_span(MINION* pMi, uint32_t vptr, uint32_t len) {
+	void* p = NULL;
+	if (!pMi) return NULL;
+	if (len == 0) {
+		return minion_resolve_vptr(pMi, vptr);
+	}
+	if (vptr < pMi->codeOrg && vptr > 4) {
+		if (len <= pMi->codeOrg - vptr) {
+			p = pMi->pStkMem;
+			if (p) {
+				p = (uint8_t*)p + vptr;
+			}
+		}
+	} else if (minion_is_mapped_vptr(vptr)) {
+		int vidx = (vptr >> MINION_VPTR_BITS) & 0xF;
+		uint32_t size = MINION_LOAD_ACQ(&pMi->pCfg->memMap[vidx].size);
+		if (size > 0) {
+			uint32_t offs = vptr - pMi->pCfg->memMap[vidx].vptr;
+			if (offs < size && len <= size - offs) {
+				p = (uint8_t*)pMi->pCfg->memMap[vidx].p + offs;
+			}
+		}
+	} else if (vptr >= pMi->codeOrg) {
+		uint32_t offs = vptr - pMi->codeOrg;
+		if (offs < pMi->binSize && len <= pMi->binSize - offs) {
+			p = (uint8_t*)pMi->pBinMem + offs;
+		} else if (pMi->pCfg->nmods > 0) {
+			p = mod_span(pMi->pCfg, vptr, len);
+		}
+	}
+	return p;
+}
+
+static int mem_map_ro(MINION* pMi, uint32_t vptr) {
+	return minion_is_mapped_vptr(vptr) && (pMi->pCfg->memMap[(vptr >> MINION_VPTR_BITS) & 0xF].flags & MINION_MEM_RO);
+}
+
+/* for host code storing on the guest's behalf: read-only maps don't resolve, their pages may not be writable */
+void* minion_span_w(MINION* pMi, uint32_t vptr, uint32_t len) {
+	if (!pMi || mem_map_ro(pMi, vptr)) return NULL;
+	return minion_span(pMi, vptr, len);
+}
+
+/* guest stores: read-only maps fault instead of resolving */
+static void* resolve_store(MINION* pMi, uint32_t vptr) {
+	if (mem_map_ro(pMi, vptr)) {
+		minion_err(pMi, "store to read-only memory @ %X\n", vptr);
+		pMi->faultFlags |= 1;
+		return NULL;
+	}
+	return minion_resolve_vptr(pMi, vptr);
+}
+
+int minion_read(MINION* pMi, uint32_t vptr, void* pDst, uint32_t len) {
+	void* pSrc = minion_span(pMi, vptr, len);
+	if (!pSrc || !pDst) return 0;
+	memcpy(pDst, pSrc, len);
+	return 1;
+}
+
+int minion_write(MINION* pMi, uint32_t vptr, const void* pSrc, uint32_t len) {
+	void* pDst = minion_span_w(pMi, vptr, len);
+	if (!pDst || !pSrc) return 0;
+	memcpy(pDst, pSrc, len);
+	return 1;
+}
+
+static int span_vec_ck(MINION* pMi, const MINION_IOVEC* pVec, int n, int store) {
+	int i;
+	if (!pMi || !pVec) return 0;
+	for (i = 0; i < n; ++i) {
+		if (!pVec[i].p || !(store ? minion_span_w : minion_span)(pMi, pVec[i].vptr, pVec[i].size)) {
+			return 0;
+		}
+	}
+	return 1;
+}
+
+int minion_readv(MINION* pMi, const MINION_IOVEC* pVec, int n) {
+	int i;
+	if (!span_vec_ck(pMi, pVec, n, 0)) return 0;
+	for (i = 0; i < n; ++i) {
+		memcpy(pVec[i].p, minion_span(pMi, pVec[i].vptr, pVec[i].size), pVec[i].size);
+	}
+	return n;
+}
+
+int minion_writev(MINION* pMi, const MINION_IOVEC* pVec, int n) {
+	int i;
+	if (!span_vec_ck(pMi, pVec, n, 1)) return 0;
+	for (i = 0; i < n; ++i) {
+		memcpy(minion_span(pMi, pVec[i].vptr, pVec[i].size), pVec[i].p, pVec[i].size);
+	}
+	return n;
+}
+
 #include "minion_regs.c"
 #include "minion_instrs.c"
 
 
 uint32_t minion_mem_map(MINION* pMi, void* p, uint32_t size) {
+	return minion_mem_map_ext(pMi, p, size, 0);
+}
+
+/* a slot spans 1 << MINION_VPTR_BITS bytes of guest address space;
+   the 16 slots belong to the cfg, so a mapping made through one instance is visible to all instances sharing it;
+   vptr claims a slot, size publishes it: readers take a slot with size 0 as unmapped */
+uint32_t minion_mem_map_ext(MINION* pMi, void* p, uint32_t size, uint32_t flags) {
 	uint32_t vptr = 0;
-	if (size > 0x10000) {
+	if (size > (1U << MINION_VPTR_BITS)) {
 		minion_err(pMi, "can't create memory map, size = 0x%X\n", size);
 	} else {
 		int i;
 		int idx = -1;
+		/* slots are claimed with a CAS, instances sharing the cfg may map from several threads */
 		for (i = 0; i < 16; ++i) {
-			if (pMi->memMap[i].vptr == 0) {
+			uint32_t slotVptr = MINION_VPTR_TAG | ((uint32_t)i << MINION_VPTR_BITS);
+			if (MINION_LOAD_ACQ(&pMi->pCfg->memMap[i].vptr) == 0 && MINION_ATOMIC_CAS(&pMi->pCfg->memMap[i].vptr, 0, slotVptr)) {
 				idx = i;
 				break;
 			}
@@ -155,9 +548,9 @@ uint32_t minion_mem_map(MINION* pMi, void* p, uint32_t size) {
 			minion_err(pMi, "can't map memory, no free slots\n");
 		} else {
 			vptr = MINION_VPTR_TAG | (idx << MINION_VPTR_BITS);
-			pMi->memMap[idx].p = p;
-			pMi->memMap[idx].size = size;
-			pMi->memMap[idx].vptr = vptr;
+			pMi->pCfg->memMap[idx].p = p;
+			pMi->pCfg->memMap[idx].flags = flags;
+			MINION_STORE_REL(&pMi->pCfg->memMap[idx].size, size);
 		}
 	}
 	return vptr;
@@ -166,17 +559,695 @@ uint32_t minion_mem_map(MINION* pMi, void* p, uint32_t size) {
 void minion_mem_unmap(MINION* pMi, uint32_t vptr) {
 	if (minion_is_mapped_vptr(vptr)) {
 		int idx = (vptr >> MINION_VPTR_BITS) & 0xF;
-		pMi->memMap[idx].p = NULL;
-		pMi->memMap[idx].size = 0;
-		pMi->memMap[idx].vptr = 0;
+		MINION_STORE_REL(&pMi->pCfg->memMap[idx].size, 0);
+		pMi->pCfg->memMap[idx].p = NULL;
+		pMi->pCfg->memMap[idx].flags = 0;
+		MINION_STORE_REL(&pMi->pCfg->memMap[idx].vptr, 0);
 	} else {
 		minion_err(pMi, "can't umap memory, invalid vptr\n");
 	}
 }
 
-static int find_func_sub(MINION_FUNC_INFO* pFuncs, int nfuncs, const char* pFnName) {
+/* ILP32D register plan, worked out once per signature: shared by minion_call and reused for every element of a batch */
+typedef struct _MINION_CALL_SLOT {
+	char type;
+	int8_t ireg;
+	int8_t nireg;
+	int8_t freg;
+	int8_t nfreg;
+	int32_t stk;
+	uint32_t size; /* bytes passed: whole words for aggregates, 4 for a by-reference copy */
+	int byRef;
+} MINION_CALL_SLOT;
+
+static int call_sig_size(char type) {
+	switch (type) {
+		case MINION_SIG_I32:
+		case MINION_SIG_U32:
+		case MINION_SIG_VPTR:
+		case MINION_SIG_F32:
+			return 4;
+		case MINION_SIG_I64:
+		case MINION_SIG_F64:
+			return 8;
+		case MINION_SIG_VOID:
+			return 0;
+	}
+	return -1;
+}
+
+static int call_is_struct(char type) {
+	return type == MINION_SIG_STRUCT || type == MINION_SIG_STRUCT_F || type == MINION_SIG_STRUCT_D;
+}
+
+/* fa-regs a float aggregate of the given size takes, 0 if it has no valid float layout */
+static int call_struct_nfregs(char type, uint32_t size) {
+	uint32_t esize = type == MINION_SIG_STRUCT_F ? 4 : type == MINION_SIG_STRUCT_D ? 8 : 0;
+	if (esize == 0) return 0;
+	return size == esize ? 1 : size == 2 * esize ? 2 : 0;
+}
+
+/* m and aggregates need their MINION_VAL to be planned, without pArgs only scalar signatures are accepted */
+static int call_plan(const char* pArgSig, const MINION_VAL* pArgs, int ni, MINION_CALL_SLOT* pSlots, uint32_t* pStkSize) {
+	int i;
+	int nf = 0;
+	uint32_t stk = 0;
+	for (i = 0; pArgSig[i] && pArgSig[i] != ')'; ++i) {
+		MINION_CALL_SLOT* pSlot;
+		int size = call_sig_size(pArgSig[i]);
+		int words;
+		if (i >= MINION_CALL_MAX_ARGS) return -1;
+		pSlot = &pSlots[i];
+		pSlot->type = pArgSig[i];
+		pSlot->ireg = -1;
+		pSlot->nireg = 0;
+		pSlot->freg = -1;
+		pSlot->nfreg = 0;
+		pSlot->stk = -1;
+		pSlot->byRef = 0;
+		if (pSlot->type == MINION_SIG_MEM && pArgs) {
+			size = 4;
+		} else if (call_is_struct(pSlot->type) && pArgs && pArgs[i].mem.size > 0) {
+			int nfregs = call_struct_nfregs(pSlot->type, pArgs[i].mem.size);
+			if (pSlot->type != MINION_SIG_STRUCT && nfregs == 0) return -1;
+			if (nfregs > 0 && nf + nfregs <= 8) {
+				pSlot->freg = (int8_t)nf;
+				pSlot->nfreg = (int8_t)nfregs;
+				pSlot->size = pArgs[i].mem.size;
+				nf += nfregs;
+				continue;
+			}
+			size = (int)((pArgs[i].mem.size + 3) & ~3U);
+			if (size > 8) {
+				pSlot->byRef = 1;
+				size = 4;
+			}
+		}
+		if (size <= 0) return -1;
+		pSlot->size = (uint32_t)size;
+		words = size / 4;
+		if ((pSlot->type == MINION_SIG_F32 || pSlot->type == MINION_SIG_F64) && nf < 8) {
+			pSlot->freg = (int8_t)nf++;
+			pSlot->nfreg = 1;
+		} else if (ni < 8) {
+			/* a pair, or split between a7 and the stack */
+			pSlot->ireg = (int8_t)ni;
+			pSlot->nireg = (int8_t)(words <= 8 - ni ? words : 8 - ni);
+			ni += pSlot->nireg;
+			if (pSlot->nireg < words) {
+				pSlot->stk = (int32_t)stk;
+				stk += 4;
+			}
+		} else {
+			if (words == 2 && pSlot->type != MINION_SIG_STRUCT && pSlot->type != MINION_SIG_STRUCT_F) stk = (stk + 7) & ~7U;
+			pSlot->stk = (int32_t)stk;
+			stk += 4 * words;
+		}
+	}
+	*pStkSize = (stk + 15) & ~15U;
+	return i;
+}
+
+/* pSrc holds pSlot->size bytes as laid out in memory, pStk is the host view of the outgoing stack area */
+static void call_put(MINION* pMi, const MINION_CALL_SLOT* pSlot, uint8_t* pStk, const void* pSrc) {
+	const uint8_t* p = (const uint8_t*)pSrc;
+	if (pSlot->freg >= 0) {
+		/* one member per fa-reg, floats in the low half as in minion_set_freg_s */
+		uint32_t esize = pSlot->size / (uint32_t)pSlot->nfreg;
+		int k;
+		for (k = 0; k < pSlot->nfreg; ++k) {
+			memcpy(&pMi->fregs[10 + pSlot->freg + k], p + k * esize, esize);
+		}
+	} else {
+		if (pSlot->nireg > 0) memcpy(&pMi->regs[10 + pSlot->ireg], p, 4 * pSlot->nireg);
+		if (pSlot->stk >= 0) memcpy(pStk + pSlot->stk, p + 4 * pSlot->nireg, pSlot->size - 4 * pSlot->nireg);
+	}
+}
+
+/* outgoing stack area of stkSize below copyTop, refused if it would leave less than 0x100 bytes of stack; 0 on failure */
+static uint32_t call_frame(MINION* pMi, const char* pWho, uint32_t sp0, uint32_t copyTop, uint32_t stkSize, uint8_t** ppStk) {
+	uint32_t stkBase;
+	copyTop &= ~15U;
+	if (copyTop < stkSize + 0x100 || sp0 > pMi->codeOrg) {
+		minion_err(pMi, "%s: stack overflow\n", pWho);
+		return 0;
+	}
+	stkBase = (copyTop - stkSize) & ~15U;
+	*ppStk = NULL;
+	if (stkSize > 0) {
+		*ppStk = (uint8_t*)minion_span(pMi, stkBase, stkSize);
+		if (!*ppStk) return 0;
+	}
+	return stkBase;
+}
+
+/* sets up the ILP32D frame below the current sp, runs the function to completion and fetches the result */
+int minion_call(MINION* pMi, MINION_FUNC_HANDLE hFn, const char* pSig, const MINION_VAL* pArgs, MINION_VAL* pRet) {
+	MINION_CALL_SLOT slots[MINION_CALL_MAX_ARGS];
+	uint32_t refs[MINION_CALL_MAX_ARGS];
+	uint32_t maps[MINION_CALL_MAX_ARGS];
+	int i, nargs, nmaps = 0;
+	int ok = 1;
+	char rt;
+	uint32_t sp0, copyTop, stkBase, stkSize, sret = 0;
+	uint8_t* pStk = NULL;
+	if (!pMi || !hFn || !pSig || !pSig[0] || pSig[1] != '(') return 0;
+	rt = pSig[0];
+	sp0 = (uint32_t)pMi->regs[2];
+	/* a fault from an earlier call must not stop this one */
+	pMi->faultFlags = 0;
+	pMi->pcStatus = 0;
+
+	/* by-reference copies and the sret buffer go right below sp, the outgoing stack area below them */
+	copyTop = sp0 & ~15U;
+	if (rt == MINION_SIG_STRUCT && pRet && pRet->mem.size > 8) {
+		copyTop = (copyTop - pRet->mem.size) & ~7U;
+		sret = copyTop;
+	}
+	nargs = call_plan(pSig + 2, pArgs, sret ? 1 : 0, slots, &stkSize);
+	if (nargs < 0 || ((rt == MINION_SIG_STRUCT_F || rt == MINION_SIG_STRUCT_D) && pRet && call_struct_nfregs(rt, pRet->mem.size) == 0)) {
+		minion_err(pMi, "call: unsupported signature \"%s\"\n", pSig);
+		return 0;
+	}
+	for (i = 0; i < nargs; ++i) {
+		if (slots[i].byRef) {
+			copyTop = (copyTop - pArgs[i].mem.size) & ~7U;
+			refs[i] = copyTop;
+		}
+	}
+	stkBase = call_frame(pMi, "call", sp0, copyTop, stkSize, &pStk);
+	if (!stkBase) return 0;
+
+	if (sret) {
+		pMi->regs[10] = (int32_t)sret;
+	}
+	for (i = 0; i < nargs && ok; ++i) {
+		const MINION_VAL* pArg = &pArgs[i];
+		const void* pSrc = pArg; /* scalars sit at the start of the union */
+		uint32_t w[4] = { 0, 0, 0, 0 };
+		if (slots[i].type == MINION_SIG_MEM) {
+			w[0] = minion_mem_map(pMi, pArg->mem.p, pArg->mem.size);
+			if (w[0]) {
+				maps[nmaps++] = w[0];
+			} else {
+				ok = 0;
+			}
+			pSrc = w;
+		} else if (call_is_struct(slots[i].type)) {
+			if (slots[i].byRef) {
+				ok = minion_write(pMi, refs[i], pArg->mem.p, pArg->mem.size);
+				w[0] = refs[i];
+			} else if (pArg->mem.p) {
+				memcpy(w, pArg->mem.p, pArg->mem.size);
+			}
+			pSrc = w;
+		}
+		call_put(pMi, &slots[i], pStk, pSrc);
+	}
+	if (ok) {
+		pMi->regs[2] = (int32_t)stkBase;
+		minion_set_ra(pMi, MINION_PC_NATIVE);
+		minion_set_pc_to_func_handle(pMi, hFn);
+		minion_exec(pMi);
+		ok = pMi->faultFlags == 0;
+	}
+	for (i = 0; i < nmaps; ++i) {
+		minion_mem_unmap(pMi, maps[i]);
+	}
+	pMi->regs[2] = (int32_t)sp0;
+
+	if (ok && pRet) {
+		switch (rt) {
+			case MINION_SIG_I32:
+			case MINION_SIG_U32:
+			case MINION_SIG_VPTR:
+				pRet->u = (uint32_t)pMi->regs[10];
+				break;
+			case MINION_SIG_I64:
+				pRet->l = (int64_t)(((uint64_t)(uint32_t)pMi->regs[11] << 32) | (uint32_t)pMi->regs[10]);
+				break;
+			case MINION_SIG_F32:
+				pRet->f = minion_get_freg_s(pMi, 10);
+				break;
+			case MINION_SIG_F64:
+				pRet->d = minion_get_freg_d(pMi, 10);
+				break;
+			case MINION_SIG_STRUCT:
+				if (sret) {
+					ok = minion_read(pMi, sret, pRet->mem.p, pRet->mem.size);
+				} else if (pRet->mem.p) {
+					memcpy(pRet->mem.p, &pMi->regs[10], pRet->mem.size);
+				}
+				break;
+			case MINION_SIG_STRUCT_F:
+			case MINION_SIG_STRUCT_D:
+				if (pRet->mem.p) {
+					uint32_t esize = rt == MINION_SIG_STRUCT_F ? 4 : 8;
+					for (i = 0; i < call_struct_nfregs(rt, pRet->mem.size); ++i) {
+						memcpy((uint8_t*)pRet->mem.p + i * esize, &pMi->fregs[10 + i], esize);
+					}
+				}
+				break;
+		}
+	}
+	return ok;
+}
+
+/* ppIn[i] points to an array of count values of the i-th argument type, results go to pOut; returns the number of completed calls */
+uint32_t minion_call_batch(MINION* pMi, MINION_FUNC_HANDLE hFn, const char* pSig, const void* const* ppIn, void* pOut, uint32_t count) {
+	MINION_CALL_SLOT slots[MINION_CALL_MAX_ARGS];
+	int i, nargs, argSize[MINION_CALL_MAX_ARGS], retSize;
+	uint32_t n, sp0, stkBase, stkSize = 0;
+	uint8_t* pStk = NULL;
+	if (!pMi || !hFn || !pSig || !pSig[0] || pSig[1] != '(') return 0;
+	retSize = call_sig_size(pSig[0]);
+	nargs = call_plan(pSig + 2, NULL, 0, slots, &stkSize);
+	if (retSize < 0 || nargs < 0 || (retSize > 0 && !pOut)) {
+		minion_err(pMi, "call_batch: unsupported signature \"%s\"\n", pSig);
+		return 0;
+	}
+	for (i = 0; i < nargs; ++i) {
+		argSize[i] = (int)slots[i].size;
+		if (!ppIn || !ppIn[i]) return 0;
+	}
+	pMi->faultFlags = 0;
+	pMi->pcStatus = 0;
+	sp0 = (uint32_t)pMi->regs[2];
+	stkBase = call_frame(pMi, "call_batch", sp0, sp0, stkSize, &pStk);
+	if (!stkBase) return 0;
+
+	for (n = 0; n < count; ++n) {
+		for (i = 0; i < nargs; ++i) {
+			call_put(pMi, &slots[i], pStk, (const uint8_t*)ppIn[i] + n * argSize[i]);
+		}
+		pMi->regs[2] = (int32_t)stkBase;
+		pMi->regs[1] = (int32_t)MINION_PC_NATIVE;
+		pMi->pc = hFn->addr;
+		do {
+			minion_instr(pMi, minion_fetch_pc_instr(pMi), MINION_IMODE_EXEC);
+		} while (!(pMi->pcStatus & MINION_PCSTATUS_NATIVE));
+		if (pMi->faultFlags) break;
+		if (retSize > 0) {
+			uint8_t* pDst = (uint8_t*)pOut + n * retSize;
+			if (pSig[0] == MINION_SIG_F32 || pSig[0] == MINION_SIG_F64) {
+				memcpy(pDst, &pMi->fregs[10], retSize);
+			} else {
+				memcpy(pDst, &pMi->regs[10], retSize);
+			}
+		}
+	}
+	pMi->regs[2] = (int32_t)sp0;
+	return n;
+}
+
+uint32_t minion_io_map(MINION* pMi, uint32_t size,
+                       uint32_t (*read_fn)(MINION*, MINION_IO_REGION*, uint32_t, int),
+                       void (*write_fn)(MINION*, MINION_IO_REGION*, uint32_t, uint32_t, int),
+                       void* pCtx) {
+	uint32_t vptr = 0;
+	if (!pMi) return 0;
+	if (size == 0 || size > (1U << MINION_VPTR_BITS)) {
+		minion_err(pMi, "can't create io map, size = 0x%X\n", size);
+	} else {
+		int i;
+		int idx = -1;
+		/* claimed and published the same way as memory slots */
+		for (i = 0; i < 16; ++i) {
+			uint32_t slotVptr = MINION_IO_TAG | ((uint32_t)i << MINION_VPTR_BITS);
+			if (MINION_LOAD_ACQ(&pMi->pCfg->ioMap[i].vptr) == 0 && MINION_ATOMIC_CAS(&pMi->pCfg->ioMap[i].vptr, 0, slotVptr)) {
+				idx = i;
+				break;
+			}
+		}
+		if (idx < 0) {
+			minion_err(pMi, "can't map io, no free slots\n");
+		} else {
+			MINION_IO_REGION* pIO = &pMi->pCfg->ioMap[idx];
+			vptr = MINION_IO_TAG | (idx << MINION_VPTR_BITS);
+			pIO->flags = 0;
+			minion_io_fifo_in(pIO, NULL, 0);
+			minion_io_fifo_out(pIO, NULL, 0);
+			pIO->read_fn = read_fn;
+			pIO->write_fn = write_fn;
+			pIO->pCtx = pCtx;
+			MINION_STORE_REL(&pIO->size, size);
+		}
+	}
+	return vptr;
+}
+
+uint32_t minion_io_map_fifo(MINION* pMi, const uint32_t* pIn, uint32_t inCount, uint32_t* pOut, uint32_t outCap) {
+	uint32_t vptr = minion_io_map(pMi, 8, NULL, NULL, NULL);
+	if (vptr) {
+		MINION_IO_REGION* pIO = minion_io_region(pMi, vptr);
+		pIO->flags |= MINION_IO_FIFO;
+		minion_io_fifo_in(pIO, pIn, inCount);
+		minion_io_fifo_out(pIO, pOut, outCap);
+	}
+	return vptr;
+}
+
+MINION_IO_REGION* minion_io_region(MINION* pMi, uint32_t vptr) {
+	uint32_t offs = 0;
+	if (!pMi || !minion_is_io_vptr(vptr)) return NULL;
+	return io_region_sub(pMi, vptr, &offs);
+}
+
+void minion_io_fifo_in(MINION_IO_REGION* pIO, const uint32_t* pIn, uint32_t inCount) {
+	if (!pIO) return;
+	pIO->pFifoIn = pIn;
+	pIO->fifoInCount = pIn ? inCount : 0;
+	pIO->fifoInPos = 0;
+}
+
+void minion_io_fifo_out(MINION_IO_REGION* pIO, uint32_t* pOut, uint32_t outCap) {
+	if (!pIO) return;
+	pIO->pFifoOut = pOut;
+	pIO->fifoOutCap = pOut ? outCap : 0;
+	pIO->fifoOutPos = 0;
+}
+
+void minion_io_unmap(MINION* pMi, uint32_t vptr) {
+	if (pMi && minion_is_io_vptr(vptr)) {
+		MINION_IO_REGION* pIO = &pMi->pCfg->ioMap[(vptr >> MINION_VPTR_BITS) & 0xF];
+		MINION_STORE_REL(&pIO->size, 0);
+		pIO->flags = 0;
+		minion_io_fifo_in(pIO, NULL, 0);
+		minion_io_fifo_out(pIO, NULL, 0);
+		pIO->read_fn = NULL;
+		pIO->write_fn = NULL;
+		pIO->pCtx = NULL;
+		MINION_STORE_REL(&pIO->vptr, 0);
+	} else {
+		minion_err(pMi, "can't unmap io, invalid vptr\n");
+	}
+}
+
+MINION_RING* minion_ring_init(void* pMem, uint32_t memSize, uint32_t elemSize) {
+	MINION_RING* pRing = (MINION_RING*)pMem;
+	uint32_t cap = 1;
+	if (!pMem || elemSize == 0 || (elemSize & 3) || memSize < sizeof(MINION_RING) + elemSize) {
+		minion_sys_err("can't create ring, mem size = 0x%X, elem size = %d\n", memSize, elemSize);
+		return NULL;
+	}
+	while ((cap << 1) * elemSize <= memSize - sizeof(MINION_RING)) {
+		cap <<= 1;
+	}
+	memset(pRing, 0, sizeof(MINION_RING));
+	pRing->mask = cap - 1;
+	pRing->elemSize = elemSize;
+	return pRing;
+}
+
+uint32_t minion_ring_mem_size(MINION_RING* pRing) {
+	if (!pRing) return 0;
+	return (uint32_t)sizeof(MINION_RING) + (pRing->mask + 1) * pRing->elemSize;
+}
+
+uint32_t minion_ring_map(MINION* pMi, MINION_RING* pRing) {
+	if (!pRing) return 0;
+	return minion_mem_map(pMi, pRing, minion_ring_mem_size(pRing));
+}
+
+uint32_t minion_ring_count(MINION_RING* pRing) {
+	if (!pRing) return 0;
+	return MINION_LOAD_ACQ(&pRing->head) - MINION_LOAD_ACQ(&pRing->tail);
+}
+
+uint32_t minion_ring_put(MINION_RING* pRing, const void* pSrc, uint32_t n) {
+	uint32_t head, tail, cap, pos, n0;
+	uint8_t* pData;
+	if (!pRing || !pSrc) return 0;
+	head = pRing->head;
+	tail = MINION_LOAD_ACQ(&pRing->tail);
+	cap = pRing->mask + 1;
+	if (n > cap - (head - tail)) {
+		n = cap - (head - tail);
+	}
+	if (n == 0) return 0;
+	pData = (uint8_t*)(pRing + 1);
+	pos = head & pRing->mask;
+	n0 = cap - pos;
+	if (n0 > n) n0 = n;
+	memcpy(pData + pos*pRing->elemSize, pSrc, n0*pRing->elemSize);
+	if (n > n0) {
+		memcpy(pData, (const uint8_t*)pSrc + n0*pRing->elemSize, (n - n0)*pRing->elemSize);
+	}
+	MINION_STORE_REL(&pRing->head, head + n);
+	return n;
+}
+
+uint32_t minion_ring_get(MINION_RING* pRing, void* pDst, uint32_t n) {
+	uint32_t head, tail, cap, pos, n0;
+	uint8_t* pData;
+	if (!pRing || !pDst) return 0;
+	tail = pRing->tail;
+	head = MINION_LOAD_ACQ(&pRing->head);
+	cap = pRing->mask + 1;
+	if (n > head - tail) {
+		n = head - tail;
+	}
+	if (n == 0) return 0;
+	pData = (uint8_t*)(pRing + 1);
+	pos = tail & pRing->mask;
+	n0 = cap - pos;
+	if (n0 > n) n0 = n;
+	memcpy(pDst, pData + pos*pRing->elemSize, n0*pRing->elemSize);
+	if (n > n0) {
+		memcpy((uint8_t*)pDst + n0*pRing->elemSize, pData, (n - n0)*pRing->elemSize);
+	}
+	MINION_STORE_REL(&pRing->tail, tail + n);
+	return n;
+}
+
+static uint32_t out_millis(void) {
+#if defined(_WIN32)
+	return (uint32_t)((double)clock() * 1000.0 / CLOCKS_PER_SEC);
+#else
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint32_t)ts.tv_sec * 1000U + (uint32_t)(ts.tv_nsec / 1000000);
+#endif
+}
+
+void minion_out_init(MINION_OUTBUF* pOut, void* pMem, uint32_t size, MINION_OUT_SINK sink, void* pUser) {
+	if (!pOut) return;
+	memset(pOut, 0, sizeof(MINION_OUTBUF));
+	pOut->pBuf = (char*)pMem;
+	pOut->size = pMem ? size : 0;
+	pOut->flushOnReturn = 1;
+	pOut->sink = sink ? sink : minion_out_file_sink;
+	pOut->pUser = sink ? pUser : (void*)stdout;
+}
+
+/* NULL detaches, pending output goes out first */
+void minion_out_attach(MINION* pMi, MINION_OUTBUF* pOut) {
+	if (!pMi || !pMi->pCold) return;
+	minion_out_flush(pMi);
+	pMi->pCold->pOut = pOut;
+}
+
+void minion_out_flush(MINION* pMi) {
+	MINION_OUTBUF* pOut = pMi && pMi->pCold ? pMi->pCold->pOut : NULL;
+	if (!pOut || pOut->used == 0) return;
+	pOut->sink(pOut->pUser, pOut->pBuf, pOut->used);
+	pOut->used = 0;
+}
+
+/* without a buffer attached this is a plain stdout write;
+   the age limit is only checked here, so output of a guest that stops writing waits for a flush or a return */
+void minion_out_write(MINION* pMi, const char* pData, uint32_t len) {
+	MINION_OUTBUF* pOut = pMi && pMi->pCold ? pMi->pCold->pOut : NULL;
+	if (!pData || len == 0) return;
+	if (!pOut) {
+		if (ctx_log(pMi)->level >= MINION_LOG_MSG) fwrite(pData, 1, len, stdout);
+		return;
+	}
+	if (len > pOut->size - pOut->used) {
+		minion_out_flush(pMi);
+		if (len >= pOut->size) {
+			pOut->sink(pOut->pUser, pData, len);
+			return;
+		}
+	}
+	if (pOut->used == 0 && pOut->flushMillis) {
+		pOut->t0 = out_millis();
+	}
+	memcpy(pOut->pBuf + pOut->used, pData, len);
+	pOut->used += len;
+	if ((pOut->flushSize && pOut->used >= pOut->flushSize) || (pOut->flushMillis && out_millis() - pOut->t0 >= pOut->flushMillis)) {
+		minion_out_flush(pMi);
+	}
+}
+
+void minion_out_printf(MINION* pMi, const char* pFmt, ...) {
+	char tmp[256];
+	char* pStr = tmp;
+	va_list argLst;
+	int len;
+	va_start(argLst, pFmt);
+	len = vsnprintf(tmp, sizeof(tmp), pFmt, argLst);
+	va_end(argLst);
+	if (len < 0) return;
+	if ((size_t)len >= sizeof(tmp)) {
+		pStr = (char*)malloc((size_t)len + 1);
+		if (!pStr) return;
+		va_start(argLst, pFmt);
+		vsnprintf(pStr, (size_t)len + 1, pFmt, argLst);
+		va_end(argLst);
+	}
+	minion_out_write(pMi, pStr, (uint32_t)len);
+	if (pStr != tmp) free(pStr);
+}
+
+/* pUser: FILE*, one fwrite per flushed chunk */
+void minion_out_file_sink(void* pUser, const char* pData, uint32_t len) {
+	fwrite(pData, 1, len, pUser ? (FILE*)pUser : stdout);
+}
+
+/* pUser: MINION_RING of MINION_OUT_CHUNK, single producer; chunks that don't fit are dropped with an error */
+void minion_out_ring_sink(void* pUser, const char* pData, uint32_t len) {
+	MINION_RING* pRing = (MINION_RING*)pUser;
+	MINION_OUT_CHUNK chunk;
+	if (!pRing || pRing->elemSize != sizeof(MINION_OUT_CHUNK)) return;
+	while (len > 0) {
+		chunk.len = len < sizeof(chunk.data) ? len : (uint32_t)sizeof(chunk.data);
+		memcpy(chunk.data, pData, chunk.len);
+		if (minion_ring_put(pRing, &chunk, 1) == 0) {
+			minion_sys_err("output ring full, %d bytes dropped\n", len);
+			return;
+		}
+		pData += chunk.len;
+		len -= chunk.len;
+	}
+}
+
+/* the ring must be set up with elemSize = sizeof(MINION_CMD), returns its guest address */
+uint32_t minion_cmd_ring_attach(MINION* pMi, MINION_RING* pRing) {
+	uint32_t vptr;
+	if (!pMi || !pRing) return 0;
+	if (pRing->elemSize != sizeof(MINION_CMD)) {
+		minion_err(pMi, "command ring element size %d != %d\n", pRing->elemSize, (int)sizeof(MINION_CMD));
+		return 0;
+	}
+	vptr = minion_ring_map(pMi, pRing);
+	if (vptr) {
+		pMi->pCmdRing = pRing;
+	}
+	return vptr;
+}
+
+void minion_cmd_ring_detach(MINION* pMi, uint32_t vptr) {
+	if (!pMi || !pMi->pCmdRing) return;
+	minion_cmd_flush(pMi);
+	minion_mem_unmap(pMi, vptr);
+	pMi->pCmdRing = NULL;
+}
+
+/* runs every queued command as if it were an ecall with args in a0-a2, a0-a7/fa0-fa7 are left as they were;
+   returns the number run, unknown and float-arg ids are dropped with an error */
+uint32_t minion_cmd_flush(MINION* pMi) {
+	MINION_CMD cmds[16];
+	MINION_CFG* pCfg;
+	int32_t aregs[8];
+	double faregs[8];
+	uint32_t i, n;
+	uint32_t total = 0;
+	uint32_t ndropped = 0;
+	if (!pMi || !pMi->pCmdRing) return 0;
+	pCfg = pMi->pCfg;
+	memcpy(aregs, &pMi->regs[10], sizeof(aregs));
+	memcpy(faregs, &pMi->fregs[10], sizeof(faregs));
+	while ((n = minion_ring_get(pMi->pCmdRing, cmds, sizeof(cmds) / sizeof(cmds[0]))) > 0) {
+		for (i = 0; i < n; ++i) {
+			uint32_t id = cmds[i].id;
+			if (id >= MINION_MAX_ECALLS || !pCfg->ecalls[id].invoke || (pCfg->ecalls[id].flags & MINION_NATIVE_FLG_FLOAT_ARGS)) {
+				++ndropped;
+				continue;
+			}
+			++pMi->pCold->ecallCounts[id];
+			pMi->regs[10] = (int32_t)cmds[i].args[0];
+			pMi->regs[11] = (int32_t)cmds[i].args[1];
+			pMi->regs[12] = (int32_t)cmds[i].args[2];
+			pMi->regs[17] = (int32_t)id;
+			pCfg->ecalls[id].invoke(pMi, &pCfg->ecalls[id]);
+			++total;
+		}
+	}
+	memcpy(&pMi->regs[10], aregs, sizeof(aregs));
+	memcpy(&pMi->fregs[10], faregs, sizeof(faregs));
+	if (ndropped) {
+		minion_err(pMi, "cmd ring: %d commands with unknown or float-arg ids dropped\n", ndropped);
+	}
+	return total;
+}
+
+uint32_t minion_name_hash(const char* pName) {
+	uint32_t h = 2166136261U;
+	if (pName) {
+		while (*pName) {
+			h ^= (uint8_t)*pName++;
+			h *= 16777619U;
+		}
+	}
+	return h;
+}
+
+uint32_t minion_func_hash_size(int nfuncs) {
+	uint32_t size = 4;
+	while (size < (uint32_t)nfuncs * 2) {
+		size <<= 1;
+	}
+	return size;
+}
+
+void minion_func_hash_build(const MINION_FUNC_INFO* pFuncs, int nfuncs, uint32_t* pHash, uint32_t mask) {
+	int i;
+	if (!pFuncs || !pHash) return;
+	memset(pHash, 0, (mask + 1) * sizeof(uint32_t));
+	for (i = 0; i < nfuncs; ++i) {
+		uint32_t h = minion_name_hash(pFuncs[i].pName) & mask;
+		while (pHash[h] != 0) {
+			h = (h + 1) & mask;
+		}
+		pHash[h] = (uint32_t)i + 1;
+	}
+}
+
+/* fills per-function name hashes and builds the lookup index once at load time */
+static void bin_index_funcs(MINION_BIN* pBin) {
+	int i;
+	if (!pBin->pFuncs || pBin->nfuncs <= 0) return;
+	for (i = 0; i < pBin->nfuncs; ++i) {
+		pBin->pFuncs[i].hash = minion_name_hash(pBin->pFuncs[i].pName);
+	}
+	if (pBin->pFuncHash) return;
+	pBin->funcHashMask = minion_func_hash_size(pBin->nfuncs) - 1;
+	pBin->pFuncHash = (uint32_t*)minion_mem_alloc(&pBin->alloc, (pBin->funcHashMask + 1) * sizeof(uint32_t));
+	if (pBin->pFuncHash) {
+		minion_func_hash_build(pBin->pFuncs, pBin->nfuncs, pBin->pFuncHash, pBin->funcHashMask);
+	} else {
+		pBin->funcHashMask = 0;
+	}
+}
+
+static int find_func_sub(MINION_FUNC_INFO* pFuncs, int nfuncs, const uint32_t* pHash, uint32_t mask, const char* pFnName) {
 	if (pFuncs && pFnName) {
 		int i;
+		if (pHash) {
+			uint32_t hash = minion_name_hash(pFnName);
+			uint32_t h = hash & mask;
+			uint32_t n;
+			for (n = 0; n <= mask; ++n) {
+				uint32_t e = pHash[h];
+				if (e == 0) break;
+				if (e <= (uint32_t)nfuncs && pFuncs[e - 1].hash == hash && strcmp(pFnName, pFuncs[e - 1].pName) == 0) {
+					return (int)e - 1;
+				}
+				h = (h + 1) & mask;
+			}
+			return -1;
+		}
 		for (i = 0; i < nfuncs; ++i) {
 			if (strcmp(pFnName, pFuncs[i].pName) == 0) {
 				return i;
@@ -189,136 +1260,136 @@ static int find_func_sub(MINION_FUNC_INFO* pFuncs, int nfuncs, const char* pFnNa
 int minion_bin_find_func(MINION_BIN* pBin, const char* pFnName) {
 	int id = -1;
 	if (pBin) {
-		id = find_func_sub(pBin->pFuncs, pBin->nfuncs, pFnName);
+		id = find_func_sub(pBin->pFuncs, pBin->nfuncs, pBin->pFuncHash, pBin->funcHashMask, pFnName);
 	}
 	return id;
 }
 
 int minion_find_func(MINION* pMi, const char* pFnName) {
 	int id = -1;
-	if (pMi) {
-		id = find_func_sub(pMi->pFuncs, pMi->nfuncs, pFnName);
+	if (pMi && pMi->pProg) {
+		id = minion_bin_find_func(&pMi->pProg->bin, pFnName);
+	} else if (pMi) {
+		id = find_func_sub(pMi->pCfg->pFuncs, pMi->pCfg->nfuncs, pMi->pCfg->pFuncHash, pMi->pCfg->funcHashMask, pFnName);
 	}
 	return id;
 }
 
+static MINION_FUNC_INFO* ctx_funcs(MINION* pMi, int* pNum) {
+	if (pMi->pProg) {
+		*pNum = pMi->pProg->bin.nfuncs;
+		return pMi->pProg->bin.pFuncs;
+	}
+	*pNum = pMi->pCfg->nfuncs;
+	return pMi->pCfg->pFuncs;
+}
+
 int minion_valid_func_idx(MINION* pMi, int ifn) {
-	return pMi && ifn >= 0 && ifn < pMi->nfuncs;
+	int nfuncs = 0;
+	if (!pMi) return 0;
+	ctx_funcs(pMi, &nfuncs);
+	return ifn >= 0 && ifn < nfuncs;
 }
 
 void minion_set_pc_to_func_idx(MINION* pMi, int ifn) {
 	if (minion_valid_func_idx(pMi, ifn)) {
-		pMi->pc = pMi->pFuncs[ifn].addr;
+		int nfuncs;
+		pMi->pc = ctx_funcs(pMi, &nfuncs)[ifn].addr;
 	}
 }
 
-void minion_set_pc_to_func(MINION* pMi, const char* pFnName) {
+MINION_FUNC_HANDLE minion_get_func(MINION* pMi, const char* pFnName) {
+	int i;
 	int ifn = minion_find_func(pMi, pFnName);
-	minion_set_pc_to_func_idx(pMi, ifn);
+	if (minion_valid_func_idx(pMi, ifn)) {
+		int nfuncs;
+		return &ctx_funcs(pMi, &nfuncs)[ifn];
+	}
+	for (i = 0; pMi && i < pMi->pCfg->nmods; ++i) {
+		MINION_BIN* pLib = pMi->pCfg->mods[i].pBin;
+		ifn = minion_bin_find_func(pLib, pFnName);
+		if (ifn >= 0) {
+			return &pLib->pFuncs[ifn];
+		}
+	}
+	return NULL;
 }
 
-uint32_t minion_get_func_instr_count(MINION* pMi, const char* pFnName) {
-	uint32_t n = 0;
-	int ifn = minion_find_func(pMi, pFnName);
-	if (ifn >= 0) {
-		n = pMi->pFuncs[ifn].size >> 2;
+void minion_set_pc_to_func_handle(MINION* pMi, MINION_FUNC_HANDLE hFn) {
+	if (pMi && hFn) {
+		pMi->pc = hFn->addr;
 	}
-	return n;
 }
 
-typedef struct _MINION_IN_STREAM {
-	FILE* pFile;
-	void* pMem;
-	long offs;
-	size_t size;
-} MINION_IN_STREAM;
-
-static char* ins_gets(MINION_IN_STREAM* pIn, MINION_BIN* pBin) {
-	char* pStr = NULL;
-	if (pIn && pBin) {
-		if (pIn->pFile) {
-			pStr = fgets(pBin->tmpStr, MINION_TSTR_SIZE, pIn->pFile);
-		} else if (pIn->pMem) {
-			size_t len = 0;
-			long offs = pIn->offs;
-			char* p = (char*)pIn->pMem;
-			while (1) {
-				char c;
-				if (offs >= pIn->size) {
-					break;
-				}
-				c = p[offs];
-				++offs;
-				if (c == '\n') {
-					break;
-				}
-			}
-			len = offs - pIn->offs;
-			if (len < MINION_TSTR_SIZE-1) {
-				pStr = pBin->tmpStr;
-				memcpy(pStr, (char*)pIn->pMem + pIn->offs, len);
-				pStr[len] = 0;
-			}
-			pIn->offs = offs;
-		}
-	}
-	return pStr;
+void minion_set_pc_to_func(MINION* pMi, const char* pFnName) {
+	minion_set_pc_to_func_handle(pMi, minion_get_func(pMi, pFnName));
 }
 
-static size_t ins_read(MINION_IN_STREAM* pIn, void* pDst, size_t size) {
-	size_t nread = 0;
-	if (pIn && pDst) {
-		if (pIn->pFile) {
-			nread = fread(pDst, 1, size, pIn->pFile);
-		} else if (pIn->pMem) {
-			long noffs = pIn->offs + (long)size;
-			if (pDst && (noffs <= pIn->size)) {
-				memcpy(pDst, (uint8_t*)pIn->pMem + pIn->offs, size);
-				pIn->offs = noffs;
-				nread = size;
-			}
-		}
-	}
-	return nread;
+uint32_t minion_get_func_instr_count(MINION* pMi, const char* pFnName) {
+	MINION_FUNC_HANDLE hFn = minion_get_func(pMi, pFnName);
+	return hFn ? hFn->size >> 2 : 0;
+}
+
+/* one header line, NUL-terminated in place */
+static char* bin1_line(char** ppCur, char* pEnd) {
+	char* pLine = *ppCur;
+	char* pEol;
+	if (pLine >= pEnd) return NULL;
+	pEol = (char*)memchr(pLine, '\n', pEnd - pLine);
+	if (!pEol) return NULL;
+	*pEol = 0;
+	if (pEol > pLine && pEol[-1] == '\r') pEol[-1] = 0;
+	*ppCur = pEol + 1;
+	return pLine;
 }
 
-static long ins_offs(MINION_IN_STREAM* pIn) {
-	long offs = 0;
-	if (pIn) {
-		if (pIn->pFile) {
-			offs = ftell(pIn->pFile);
-		} else if (pIn->pMem) {
-			offs = pIn->offs;
+/* offset of the payload, i.e. the end of the $bin line, without touching the image; 0 if there is none */
+static size_t bin1_header_size(const char* pMem, size_t memSize) {
+	const char* pCur = pMem;
+	const char* pEnd = pMem + memSize;
+	while (pCur < pEnd) {
+		const char* pEol = (const char*)memchr(pCur, '\n', pEnd - pCur);
+		if (!pEol) break;
+		if (pEol - pCur >= 4 && memcmp(pCur, "$bin", 4) == 0) {
+			return (size_t)(pEol + 1 - pMem);
 		}
+		pCur = pEol + 1;
 	}
-	return offs;
+	return 0;
 }
 
-static void ins_seek(MINION_IN_STREAM* pIn, long offs) {
-	if (pIn) {
-		if (pIn->pFile) {
-			fseek(pIn->pFile, offs, SEEK_SET);
-		} else if (pIn->pMem) {
-			pIn->offs = offs;
-		}
+/* the payload is used in place: guest words and doubles are accessed directly, so it must be 8-aligned on the host,
+   which the build scripts ensure by padding the $bin line */
+static int bin1_payload(MINION_BIN* pBin, char* pPayload, size_t avail) {
+	if (((uintptr_t)pPayload & 7) != 0) {
+		minion_sys_err("Misaligned binary part, the header must be padded to 8 bytes!\n");
+		pBin->binSize = 0;
+		return 0;
 	}
+	if (pBin->binSize > avail) {
+		minion_sys_err("Incomplete binary part!\n");
+		pBin->binSize = (uint32_t)avail;
+	}
+	pBin->pBinMem = pPayload;
+	return 1;
 }
 
-static void minion_bin_in(MINION_BIN* pBin, MINION_IN_STREAM* pIn) {
+/* single pass over the writable header of a MINION 1 image, names are used where they are;
+   returns the payload offset, 0 on error */
+static size_t bin1_parse(MINION_BIN* pBin, char* pMem, size_t memSize) {
 	int i;
-	size_t nameMemSize = 0;
-	long funcsLstOffs = 0;
-	char* pStr = ins_gets(pIn, pBin);
+	char* pCur = pMem;
+	char* pEnd = pMem + memSize;
+	char* pStr = bin1_line(&pCur, pEnd);
 	const char* pVer = ck_str_cmd(pStr, "MINION");
 	if (!pVer) {
 		minion_sys_err("Not a MINION!\n");
-		return;
+		return 0;
 	}
 	pBin->version = atoi(pVer);
 
-	while (1) {
+	while ((pStr = bin1_line(&pCur, pEnd))) {
 		const char* pArg;
-		pStr = ins_gets(pIn, pBin);
 		if ((pArg = ck_str_cmd(pStr, "$code"))) {
 			pBin->codeOrg = u32_hex(pArg, skip_chars(pArg) - pArg);
 		} else if ((pArg = ck_str_cmd(pStr, "$data"))) {
@@ -328,57 +1399,38 @@ static void minion_bin_in(MINION_BIN* pBin, MINION_IN_STREAM* pIn) {
 		} else if ((pArg = ck_str_cmd(pStr, "$gp"))) {
 			pBin->gpIni = u32_hex(pArg, skip_chars(pArg) - pArg);
 		} else if ((pArg = ck_str_cmd(pStr, "$bin"))) {
-			size_t nread;
 			pBin->binSize = (uint32_t)atoi(pArg);
-			pBin->pBinMem = malloc(pBin->binSize);
-			nread = ins_read(pIn, pBin->pBinMem, pBin->binSize);
-			if (nread != pBin->binSize) {
-				minion_sys_err("Incomplete binary part!\n");
-			}
+			bin_index_funcs(pBin);
+			return (size_t)(pCur - pMem);
 		} else if ((pArg = ck_str_cmd(pStr, "$funcs"))) {
 			pBin->nfuncs = atoi(pArg);
-			pBin->pFuncs = (MINION_FUNC_INFO*)malloc(pBin->nfuncs * sizeof(MINION_FUNC_INFO));
-			funcsLstOffs = ins_offs(pIn);
+			pBin->pFuncs = (MINION_FUNC_INFO*)minion_mem_alloc(&pBin->alloc, pBin->nfuncs * sizeof(MINION_FUNC_INFO));
+			if (!pBin->pFuncs) {
+				minion_sys_err("Can't allocate function table!\n");
+				pBin->nfuncs = 0;
+				return 0;
+			}
 			for (i = 0; i < pBin->nfuncs; ++i) {
-				uint32_t funcAddr;
-				uint32_t funcSize;
 				const char* pSizeArg;
-				const char* pNameArg;
-				uint32_t nameSize;
-				pStr = ins_gets(pIn, pBin);
+				char* pNameArg;
+				pStr = bin1_line(&pCur, pEnd);
+				if (!pStr) {
+					pBin->nfuncs = i;
+					break;
+				}
 				pSizeArg = skip_space(skip_chars(pStr));
-				pNameArg = skip_space(skip_chars(pSizeArg));
-				funcAddr = u32_hex(pStr, skip_chars(pStr) - pStr);
-				funcSize = atoi(pSizeArg);
-				nameSize = (uint32_t)(skip_chars(pNameArg) - pNameArg);
-				nameMemSize += nameSize + 1;
-				pBin->pFuncs[i].addr = funcAddr;
-				pBin->pFuncs[i].size = funcSize;
+				pNameArg = (char*)skip_space(skip_chars(pSizeArg));
+				*(char*)skip_chars(pNameArg) = 0;
+				pBin->pFuncs[i].addr = u32_hex(pStr, skip_chars(pStr) - pStr);
+				pBin->pFuncs[i].size = atoi(pSizeArg);
+				pBin->pFuncs[i].pName = pNameArg;
 			}
 		} else {
 			break;
 		}
 	}
-
-	if (pBin->nfuncs && nameMemSize && funcsLstOffs > 0) {
-		char* pNameMem;
-		ins_seek(pIn, funcsLstOffs);
-		pBin->pNameMem = (char*)malloc(nameMemSize);
-		memset(pBin->pNameMem, 0, nameMemSize);
-		pNameMem = pBin->pNameMem;
-		for (i = 0; i < pBin->nfuncs; ++i) {
-			const char* pSizeArg;
-			const char* pNameArg;
-			uint32_t nameSize;
-			pStr = ins_gets(pIn, pBin);
-			pSizeArg = skip_space(skip_chars(pStr));
-			pNameArg = skip_space(skip_chars(pSizeArg));
-			nameSize = (uint32_t)(skip_chars(pNameArg) - pNameArg);
-			memcpy(pNameMem, pNameArg, nameSize);
-			pBin->pFuncs[i].pName = pNameMem;
-			pNameMem += nameSize + 1;
-		}
-	}
+	bin_index_funcs(pBin);
+	return 0;
 }
 
 void minion_bin_info(MINION_BIN* pBin) {
@@ -391,6 +1443,7 @@ void minion_bin_info(MINION_BIN* pBin) {
 	minion_sys_msg("gp: %X\n", pBin->gpIni);
 	minion_sys_msg("nfuncs: %d\n", pBin->nfuncs);
 	minion_sys_msg("binSize: %d (0x%X)\n", pBin->binSize, pBin->binSize);
+	minion_sys_msg("bssSize: %d (0x%X)\n", pBin->bssSize, pBin->bssSize);
 	minion_sys_msg("pBinMem: %p\n", pBin->pBinMem);
 	if (pBin->pFuncs) {
 		for (i = 0; i < pBin->nfuncs; ++i) {
@@ -401,33 +1454,121 @@ void minion_bin_info(MINION_BIN* pBin) {
 	}
 }
 
+#include "minion_bin2.c"
+#include "minion_elf.c"
+#include "minion_fs.c"
+#include "minion_async.c"
+#include "minion_pool.c"
+#include "minion_harts.c"
+
+/* MINION 1: pMem is left untouched but its payload is used in place, so it must outlive pBin */
 void minion_bin_from_mem(MINION_BIN* pBin, void* pMem, size_t memSize) {
-	if (pBin && pMem && memSize > 0) {
-		MINION_IN_STREAM ins;
-		ins.pFile = NULL;
-		ins.pMem = pMem;
-		ins.offs = 0;
-		ins.size = memSize;
-		minion_bin_in(pBin, &ins);
+	if (pBin && minion_bin2_ck_magic(pMem, memSize)) {
+		minion_bin2_from_mem(pBin, pMem, memSize);
+	} else if (pBin && minion_elf_ck_magic(pMem, memSize)) {
+		minion_bin_elf_from_mem(pBin, pMem, memSize);
+	} else if (pBin && pMem && memSize > 0) {
+		/* only the header is copied, the payload stays where it is */
+		size_t hdrSize = bin1_header_size((const char*)pMem, memSize);
+		if (hdrSize == 0) {
+			minion_sys_err("Not a MINION!\n");
+			return;
+		}
+		pBin->pMetaMem = minion_mem_alloc(&pBin->alloc, hdrSize);
+		if (!pBin->pMetaMem) {
+			minion_sys_err("Can't allocate binary header!\n");
+			return;
+		}
+		memcpy(pBin->pMetaMem, pMem, hdrSize);
+		pBin->metaSize = hdrSize;
+		pBin->flags |= MINION_BIN_FLG_NAMES_REF | MINION_BIN_FLG_BIN_REF;
+		if (bin1_parse(pBin, (char*)pBin->pMetaMem, hdrSize) == hdrSize) {
+			bin1_payload(pBin, (char*)pMem + hdrSize, memSize - hdrSize);
+		}
 	} else {
 		minion_sys_err("bin_from_mem error\n");
 	}
 }
 
-static void minion_bin_read(MINION_BIN* pBin, FILE* pFile) {
-	if (pFile && pBin) {
-		MINION_IN_STREAM ins;
-		ins.pFile = pFile;
-		ins.pMem = NULL;
-		minion_bin_in(pBin, &ins);
+/* MINION 1 only: the caller's buffer is modified and must outlive pBin */
+void minion_bin_from_mem_inplace(MINION_BIN* pBin, void* pMem, size_t memSize) {
+	if (pBin && pMem && memSize > 0 && !minion_bin2_ck_magic(pMem, memSize) && !minion_elf_ck_magic(pMem, memSize)) {
+		size_t hdrSize;
+		pBin->flags |= MINION_BIN_FLG_NAMES_REF | MINION_BIN_FLG_BIN_REF;
+		hdrSize = bin1_parse(pBin, (char*)pMem, memSize);
+		if (hdrSize) {
+			bin1_payload(pBin, (char*)pMem + hdrSize, memSize - hdrSize);
+		}
+	} else {
+		minion_bin_from_mem(pBin, pMem, memSize);
+	}
+}
+
+#ifdef MINION_NO_MMAP
+static void bin1_load(MINION_BIN* pBin, FILE* pFile) {
+	size_t hdrSize;
+	long len = 0;
+	if (fseek(pFile, 0, SEEK_END) == 0) {
+		len = ftell(pFile);
+		fseek(pFile, 0, SEEK_SET);
+	}
+	if (len > 0) {
+		pBin->pMetaMem = minion_mem_alloc(&pBin->alloc, (size_t)len);
+	}
+	if (!pBin->pMetaMem || fread(pBin->pMetaMem, 1, (size_t)len, pFile) != (size_t)len) {
+		minion_sys_err("Can't read binary!\n");
+		return;
+	}
+	pBin->metaSize = (size_t)len;
+	pBin->flags |= MINION_BIN_FLG_NAMES_REF | MINION_BIN_FLG_BIN_REF;
+	hdrSize = bin1_parse(pBin, (char*)pBin->pMetaMem, pBin->metaSize);
+	if (hdrSize) {
+		bin1_payload(pBin, (char*)pBin->pMetaMem + hdrSize, pBin->metaSize - hdrSize);
+	}
+}
+#else
+/* private writable mapping: header lines are terminated in place, image pages are copied on first guest write */
+static void bin1_load(MINION_BIN* pBin, FILE* pFile) {
+	size_t hdrSize;
+	struct stat st;
+	void* pMap;
+	int fd = fileno(pFile);
+	if (fstat(fd, &st) != 0 || st.st_size <= 0) {
+		minion_sys_err("Can't stat binary!\n");
+		return;
+	}
+	pMap = mmap(NULL, (size_t)st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+	if (pMap == MAP_FAILED) {
+		minion_sys_err("Can't map binary!\n");
+		return;
+	}
+	pBin->pMetaMem = pMap;
+	pBin->metaSize = (size_t)st.st_size;
+	pBin->flags |= MINION_BIN_FLG_META_MAPPED | MINION_BIN_FLG_NAMES_REF | MINION_BIN_FLG_BIN_REF;
+	hdrSize = bin1_parse(pBin, (char*)pMap, pBin->metaSize);
+	if (hdrSize) {
+		bin1_payload(pBin, (char*)pMap + hdrSize, pBin->metaSize - hdrSize);
 	}
 }
+#endif
 
 void minion_bin_load(MINION_BIN* pBin, const char* pPath) {
 	if (pPath) {
-		FILE* pFile = fopen(pPath, "r+b");
+		FILE* pFile = fopen(pPath, "rb");
 		if (pFile) {
-			minion_bin_read(pBin, pFile);
+			char magic[8];
+			size_t nmagic = fread(magic, 1, sizeof(magic), pFile);
+			if (minion_bin2_ck_magic(magic, nmagic)) {
+				fclose(pFile);
+				minion_bin2_load(pBin, pPath);
+				return;
+			}
+			if (minion_elf_ck_magic(magic, nmagic)) {
+				fclose(pFile);
+				minion_bin_load_elf(pBin, pPath);
+				return;
+			}
+			bin1_load(pBin, pFile);
 			fclose(pFile);
 		} else {
 			minion_sys_err("Can't find \"%s\".\n", pPath);
@@ -438,58 +1579,568 @@ void minion_bin_load(MINION_BIN* pBin, const char* pPath) {
 }
 
 void minion_bin_free(MINION_BIN* pBin) {
+	MINION_ALLOCATOR alloc;
 	if (!pBin) return;
-	if (pBin->pFuncs) {
-		free(pBin->pFuncs);
+	alloc = pBin->alloc;
+	minion_mem_free(&alloc, pBin->pFuncs);
+	if (!(pBin->flags & MINION_BIN_FLG_NAMES_REF)) {
+		minion_mem_free(&alloc, pBin->pNameMem);
+	}
+	if (!(pBin->flags & MINION_BIN_FLG_HASH_REF)) {
+		minion_mem_free(&alloc, pBin->pFuncHash);
 	}
-	if (pBin->pNameMem) {
-		free(pBin->pNameMem);
+	if (pBin->flags & MINION_BIN_FLG_BIN_MAPPED) {
+		bin2_unmap(pBin->pBinMem, pBin->binMapSize);
+	} else if (!(pBin->flags & MINION_BIN_FLG_BIN_REF)) {
+		minion_mem_free(&alloc, pBin->pBinMem);
 	}
-	if (pBin->pBinMem) {
-		free(pBin->pBinMem);
+	if (pBin->flags & MINION_BIN_FLG_META_MAPPED) {
+		bin2_unmap(pBin->pMetaMem, pBin->metaSize);
+	} else {
+		minion_mem_free(&alloc, pBin->pMetaMem);
 	}
 	memset(pBin, 0, sizeof(MINION_BIN));
+	pBin->alloc = alloc;
 }
 
-void minion_init(MINION* pMi, MINION_BIN* pBin) {
-	if (!pMi) return;
+/* borrowed images (file pages, the caller's buffer) get a private copy, so patching them touches nothing else; call before creating contexts */
+int minion_bin_copy_image(MINION_BIN* pBin) {
+	void* pCopy;
+	if (!pBin || !pBin->pBinMem) return -1;
+	if (!(pBin->flags & (MINION_BIN_FLG_BIN_REF | MINION_BIN_FLG_BIN_MAPPED))) return 0;
+	pCopy = minion_mem_alloc(&pBin->alloc, pBin->binSize);
+	if (!pCopy) {
+		minion_sys_err("Can't allocate image copy!\n");
+		return -1;
+	}
+	memcpy(pCopy, pBin->pBinMem, pBin->binSize);
+	if (pBin->flags & MINION_BIN_FLG_BIN_MAPPED) {
+		bin2_unmap(pBin->pBinMem, pBin->binMapSize);
+		pBin->binMapSize = 0;
+	}
+	pBin->pBinMem = pCopy;
+	pBin->flags &= ~(MINION_BIN_FLG_BIN_REF | MINION_BIN_FLG_BIN_MAPPED);
+	return 0;
+}
+
+void minion_cfg_init(MINION_CFG* pCfg, MINION_BIN* pBin) {
+	if (!pCfg) return;
+	memset(pCfg, 0, sizeof(MINION_CFG));
+	pCfg->log = s_defLog;
 	if (!pBin) return;
+	pCfg->pBin = pBin;
+	pCfg->alloc = pBin->alloc;
+	pCfg->pFuncs = pBin->pFuncs;
+	pCfg->nfuncs = pBin->nfuncs;
+	pCfg->pFuncHash = pBin->pFuncHash;
+	pCfg->funcHashMask = pBin->funcHashMask;
+	pCfg->gpIni = pBin->gpIni;
+}
 
-	pMi->pBinMem = pBin->pBinMem;
-	pMi->codeOrg = pBin->codeOrg;
-	pMi->binSize = pBin->binSize;
-	pMi->nfuncs = pBin->nfuncs;
-	pMi->pFuncs = pBin->pFuncs;
+int minion_cfg_add_module(MINION_CFG* pCfg, MINION_BIN* pLib) {
+	int i;
+	uint32_t org, end;
+	if (!pCfg || !pLib || !pLib->pBinMem) return -1;
+	if (pCfg->nmods >= MINION_MAX_MODULES) {
+		minion_sys_err("Too many modules!\n");
+		return -1;
+	}
+	org = pLib->codeOrg;
+	end = org + pLib->binSize;
+	if (end < org || end > MINION_PC_NATIVE || (pCfg->pBin && org < pCfg->pBin->codeOrg + pCfg->pBin->binSize)) {
+		minion_sys_err("Module @ %X overlaps the main image!\n", org);
+		return -1;
+	}
+	for (i = 0; i < pCfg->nmods; ++i) {
+		if (org < pCfg->mods[i].org + pCfg->mods[i].size && end > pCfg->mods[i].org) {
+			minion_sys_err("Module @ %X overlaps module[%d]!\n", org, i);
+			return -1;
+		}
+	}
+	pCfg->mods[pCfg->nmods].pBin = pLib;
+	pCfg->mods[pCfg->nmods].org = org;
+	pCfg->mods[pCfg->nmods].size = pLib->binSize;
+	pCfg->mods[pCfg->nmods].pMem = pLib->pBinMem;
+	return pCfg->nmods++;
+}
+
+/* modules are matched by pBin, later ones move down a slot */
+int minion_cfg_remove_module(MINION_CFG* pCfg, MINION_BIN* pLib) {
+	int i;
+	if (!pCfg || !pLib) return -1;
+	for (i = 0; i < pCfg->nmods; ++i) {
+		if (pCfg->mods[i].pBin == pLib) {
+			memmove(&pCfg->mods[i], &pCfg->mods[i + 1], (pCfg->nmods - i - 1) * sizeof(MINION_MODULE));
+			--pCfg->nmods;
+			memset(&pCfg->mods[pCfg->nmods], 0, sizeof(MINION_MODULE));
+			return 0;
+		}
+	}
+	return -1;
+}
+
+/* overwrites an import stub with lui t1 + jalr x0 to addr */
+static int bin_patch_stub(MINION_BIN* pBin, const MINION_FUNC_INFO* pStub, uint32_t addr) {
+	uint32_t hi, lo, code[2];
+	if (pStub->size < sizeof(code) || pStub->addr < pBin->codeOrg || pStub->addr - pBin->codeOrg + sizeof(code) > pBin->binSize) {
+		minion_sys_err("Bad import stub %s!\n", pStub->pName);
+		return -1;
+	}
+	hi = (addr + 0x800) & 0xFFFFF000U;
+	lo = (addr - hi) & 0xFFF;
+	code[0] = hi | (6 << 7) | 0x37;
+	code[1] = (lo << 20) | (6 << 15) | 0x67;
+	memcpy((uint8_t*)pBin->pBinMem + (pStub->addr - pBin->codeOrg), code, sizeof(code));
+	return 0;
+}
+
+/* patches every __imp_<name> stub in pBin with a jump to <name> in pLib, returns the count of unresolved stubs */
+int minion_bin_link(MINION_BIN* pBin, MINION_BIN* pLib) {
+	int i;
+	int nunres = 0;
+	size_t lpfx = strlen(MINION_IMP_PREFIX);
+	if (!pBin || !pLib || !pBin->pBinMem) return -1;
+	for (i = 0; i < pBin->nfuncs; ++i) {
+		const MINION_FUNC_INFO* pStub = &pBin->pFuncs[i];
+		int iexp;
+		if (strncmp(pStub->pName, MINION_IMP_PREFIX, lpfx) != 0) continue;
+		iexp = minion_bin_find_func(pLib, pStub->pName + lpfx);
+		if (iexp < 0 || bin_patch_stub(pBin, pStub, pLib->pFuncs[iexp].addr) != 0) {
+			++nunres;
+		}
+	}
+	return nunres;
+}
+
+/* stubs jumping into pLib are put back to the unresolved ebreak + ret form, returns the count of stubs reset */
+int minion_bin_unlink(MINION_BIN* pBin, MINION_BIN* pLib) {
+	static const uint32_t unres[2] = { 0x00100073, 0x00008067 };
+	int i;
+	int nreset = 0;
+	size_t lpfx = strlen(MINION_IMP_PREFIX);
+	if (!pBin || !pLib || !pBin->pBinMem) return -1;
+	for (i = 0; i < pBin->nfuncs; ++i) {
+		const MINION_FUNC_INFO* pStub = &pBin->pFuncs[i];
+		uint32_t code[2], addr;
+		uint8_t* pCode;
+		if (strncmp(pStub->pName, MINION_IMP_PREFIX, lpfx) != 0) continue;
+		if (pStub->size < sizeof(code) || pStub->addr < pBin->codeOrg || pStub->addr - pBin->codeOrg + sizeof(code) > pBin->binSize) continue;
+		pCode = (uint8_t*)pBin->pBinMem + (pStub->addr - pBin->codeOrg);
+		memcpy(code, pCode, sizeof(code));
+		if ((code[0] & 0xFFF) != ((6 << 7) | 0x37) || (code[1] & 0xFFFFF) != ((6 << 15) | 0x67)) continue;
+		addr = (code[0] & 0xFFFFF000U) + (uint32_t)((int32_t)code[1] >> 20);
+		if (addr - pLib->codeOrg < pLib->binSize) {
+			memcpy(pCode, unres, sizeof(unres));
+			++nreset;
+		}
+	}
+	return nreset;
+}
+
+static uint32_t cfg_add_native(MINION_CFG* pCfg, const char* pName, MINION_NATIVE_RAW_FN invoke, MINION_NATIVE_FN fn, void* pUser) {
+	MINION_NATIVE* pNat;
+	if (pCfg->nnatives >= MINION_MAX_NATIVES) {
+		minion_sys_err("Too many native imports!\n");
+		return 0;
+	}
+	pNat = &pCfg->natives[pCfg->nnatives];
+	pNat->invoke = invoke;
+	pNat->fn = fn;
+	pNat->pName = pName;
+	pNat->pUser = pUser;
+	return MINION_PC_IMPORT + (uint32_t)(pCfg->nnatives++) * 4;
+}
+
+static MINION_NATIVE_RAW_FN native_shape(const char* pSig) {
+	char sig[16];
+	size_t i;
+	for (i = 0; i < sizeof(sig) - 1 && pSig[i]; ++i) {
+		sig[i] = (pSig[i] == MINION_SIG_U32 || pSig[i] == MINION_SIG_VPTR) ? MINION_SIG_I32 : pSig[i];
+	}
+	sig[i] = 0;
+	for (i = 0; i < sizeof(s_nativeShapes) / sizeof(s_nativeShapes[0]); ++i) {
+		if (strcmp(sig, s_nativeShapes[i].pSig) == 0) {
+			return s_nativeShapes[i].invoke;
+		}
+	}
+	minion_sys_err("Unsupported native signature %s!\n", pSig);
+	return NULL;
+}
+
+/* returns the thunk address guests may call directly, 0 if the signature has no native shape */
+uint32_t minion_bind_native(MINION_CFG* pCfg, const char* pName, const char* pSig, MINION_NATIVE_FN fn) {
+	MINION_NATIVE_RAW_FN invoke;
+	if (!pCfg || !pSig || !fn) return 0;
+	invoke = native_shape(pSig);
+	return invoke ? cfg_add_native(pCfg, pName, invoke, fn, NULL) : 0;
+}
+
+uint32_t minion_bind_native_raw(MINION_CFG* pCfg, const char* pName, MINION_NATIVE_RAW_FN fn, void* pUser) {
+	if (!pCfg || !fn) return 0;
+	return cfg_add_native(pCfg, pName, fn, NULL, pUser);
+}
+
+/* points __imp_<name> stubs at the thunks of natives bound under <name>, returns the count of stubs left alone */
+int minion_bin_link_natives(MINION_BIN* pBin, MINION_CFG* pCfg) {
+	int i, j;
+	int nunres = 0;
+	size_t lpfx = strlen(MINION_IMP_PREFIX);
+	if (!pBin || !pCfg || !pBin->pBinMem) return -1;
+	for (i = 0; i < pBin->nfuncs; ++i) {
+		const MINION_FUNC_INFO* pStub = &pBin->pFuncs[i];
+		if (strncmp(pStub->pName, MINION_IMP_PREFIX, lpfx) != 0) continue;
+		for (j = 0; j < pCfg->nnatives; ++j) {
+			if (pCfg->natives[j].pName && strcmp(pCfg->natives[j].pName, pStub->pName + lpfx) == 0) break;
+		}
+		if (j >= pCfg->nnatives || bin_patch_stub(pBin, pStub, MINION_PC_IMPORT + (uint32_t)j * 4) != 0) {
+			++nunres;
+		}
+	}
+	return nunres;
+}
+
+/* ecall id in a7, arguments and results in a0-a3/fa0-fa1 as for natives */
+int minion_register_ecall(MINION_CFG* pCfg, uint32_t id, MINION_NATIVE_FN fn, const char* pSig) {
+	MINION_NATIVE_RAW_FN invoke;
+	if (!pCfg || !fn || !pSig || id >= MINION_MAX_ECALLS) return -1;
+	invoke = native_shape(pSig);
+	if (!invoke) return -1;
+	pCfg->ecalls[id].invoke = invoke;
+	pCfg->ecalls[id].fn = fn;
+	pCfg->ecalls[id].pName = NULL;
+	pCfg->ecalls[id].pUser = NULL;
+	pCfg->ecalls[id].flags = strpbrk(strchr(pSig, '('), "fd") ? MINION_NATIVE_FLG_FLOAT_ARGS : 0;
+	return 0;
+}
+
+int minion_register_ecall_raw(MINION_CFG* pCfg, uint32_t id, MINION_NATIVE_RAW_FN fn, void* pUser) {
+	if (!pCfg || !fn || id >= MINION_MAX_ECALLS) return -1;
+	pCfg->ecalls[id].invoke = fn;
+	pCfg->ecalls[id].fn = NULL;
+	pCfg->ecalls[id].pName = NULL;
+	pCfg->ecalls[id].pUser = pUser;
+	pCfg->ecalls[id].flags = 0;
+	return 0;
+}
+
+/* MINION_NATIVE_FLG_*, on an id that is already registered; registering again clears them */
+int minion_set_ecall_flags(MINION_CFG* pCfg, uint32_t id, uint32_t flags) {
+	if (!pCfg || id >= MINION_MAX_ECALLS || !pCfg->ecalls[id].invoke) return -1;
+	pCfg->ecalls[id].flags = flags;
+	return 0;
+}
+
+/* sums over nctxs consecutive instances, e.g. a pool's or ctx_array's; read while they are idle */
+uint32_t minion_ecall_count(const MINION* pCtxs, int nctxs, uint32_t id) {
+	uint32_t n = 0;
+	int i;
+	if (!pCtxs || id >= MINION_MAX_ECALLS) return 0;
+	for (i = 0; i < nctxs; ++i) {
+		if (pCtxs[i].pCold) n += pCtxs[i].pCold->ecallCounts[id];
+	}
+	return n;
+}
+
+static int cfg_replace(MINION_CFG* pCfg, const char* pName, char retType, MINION_NATIVE_RAW_FN invoke, MINION_NATIVE_FN fn, void* pUser, uint32_t checkEvery) {
+	MINION_BIN* pBin = pCfg->pBin;
+	MINION_REPLACED* pRep;
+	uint32_t addr, instr;
+	int ifn;
+	if (!pBin || !pBin->pBinMem) return -1;
+	if (checkEvery && retType == MINION_SIG_VOID) {
+		minion_sys_err("Can't check %s: only functions with a result can be checked!\n", pName);
+		return -1;
+	}
+	if (pBin->flags & (MINION_BIN_FLG_BIN_REF | MINION_BIN_FLG_BIN_MAPPED)) {
+		minion_sys_err("Can't replace %s: the image is borrowed, see minion_bin_copy_image!\n", pName);
+		return -1;
+	}
+	if (pCfg->nrepls >= MINION_MAX_REPLACED) {
+		minion_sys_err("Too many replaced functions!\n");
+		return -1;
+	}
+	ifn = minion_bin_find_func(pBin, pName);
+	if (ifn < 0) {
+		minion_sys_err("Can't replace %s: no such function!\n", pName);
+		return -1;
+	}
+	addr = pBin->pFuncs[ifn].addr;
+	if (addr < pBin->codeOrg || addr - pBin->codeOrg + 4 > pBin->binSize) {
+		minion_sys_err("Can't replace %s: bad address!\n", pName);
+		return -1;
+	}
+	memcpy(&instr, (uint8_t*)pBin->pBinMem + (addr - pBin->codeOrg), 4);
+	if ((instr & 0x7F) == 0x0B) {
+		minion_sys_err("%s is already replaced!\n", pName);
+		return -1;
+	}
+	pRep = &pCfg->repls[pCfg->nrepls];
+	memset(pRep, 0, sizeof(MINION_REPLACED));
+	pRep->nat.invoke = invoke;
+	pRep->nat.fn = fn;
+	pRep->nat.pName = pBin->pFuncs[ifn].pName;
+	pRep->nat.pUser = pUser;
+	pRep->pBin = pBin;
+	pRep->pImage = pBin->pBinMem;
+	pRep->addr = addr;
+	pRep->origInstr = instr;
+	pRep->retType = retType;
+	pRep->checkEvery = checkEvery;
+	instr = 0x0B | ((uint32_t)pCfg->nrepls << 7);
+	memcpy((uint8_t*)pBin->pBinMem + (addr - pBin->codeOrg), &instr, 4);
+	return pCfg->nrepls++;
+}
+
+/* patches the entry of pName in the cfg's image, every cfg sharing that image must carry the same replacements;
+   checkEvery > 0 runs both copies on every n-th call and compares the results, so it is only for pure functions */
+int minion_replace_func(MINION_CFG* pCfg, const char* pName, const char* pSig, MINION_NATIVE_FN fn, uint32_t checkEvery) {
+	MINION_NATIVE_RAW_FN invoke;
+	if (!pCfg || !pName || !pSig || !fn) return -1;
+	invoke = native_shape(pSig);
+	return invoke ? cfg_replace(pCfg, pName, pSig[0], invoke, fn, NULL, checkEvery) : -1;
+}
+
+int minion_replace_func_raw(MINION_CFG* pCfg, const char* pName, char retType, MINION_NATIVE_RAW_FN fn, void* pUser, uint32_t checkEvery) {
+	if (!pCfg || !pName || !fn) return -1;
+	return cfg_replace(pCfg, pName, retType, fn, NULL, pUser, checkEvery);
+}
+
+/* entries patched into an image the cfg no longer runs (e.g. after a hot swap) are dropped, not written back */
+void minion_restore_funcs(MINION_CFG* pCfg) {
+	if (!pCfg) return;
+	while (pCfg->nrepls > 0) {
+		MINION_REPLACED* pRep = &pCfg->repls[--pCfg->nrepls];
+		if (pRep->pBin != pCfg->pBin || !pCfg->pBin || pRep->pImage != pCfg->pBin->pBinMem) {
+			minion_sys_err("Not restoring %s: the image has changed!\n", pRep->nat.pName);
+			continue;
+		}
+		memcpy((uint8_t*)pCfg->pBin->pBinMem + (pRep->addr - pCfg->pBin->codeOrg), &pRep->origInstr, 4);
+	}
+}
+
+void minion_ctx_init_ext(MINION* pMi, MINION_CFG* pCfg, void* pStkMem, size_t stkSize) {
+	if (!pMi) return;
+	if (!pCfg || !pCfg->pBin) return;
+
+	memset(pMi, 0, sizeof(MINION));
+	pMi->pCold = (MINION_COLD*)minion_mem_alloc(&pCfg->alloc, sizeof(MINION_COLD));
+	if (!pMi->pCold) {
+		minion_err(pMi, "can't allocate instance state\n");
+		pMi->faultFlags |= 1;
+		return;
+	}
+	memset(pMi->pCold, 0, sizeof(MINION_COLD));
+	pMi->flags |= MINION_FLG_OWN_COLD;
+	pMi->pCfg = pCfg;
+	pMi->pCold->log = pCfg->log;
+	pMi->pBinMem = pCfg->pBin->pBinMem;
+	pMi->codeOrg = pCfg->pBin->codeOrg;
+	pMi->binSize = pCfg->pBin->binSize;
 
 	if (pMi->codeOrg) {
-		size_t stkSize = pMi->codeOrg;
-		pMi->pStkMem = malloc(stkSize);
-		memset(pMi->pStkMem, 0, stkSize);
+		if (pStkMem) {
+			if (stkSize < pMi->codeOrg) {
+				minion_err(pMi, "stack buffer too small: 0x%X < 0x%X\n", (uint32_t)stkSize, pMi->codeOrg);
+				pMi->faultFlags |= 1;
+				return;
+			}
+			pMi->pStkMem = pStkMem;
+		} else {
+			pMi->pStkMem = minion_mem_alloc(&pCfg->alloc, pMi->codeOrg);
+			if (!pMi->pStkMem) {
+				minion_err(pMi, "can't allocate stack\n");
+				pMi->faultFlags |= 1;
+				return;
+			}
+			pMi->flags |= MINION_FLG_OWN_STK;
+		}
+		memset(pMi->pStkMem, 0, pMi->codeOrg);
 	}
 
 	minion_set_ra(pMi, MINION_PC_NATIVE);
 	minion_set_sp(pMi, pMi->codeOrg);
-	minion_set_gp(pMi, pBin->gpIni);
+	minion_set_gp(pMi, pCfg->gpIni);
+}
 
-	pMi->faultFlags = 0;
+void minion_ctx_init(MINION* pMi, MINION_CFG* pCfg) {
+	minion_ctx_init_ext(pMi, pCfg, NULL, 0);
+}
+
+/* takes over the contents of pBin, which is left empty */
+MINION_PROG* minion_prog_create(MINION_BIN* pBin) {
+	MINION_PROG* pProg;
+	MINION_ALLOCATOR alloc;
+	if (!pBin || !pBin->pBinMem) return NULL;
+	alloc = pBin->alloc;
+	pProg = (MINION_PROG*)minion_mem_alloc(&alloc, sizeof(MINION_PROG));
+	if (!pProg) return NULL;
+	pProg->bin = *pBin;
+	pProg->refs = 1;
+	memset(pBin, 0, sizeof(MINION_BIN));
+	pBin->alloc = alloc;
+	return pProg;
+}
+
+MINION_PROG* minion_prog_load(const char* pPath, const MINION_ALLOCATOR* pAlloc) {
+	MINION_BIN bin;
+	MINION_PROG* pProg;
+	memset(&bin, 0, sizeof(bin));
+	if (pAlloc) {
+		bin.alloc = *pAlloc;
+	}
+	minion_bin_load(&bin, pPath);
+	pProg = minion_prog_create(&bin);
+	if (!pProg) {
+		minion_bin_free(&bin);
+	}
+	return pProg;
+}
+
+void minion_prog_retain(MINION_PROG* pProg) {
+	if (pProg) {
+		MINION_ATOMIC_INC(&pProg->refs);
+	}
+}
+
+void minion_prog_release(MINION_PROG* pProg) {
+	if (pProg && MINION_ATOMIC_DEC(&pProg->refs) == 0) {
+		MINION_ALLOCATOR alloc = pProg->bin.alloc;
+		minion_bin_free(&pProg->bin);
+		minion_mem_free(&alloc, pProg);
+	}
+}
+
+/* the slot takes over the caller's reference */
+void minion_prog_slot_init(MINION_PROG_SLOT* pSlot, MINION_PROG* pProg) {
+	if (!pSlot) return;
+	pSlot->pProg = pProg;
+	pSlot->lock = 0;
+}
+
+MINION_PROG* minion_prog_slot_acquire(MINION_PROG_SLOT* pSlot) {
+	MINION_PROG* pProg;
+	if (!pSlot) return NULL;
+	MINION_SPIN_LOCK(&pSlot->lock);
+	pProg = pSlot->pProg;
+	minion_prog_retain(pProg);
+	MINION_SPIN_UNLOCK(&pSlot->lock);
+	return pProg;
+}
+
+/* publishes pProg (the slot takes over the caller's reference), the old image lives on until its last user releases it */
+void minion_prog_slot_swap(MINION_PROG_SLOT* pSlot, MINION_PROG* pProg) {
+	MINION_PROG* pOld;
+	if (!pSlot) return;
+	MINION_SPIN_LOCK(&pSlot->lock);
+	pOld = pSlot->pProg;
+	pSlot->pProg = pProg;
+	MINION_SPIN_UNLOCK(&pSlot->lock);
+	minion_prog_release(pOld);
+}
+
+void minion_prog_slot_reset(MINION_PROG_SLOT* pSlot) {
+	minion_prog_slot_swap(pSlot, NULL);
+}
+
+/* rebinding needs the same code origin: the stack below it was sized for the first image */
+int minion_ctx_bind(MINION* pMi, MINION_PROG* pProg) {
+	if (!pMi || !pProg) return 0;
+	if (pMi->pProg == pProg) return 1;
+	if (pProg->bin.codeOrg != pMi->codeOrg) {
+		minion_err(pMi, "bind: code org %X != %X\n", pProg->bin.codeOrg, pMi->codeOrg);
+		return 0;
+	}
+	minion_prog_retain(pProg);
+	minion_ctx_unbind(pMi);
+	pMi->pProg = pProg;
+	pMi->pBinMem = pProg->bin.pBinMem;
+	pMi->binSize = pProg->bin.binSize;
+	minion_set_gp(pMi, pProg->bin.gpIni);
+	return 1;
+}
+
+/* call at the start of each guest call: picks up the slot's current image, in-flight calls elsewhere keep theirs */
+int minion_ctx_bind_slot(MINION* pMi, MINION_PROG_SLOT* pSlot) {
+	MINION_PROG* pProg = minion_prog_slot_acquire(pSlot);
+	int res = minion_ctx_bind(pMi, pProg);
+	minion_prog_release(pProg);
+	return res;
+}
+
+void minion_ctx_unbind(MINION* pMi) {
+	MINION_PROG* pProg;
+	if (!pMi || !pMi->pProg) return;
+	pProg = pMi->pProg;
+	pMi->pProg = NULL;
+	if (pMi->pCfg && pMi->pCfg->pBin) {
+		pMi->pBinMem = pMi->pCfg->pBin->pBinMem;
+		pMi->binSize = pMi->pCfg->pBin->binSize;
+	} else {
+		pMi->pBinMem = NULL;
+		pMi->binSize = 0;
+	}
+	minion_prog_release(pProg);
+}
+
+MINION* minion_ctx_array_alloc(const MINION_ALLOCATOR* pAlloc, int n) {
+	uint8_t* pMem;
+	uintptr_t addr;
+	if (n <= 0) return NULL;
+	pMem = (uint8_t*)minion_mem_alloc(pAlloc, n * sizeof(MINION) + MINION_CACHE_LINE + sizeof(void*));
+	if (!pMem) return NULL;
+	addr = (uintptr_t)(pMem + sizeof(void*) + MINION_CACHE_LINE - 1) & ~(uintptr_t)(MINION_CACHE_LINE - 1);
+	((void**)addr)[-1] = pMem;
+	memset((void*)addr, 0, n * sizeof(MINION));
+	return (MINION*)addr;
+}
+
+void minion_ctx_array_free(const MINION_ALLOCATOR* pAlloc, MINION* pCtxs) {
+	if (pCtxs) {
+		minion_mem_free(pAlloc, ((void**)pCtxs)[-1]);
+	}
+}
+
+void minion_init(MINION* pMi, MINION_BIN* pBin) {
+	MINION_CFG* pCfg;
+	if (!pMi) return;
+	if (!pBin) return;
+
+	pCfg = (MINION_CFG*)minion_mem_alloc(&pBin->alloc, sizeof(MINION_CFG));
+	if (!pCfg) return;
+	minion_cfg_init(pCfg, pBin);
+	minion_ctx_init(pMi, pCfg);
+	pMi->flags |= MINION_FLG_OWN_CFG;
 }
 
 void minion_release(MINION* pMi) {
+	MINION_ALLOCATOR alloc;
 	if (!pMi) return;
-	if (pMi->pStkMem) {
-		free(pMi->pStkMem);
+	memset(&alloc, 0, sizeof(alloc));
+	minion_async_detach(pMi);
+	minion_out_flush(pMi);
+	minion_ctx_unbind(pMi);
+	if (pMi->pCfg) {
+		alloc = pMi->pCfg->alloc;
+	}
+	if (pMi->flags & MINION_FLG_OWN_STK) {
+		minion_mem_free(&alloc, pMi->pStkMem);
+	}
+	if (pMi->flags & MINION_FLG_OWN_COLD) {
+		minion_mem_free(&alloc, pMi->pCold);
+	}
+	if (pMi->flags & MINION_FLG_OWN_CFG) {
+		minion_mem_free(&alloc, pMi->pCfg);
 	}
 	memset(pMi, 0, sizeof(MINION));
 }
 
-void minion_set_silent(int flg) {
-	s_silentFlg = flg;
-}
-
-void minion_enable_alt_regnames(int flg) {
-	s_altRegNames = flg;
+/* call before creating cfgs, typically once at startup */
+void minion_set_default_log(const MINION_LOG* pLog) {
+	if (!pLog) return;
+	s_defLog = *pLog;
 }
 
-void minion_enable_alt_mnemonics(int flg) {
-	s_altMnemonics = flg;
+void minion_set_log(MINION* pMi, const MINION_LOG* pLog) {
+	if (!pMi || !pMi->pCold) return;
+	pMi->pCold->log = pLog ? *pLog : s_defLog;
 }
@@ -13,17 +13,47 @@
 extern "C" {
 #endif
 
-#define MINION_TSTR_SIZE 4096
-
 #define MINION_VPTR_TAG 0xDA000000
 #define MINION_VPTR_TAG_MASK 0xFF000000
 #define MINION_VPTR_BITS 20
 
+#define MINION_IO_TAG 0xDB000000
+
 #define MINION_PC_NATIVE 0xD00D0000
+#define MINION_PC_IMPORT 0xD00E0000 /* native import thunks, 4 bytes apart */
 
 #define MINION_IMODE_EXEC (1 << 0)
 #define MINION_IMODE_ECHO (1 << 1)
 
+#define MINION_CACHE_LINE 64
+
+#if defined(_MSC_VER)
+#	define MINION_ALIGNED __declspec(align(MINION_CACHE_LINE))
+#else
+#	define MINION_ALIGNED __attribute__((aligned(MINION_CACHE_LINE)))
+#endif
+
+#define MINION_LOG_NONE 0
+#define MINION_LOG_ERR 1
+#define MINION_LOG_MSG 2
+
+#define MINION_LOG_STD_REGNAMES (1 << 0) /* x10/f10 instead of a0/fa0 */
+#define MINION_LOG_STD_MNEMONICS (1 << 1) /* no mv/li/ret/j/fmv.s pseudo-instructions */
+
+typedef void (*MINION_LOG_FN)(void* pUser, int level, const char* pMsg);
+
+/* diagnostics sink, fn == NULL: errors to stderr, messages to stdout */
+typedef struct _MINION_LOG {
+	MINION_LOG_FN fn;
+	void* pUser;
+	int level; /* messages above this level are dropped before formatting */
+	uint32_t flags;
+} MINION_LOG;
+
+#define MINION_FLG_OWN_CFG (1 << 0)
+#define MINION_FLG_OWN_STK (1 << 1)
+#define MINION_FLG_OWN_COLD (1 << 2)
+
 #define MINION_PCSTATUS_JAL    (1)
 #define MINION_PCSTATUS_JALR   (1 << 1)
 #define MINION_PCSTATUS_RET    (1 << 2)
@@ -34,14 +64,128 @@ typedef struct _MINION_FUNC_INFO {
 	const char* pName;
 	uint32_t addr;
 	uint32_t size;
+	uint32_t hash;
 } MINION_FUNC_INFO;
 
+/* stays valid for the lifetime of the binary, resolve once and call through it */
+typedef const MINION_FUNC_INFO* MINION_FUNC_HANDLE;
+
+#define MINION_MEM_RO (1 << 0) /* guest stores fault */
+
 typedef struct _MINION_MEM_MAP {
 	void* p;
 	uint32_t size;
 	uint32_t vptr;
+	uint32_t flags;
 } MINION_MEM_MAP;
 
+#define MINION_IO_FIFO (1 << 0)
+
+#define MINION_IO_FIFO_DATA 0
+#define MINION_IO_FIFO_AVAIL 4
+
+struct _MINION;
+
+typedef struct _MINION_IO_REGION {
+	uint32_t (*read_fn)(struct _MINION* pMi, struct _MINION_IO_REGION* pIO, uint32_t offs, int size);
+	void (*write_fn)(struct _MINION* pMi, struct _MINION_IO_REGION* pIO, uint32_t offs, uint32_t val, int size);
+	void* pCtx;
+	uint32_t size;
+	uint32_t vptr;
+	uint32_t flags;
+	const uint32_t* pFifoIn;
+	uint32_t fifoInCount;
+	uint32_t fifoInPos;
+	uint32_t* pFifoOut;
+	uint32_t fifoOutCap;
+	uint32_t fifoOutPos;
+} MINION_IO_REGION;
+
+typedef struct _MINION_RING {
+	uint32_t head;
+	uint32_t pad0[15];
+	uint32_t tail;
+	uint32_t pad1[15];
+	uint32_t mask;
+	uint32_t elemSize;
+	uint32_t pad2[14];
+} MINION_RING;
+
+typedef void (*MINION_OUT_SINK)(void* pUser, const char* pData, uint32_t len);
+
+/* per-instance guest output, handed to the sink in chunks instead of one stdio write per fragment */
+typedef struct _MINION_OUTBUF {
+	char* pBuf;
+	uint32_t size;
+	uint32_t used;
+	uint32_t flushSize; /* pending bytes that trigger a flush, 0: only when full */
+	uint32_t flushMillis; /* max age of pending output, 0: no time limit; checked on writes only, not by a timer */
+	uint32_t flushOnReturn; /* flush when the guest returns to MINION_PC_NATIVE */
+	uint32_t t0;
+	MINION_OUT_SINK sink;
+	void* pUser;
+} MINION_OUTBUF;
+
+/* element of the ring fed by minion_out_ring_sink, for a consumer on another thread */
+typedef struct _MINION_OUT_CHUNK {
+	uint32_t len;
+	char data[60];
+} MINION_OUT_CHUNK;
+
+/* fire-and-forget host call queued by the guest, run through the cfg ecall table on flush */
+typedef struct _MINION_CMD {
+	uint32_t id;
+	uint32_t args[3];
+} MINION_CMD;
+
+typedef struct _MINION_IOVEC {
+	uint32_t vptr;
+	void* p;
+	uint32_t size;
+} MINION_IOVEC;
+
+#define MINION_BIN2_MAGIC "MINION2\0"
+#define MINION_BIN2_ALIGN 0x1000
+
+#define MINION_BIN_FLG_BIN_MAPPED (1 << 0)
+#define MINION_BIN_FLG_META_MAPPED (1 << 1)
+#define MINION_BIN_FLG_NAMES_REF (1 << 2)
+#define MINION_BIN_FLG_HASH_REF (1 << 3)
+#define MINION_BIN_FLG_BIN_REF (1 << 4)
+
+typedef struct _MINION_BIN2_HEAD {
+	char magic[8];
+	uint32_t version;
+	uint32_t headSize;
+	uint32_t codeOrg;
+	uint32_t dataOrg;
+	uint32_t sdataOrg;
+	uint32_t gpIni;
+	uint32_t imgOffs;
+	uint32_t imgSize;
+	uint32_t bssSize;
+	uint32_t nfuncs;
+	uint32_t funcsOffs;
+	uint32_t hashSize;
+	uint32_t hashOffs;
+	uint32_t strOffs;
+	uint32_t strSize;
+	uint32_t reserved[3];
+} MINION_BIN2_HEAD;
+
+typedef struct _MINION_BIN2_FUNC {
+	uint32_t nameOffs;
+	uint32_t addr;
+	uint32_t size;
+	uint32_t hash;
+} MINION_BIN2_FUNC;
+
+typedef struct _MINION_ALLOCATOR {
+	void* (*alloc_fn)(void* pUser, size_t size);
+	void (*free_fn)(void* pUser, void* p);
+	void* pUser;
+} MINION_ALLOCATOR;
+
 typedef struct _MINION_BIN {
 	int version;
 	uint32_t codeOrg;
@@ -49,20 +193,185 @@ typedef struct _MINION_BIN {
 	uint32_t sdataOrg;
 	uint32_t gpIni;
 	uint32_t binSize;
+	uint32_t bssSize;
+	uint32_t flags;
 	int nfuncs;
 	void* pBinMem;
 	char* pNameMem;
 	MINION_FUNC_INFO* pFuncs;
-	char tmpStr[MINION_TSTR_SIZE];
+	uint32_t* pFuncHash;
+	uint32_t funcHashMask;
+	void* pMetaMem;
+	size_t metaSize;
+	size_t binMapSize;
+	MINION_ALLOCATOR alloc;
 } MINION_BIN;
 
-typedef struct _MINION {
-	void* pBinMem;
+#define MINION_MAX_MODULES 8
+#define MINION_IMP_PREFIX "__imp_"
+
+/* extra code module sharing the address space, its MINION_BIN may back any number of cfgs */
+typedef struct _MINION_MODULE {
+	MINION_BIN* pBin;
+	uint32_t org;
+	uint32_t size;
+	void* pMem;
+} MINION_MODULE;
+
+#define MINION_MAX_NATIVES 64
+
+typedef void (*MINION_NATIVE_FN)(void);
+
+/* host function behind an import thunk, invoke() reads its arguments straight from a0-a7/fa0-fa7 */
+typedef struct _MINION_NATIVE {
+	void (*invoke)(struct _MINION*, const struct _MINION_NATIVE*);
+	MINION_NATIVE_FN fn;
+	const char* pName;
+	void* pUser;
+	uint32_t flags;
+} MINION_NATIVE;
+
+/* handler touches only its arguments and guest memory, so async ecalls may run it on a worker */
+#define MINION_NATIVE_FLG_ASYNC_SAFE (1 << 0)
+/* handler reads fa-regs, command rings can't feed it; set by minion_register_ecall from the signature */
+#define MINION_NATIVE_FLG_FLOAT_ARGS (1 << 1)
+
+typedef void (*MINION_NATIVE_RAW_FN)(struct _MINION*, const MINION_NATIVE*);
+
+#define MINION_MAX_REPLACED 16
+
+/* guest function whose entry instruction is swapped for a custom-0 call to a host implementation */
+typedef struct _MINION_REPLACED {
+	MINION_NATIVE nat;
+	MINION_BIN* pBin; /* image the entry was patched in, restore skips it once the cfg moved on */
+	void* pImage;
+	uint32_t addr;
+	uint32_t origInstr;
+	char retType;
+	uint32_t checkEvery; /* every Nth call also runs the guest copy and compares the results, 0: never */
+	uint32_t ncalls;
+	uint32_t nchecked;
+	uint32_t nmismatches;
+} MINION_REPLACED;
+
+#define MINION_MAX_ECALLS 64 /* a7 ids dispatched through the cfg table, others go to ecall_fn */
+
+typedef struct _MINION_CFG {
+	MINION_BIN* pBin;
 	MINION_FUNC_INFO* pFuncs;
-	uint32_t codeOrg;
-	uint32_t binSize;
 	int nfuncs;
+	uint32_t* pFuncHash;
+	uint32_t funcHashMask;
+	uint32_t gpIni;
+	void* pUser;
+	MINION_ALLOCATOR alloc;
+	void (*ecall_fn)(struct _MINION*);
+	void (*ebreak_fn)(struct _MINION*);
+	void (*aext_fn)(struct _MINION*, uint32_t op, int rd, int rs1, int rs2, uint32_t instr, uint32_t mode); /* overrides the built-in A extension */
+	/* shared by every instance on the cfg: pool workers, harts and async snapshots see (and use up) each other's maps */
+	MINION_MEM_MAP memMap[16];
+	MINION_IO_REGION ioMap[16];
+	MINION_MODULE mods[MINION_MAX_MODULES];
+	int nmods;
+	MINION_NATIVE natives[MINION_MAX_NATIVES];
+	int nnatives;
+	MINION_NATIVE ecalls[MINION_MAX_ECALLS];
+	MINION_REPLACED repls[MINION_MAX_REPLACED];
+	int nrepls;
+	MINION_LOG log; /* copied into each instance at init */
+} MINION_CFG;
+
+/* minion_call signature: "<ret>(<args>)", e.g. "d(ilpm)" */
+#define MINION_SIG_VOID 'v'
+#define MINION_SIG_I32 'i'
+#define MINION_SIG_U32 'u'
+#define MINION_SIG_I64 'l'
+#define MINION_SIG_F32 'f'
+#define MINION_SIG_F64 'd'
+#define MINION_SIG_VPTR 'p' /* guest address, passed as is */
+#define MINION_SIG_MEM 'm' /* host memory mapped for the duration of the call */
+#define MINION_SIG_STRUCT 's' /* integer aggregate by value: a0/a1 up to 8 bytes, else by reference (sret for returns) */
+#define MINION_SIG_STRUCT_F 'F' /* aggregate of one or two floats: one fa-reg per member while enough are free, else as 's' */
+#define MINION_SIG_STRUCT_D 'D' /* aggregate of one or two doubles, passed as 'F' */
+/* aggregates mixing float and integer members have no signature code, MINION_VAL.mem describes any of them */
+
+#define MINION_CALL_MAX_ARGS 16
+
+typedef struct _MINION_BLOB {
+	void* p;
+	uint32_t size;
+} MINION_BLOB;
+
+typedef union _MINION_VAL {
+	int32_t i;
+	uint32_t u;
+	int64_t l;
+	float f;
+	double d;
+	uint32_t vptr;
+	MINION_BLOB mem;
+} MINION_VAL;
+
+#define MINION_FS_MAX_FILES 16
+#define MINION_FS_MAX_MAPS 8
+
+#define MINION_FS_MODE_READ 0
+#define MINION_FS_MODE_WRITE 1
+#define MINION_FS_MODE_APPEND 2
+
+#define MINION_FS_MAP_RO 0
+#define MINION_FS_MAP_COW 1
+
+/* file ecalls take ids firstId.. in this order */
+enum {
+	MINION_FS_OPEN = 0, /* a0: path, a1: MINION_FS_MODE_* -> a0: handle or -1 */
+	MINION_FS_READ, /* a0: handle, a1: dst, a2: len -> a0: bytes read or -1 */
+	MINION_FS_WRITE, /* a0: handle, a1: src, a2: len -> a0: bytes written or -1 */
+	MINION_FS_CLOSE, /* a0: handle -> a0: 0 or -1 */
+	MINION_FS_STAT, /* a0: path -> a0/a1: 64-bit size or -1 */
+	MINION_FS_MMAP, /* a0: handle, a1: offset, a2: len, a3: MINION_FS_MAP_* -> a0: vptr or 0 */
+	MINION_FS_MUNMAP, /* a0: vptr */
+
+	MINION_FS_NUM_ECALLS
+};
+
+typedef struct _MINION_FS_MAP {
+	void* pBase;
+	size_t baseSize;
+	uint32_t vptr;
+	int isMapped; /* pBase came from mmap, else malloc */
+} MINION_FS_MAP;
+
+/* guest file access confined to one host directory */
+typedef struct _MINION_FS {
+	char root[1024];
+	FILE* pFiles[MINION_FS_MAX_FILES];
+	MINION_FS_MAP maps[MINION_FS_MAX_MAPS];
+	void* pLock; /* guards pFiles and maps, the fs is shared by every instance on the cfg */
+} MINION_FS;
+
+/* refcounted program image, instances bind to it per call so a newer build can be swapped in under them */
+typedef struct _MINION_PROG {
+	MINION_BIN bin;
+	uint32_t refs;
+} MINION_PROG;
+
+typedef struct _MINION_PROG_SLOT {
+	MINION_PROG* pProg;
+	uint32_t lock;
+} MINION_PROG_SLOT;
 
+/* per instance state the run loop rarely reads, kept off the hot context */
+typedef struct _MINION_COLD {
+	MINION_OUTBUF* pOut;
+	struct _MINION_ASYNC* pAsync;
+	struct _MINION_HARTS* pHarts;
+	MINION_LOG log;
+	uint32_t ecallCounts[MINION_MAX_ECALLS]; /* per instance, so counting never shares a line between threads */
+} MINION_COLD;
+
+/* execution context: only what the run loop touches, padded to whole cache lines */
+typedef struct MINION_ALIGNED _MINION {
 	int32_t regs[32];
 	double fregs[32];
 	uint32_t pc;
@@ -70,14 +379,137 @@ typedef struct _MINION {
 	uint32_t fcsr;
 	uint32_t instrsExecuted;
 	uint32_t faultFlags;
+	uint32_t codeOrg;
+	uint32_t binSize;
+	uint32_t flags;
+	uint32_t hartId;
+	uint32_t resvAddr; /* lr.w reservation, sc.w succeeds if the word still holds resvVal */
+	int32_t resvVal;
+	uint32_t resvValid;
+	void* pBinMem;
 	void* pStkMem;
-	void* pUser;
-	void (*ecall_fn)(struct _MINION*);
-	void (*ebreak_fn)(struct _MINION*);
-	void (*aext_fn)(struct _MINION*, uint32_t op, int rd, int rs1, int rs2, uint32_t instr, uint32_t mode);
-	MINION_MEM_MAP memMap[16];
+	MINION_CFG* pCfg;
+	MINION_PROG* pProg;
+	MINION_RING* pCmdRing;
+	MINION_COLD* pCold; /* owned by the instance, set up by minion_ctx_init */
 } MINION;
 
+#define MINION_MAX_HARTS 16
+
+/* hart ecalls take ids firstId.. in this order */
+enum {
+	MINION_HART_START = 0, /* a0: hart, a1: entry, a2: arg -> a0: 0 or -1 when invalid or still running */
+	MINION_HART_JOIN, /* a0: hart -> a0: entry's return value */
+
+	MINION_HART_NUM_ECALLS
+};
+
+/* extra register contexts over the main instance's memory, each on a host thread with its own stack slice */
+typedef struct _MINION_HARTS {
+	MINION* pMain; /* hart 0 */
+	MINION* pCtxs; /* [1..nharts-1] */
+	MINION_COLD* pColds; /* their cold blocks, same indexing */
+	int nharts;
+	uint32_t stkSlice;
+	uint32_t busy[MINION_MAX_HARTS];
+	void* pSys;
+} MINION_HARTS;
+
+#define MINION_ASYNC_MAX_JOBS 64
+#define MINION_ASYNC_MAX_WORKERS 8
+
+/* async ecalls take ids firstId.. in this order */
+enum {
+	MINION_ASYNC_SUBMIT = 0, /* a0: ecall id flagged MINION_NATIVE_FLG_ASYNC_SAFE, a1-a6: its a0-a5 -> a0: ticket or 0 when the queue is full or the id is not async-safe */
+	MINION_ASYNC_WAIT, /* a0: completions wanted -> a0: completions ready, returns early when nothing is in flight */
+
+	MINION_ASYNC_NUM_ECALLS
+};
+
+/* completion queue element, res[] is what the handler left in a0/a1 */
+typedef struct _MINION_ASYNC_DONE {
+	uint32_t ticket;
+	uint32_t id;
+	int32_t res[2];
+} MINION_ASYNC_DONE;
+
+typedef struct _MINION_ASYNC_JOB {
+	MINION snap; /* registers at submit time, memory is shared with the guest */
+	MINION_COLD cold; /* the snapshot's own, so it never attaches the submitter's output or async state */
+	uint32_t ticket;
+	int next;
+} MINION_ASYNC_JOB;
+
+/* worker pool running ecall handlers off the guest thread, handlers must be safe to run concurrently */
+typedef struct _MINION_ASYNC {
+	MINION_RING* pDone;
+	uint32_t doneVptr;
+	MINION_ASYNC_JOB jobs[MINION_ASYNC_MAX_JOBS];
+	int freeHead;
+	int queueHead;
+	int queueTail;
+	uint32_t inflight;
+	uint32_t nextTicket;
+	void* pSys; /* threads and locks, NULL: jobs run inline at submit */
+} MINION_ASYNC;
+
+#define MINION_POOL_MAX_WORKERS 16
+#define MINION_POOL_QUEUE_SIZE 256 /* per worker, power of 2 */
+
+struct _MINION_POOL_JOB;
+
+typedef void (*MINION_POOL_DONE_FN)(struct _MINION_POOL_JOB* pJob);
+
+/* guest call handed to the pool, doubles as its future: ret/ok are valid once done is set */
+typedef struct _MINION_POOL_JOB {
+	MINION_FUNC_HANDLE hFn;
+	const char* pSig;
+	MINION_VAL args[MINION_CALL_MAX_ARGS];
+	MINION_VAL ret;
+	int ok;
+	uint32_t done;
+	MINION_POOL_DONE_FN done_fn; /* called on the worker instead of setting done, the job is the callback's from then on */
+	void* pUser;
+} MINION_POOL_JOB;
+
+typedef struct _MINION_POOL_CELL {
+	uint32_t seq;
+	MINION_POOL_JOB* pJob;
+} MINION_POOL_CELL;
+
+/* bounded MPMC queue: anyone submits, the owner and idle workers take */
+typedef struct _MINION_POOL_WORKER {
+	uint32_t head;
+	uint32_t pad0[15];
+	uint32_t tail;
+	uint32_t pad1[15];
+	MINION_POOL_CELL cells[MINION_POOL_QUEUE_SIZE];
+	uint32_t njobs;
+	uint32_t nstolen;
+	uint64_t busyNanos;
+	struct _MINION_POOL* pPool;
+	int idx;
+} MINION_POOL_WORKER;
+
+typedef struct _MINION_POOL_STATS {
+	uint32_t njobs;
+	uint32_t nstolen; /* taken from other workers' queues */
+	double busySecs;
+	double utilization; /* busy time over time since minion_pool_init */
+} MINION_POOL_STATS;
+
+/* worker threads with one instance each over a shared cfg */
+typedef struct _MINION_POOL {
+	MINION_CFG* pCfg;
+	MINION* pCtxs;
+	MINION_POOL_WORKER* pWorkers;
+	int nworkers;
+	uint32_t nextWorker;
+	uint32_t nsleeping;
+	uint64_t t0;
+	void* pSys; /* threads and the idle lock, NULL: jobs run inline at submit */
+} MINION_POOL;
+
 void minion_err(MINION* pMi, const char* pFmt, ...);
 void minion_msg(MINION* pMi, const char* pFmt, ...);
 void minion_sys_err(const char* pFmt, ...);
@@ -86,23 +518,124 @@ void minion_reset_sp(MINION* pMi);
 int minion_valid_pc(MINION* pMi);
 int minion_is_mapped_vptr(uint32_t vptr);
 void* minion_resolve_vptr(MINION* pMi, uint32_t vptr);
+void* minion_span(MINION* pMi, uint32_t vptr, uint32_t len);
+void* minion_span_w(MINION* pMi, uint32_t vptr, uint32_t len);
+int minion_read(MINION* pMi, uint32_t vptr, void* pDst, uint32_t len);
+int minion_write(MINION* pMi, uint32_t vptr, const void* pSrc, uint32_t len);
+int minion_readv(MINION* pMi, const MINION_IOVEC* pVec, int n);
+int minion_writev(MINION* pMi, const MINION_IOVEC* pVec, int n);
 uint32_t minion_mem_map(MINION* pMi, void* p, uint32_t size);
+uint32_t minion_mem_map_ext(MINION* pMi, void* p, uint32_t size, uint32_t flags);
 void minion_mem_unmap(MINION* pMi, uint32_t vptr);
+uint32_t minion_exec(MINION* pMi);
+int minion_call(MINION* pMi, MINION_FUNC_HANDLE hFn, const char* pSig, const MINION_VAL* pArgs, MINION_VAL* pRet);
+uint32_t minion_call_batch(MINION* pMi, MINION_FUNC_HANDLE hFn, const char* pSig, const void* const* ppIn, void* pOut, uint32_t count);
+int minion_is_io_vptr(uint32_t vptr);
+uint32_t minion_io_map(MINION* pMi, uint32_t size,
+                       uint32_t (*read_fn)(MINION*, MINION_IO_REGION*, uint32_t, int),
+                       void (*write_fn)(MINION*, MINION_IO_REGION*, uint32_t, uint32_t, int),
+                       void* pCtx);
+uint32_t minion_io_map_fifo(MINION* pMi, const uint32_t* pIn, uint32_t inCount, uint32_t* pOut, uint32_t outCap);
+MINION_IO_REGION* minion_io_region(MINION* pMi, uint32_t vptr);
+void minion_io_fifo_in(MINION_IO_REGION* pIO, const uint32_t* pIn, uint32_t inCount);
+void minion_io_fifo_out(MINION_IO_REGION* pIO, uint32_t* pOut, uint32_t outCap);
+void minion_io_unmap(MINION* pMi, uint32_t vptr);
+MINION_RING* minion_ring_init(void* pMem, uint32_t memSize, uint32_t elemSize);
+uint32_t minion_ring_mem_size(MINION_RING* pRing);
+uint32_t minion_ring_map(MINION* pMi, MINION_RING* pRing);
+uint32_t minion_ring_count(MINION_RING* pRing);
+uint32_t minion_ring_put(MINION_RING* pRing, const void* pSrc, uint32_t n);
+uint32_t minion_ring_get(MINION_RING* pRing, void* pDst, uint32_t n);
+void minion_out_init(MINION_OUTBUF* pOut, void* pMem, uint32_t size, MINION_OUT_SINK sink, void* pUser);
+void minion_out_attach(MINION* pMi, MINION_OUTBUF* pOut);
+void minion_out_write(MINION* pMi, const char* pData, uint32_t len);
+void minion_out_printf(MINION* pMi, const char* pFmt, ...);
+void minion_out_flush(MINION* pMi);
+void minion_out_file_sink(void* pUser, const char* pData, uint32_t len);
+void minion_out_ring_sink(void* pUser, const char* pData, uint32_t len);
+uint32_t minion_cmd_ring_attach(MINION* pMi, MINION_RING* pRing);
+void minion_cmd_ring_detach(MINION* pMi, uint32_t vptr);
+uint32_t minion_cmd_flush(MINION* pMi);
+int minion_fs_init(MINION_FS* pFs, const char* pRoot);
+int minion_fs_register(MINION_CFG* pCfg, MINION_FS* pFs, uint32_t firstId);
+void minion_fs_release(MINION* pMi, MINION_FS* pFs);
+int minion_async_init(MINION_ASYNC* pAsync, MINION_RING* pDone, int nworkers);
+int minion_async_register(MINION_CFG* pCfg, uint32_t firstId);
+uint32_t minion_async_attach(MINION* pMi, MINION_ASYNC* pAsync);
+void minion_async_detach(MINION* pMi);
+void minion_async_release(MINION_ASYNC* pAsync);
+int minion_pool_init(MINION_POOL* pPool, MINION_CFG* pCfg, int nworkers);
+int minion_pool_submit(MINION_POOL* pPool, MINION_POOL_JOB* pJob);
+int minion_pool_job_done(const MINION_POOL_JOB* pJob);
+void minion_pool_wait(MINION_POOL* pPool, MINION_POOL_JOB* pJob);
+void minion_pool_stats(MINION_POOL* pPool, int iworker, MINION_POOL_STATS* pStats);
+void minion_pool_release(MINION_POOL* pPool);
+int minion_harts_init(MINION_HARTS* pHarts, MINION* pMain, int nharts, uint32_t stkSlice);
+int minion_harts_register(MINION_CFG* pCfg, uint32_t firstId);
+int minion_hart_start(MINION_HARTS* pHarts, int hart, uint32_t entry, uint32_t arg);
+int32_t minion_hart_join(MINION_HARTS* pHarts, int hart);
+void minion_harts_release(MINION_HARTS* pHarts);
 int minion_find_func(MINION* pMi, const char* pFnName);
 int minion_valid_func_idx(MINION* pMi, int ifn);
 void minion_set_pc_to_func_idx(MINION* pMi, int ifn);
 void minion_set_pc_to_func(MINION* pMi, const char* pFnName);
+MINION_FUNC_HANDLE minion_get_func(MINION* pMi, const char* pFnName);
+void minion_set_pc_to_func_handle(MINION* pMi, MINION_FUNC_HANDLE hFn);
 uint32_t minion_get_func_instr_count(MINION* pMi, const char* pFnName);
+uint32_t minion_name_hash(const char* pName);
+uint32_t minion_func_hash_size(int nfuncs);
+void minion_func_hash_build(const MINION_FUNC_INFO* pFuncs, int nfuncs, uint32_t* pHash, uint32_t mask);
 int minion_bin_find_func(MINION_BIN* pBin, const char* pFnName);
+int minion_bin2_ck_magic(const void* pMem, size_t memSize);
+void minion_bin2_from_mem(MINION_BIN* pBin, const void* pMem, size_t memSize);
+void minion_bin2_load(MINION_BIN* pBin, const char* pPath);
+int minion_bin_save_v2(MINION_BIN* pBin, const char* pPath);
+int minion_elf_ck_magic(const void* pMem, size_t memSize);
+void minion_bin_elf_from_mem(MINION_BIN* pBin, const void* pMem, size_t memSize);
+void minion_bin_load_elf(MINION_BIN* pBin, const char* pPath);
 void minion_bin_from_mem(MINION_BIN* pBin, void* pMem, size_t memSize);
+void minion_bin_from_mem_inplace(MINION_BIN* pBin, void* pMem, size_t memSize);
 void minion_bin_load(MINION_BIN* pBin, const char* pPath);
 void minion_bin_free(MINION_BIN* pBin);
+int minion_bin_copy_image(MINION_BIN* pBin);
 void minion_bin_info(MINION_BIN* pBin);
+void minion_cfg_init(MINION_CFG* pCfg, MINION_BIN* pBin);
+int minion_cfg_add_module(MINION_CFG* pCfg, MINION_BIN* pLib);
+int minion_cfg_remove_module(MINION_CFG* pCfg, MINION_BIN* pLib);
+int minion_bin_link(MINION_BIN* pBin, MINION_BIN* pLib);
+int minion_bin_unlink(MINION_BIN* pBin, MINION_BIN* pLib);
+uint32_t minion_bind_native(MINION_CFG* pCfg, const char* pName, const char* pSig, MINION_NATIVE_FN fn);
+uint32_t minion_bind_native_raw(MINION_CFG* pCfg, const char* pName, MINION_NATIVE_RAW_FN fn, void* pUser);
+int minion_bin_link_natives(MINION_BIN* pBin, MINION_CFG* pCfg);
+int minion_register_ecall(MINION_CFG* pCfg, uint32_t id, MINION_NATIVE_FN fn, const char* pSig);
+int minion_register_ecall_raw(MINION_CFG* pCfg, uint32_t id, MINION_NATIVE_RAW_FN fn, void* pUser);
+int minion_set_ecall_flags(MINION_CFG* pCfg, uint32_t id, uint32_t flags);
+uint32_t minion_ecall_count(const MINION* pCtxs, int nctxs, uint32_t id);
+int minion_replace_func(MINION_CFG* pCfg, const char* pName, const char* pSig, MINION_NATIVE_FN fn, uint32_t checkEvery);
+int minion_replace_func_raw(MINION_CFG* pCfg, const char* pName, char retType, MINION_NATIVE_RAW_FN fn, void* pUser, uint32_t checkEvery);
+void minion_restore_funcs(MINION_CFG* pCfg);
+void minion_ctx_init(MINION* pMi, MINION_CFG* pCfg);
+MINION_PROG* minion_prog_create(MINION_BIN* pBin);
+MINION_PROG* minion_prog_load(const char* pPath, const MINION_ALLOCATOR* pAlloc);
+void minion_prog_retain(MINION_PROG* pProg);
+void minion_prog_release(MINION_PROG* pProg);
+void minion_prog_slot_init(MINION_PROG_SLOT* pSlot, MINION_PROG* pProg);
+MINION_PROG* minion_prog_slot_acquire(MINION_PROG_SLOT* pSlot);
+void minion_prog_slot_swap(MINION_PROG_SLOT* pSlot, MINION_PROG* pProg);
+void minion_prog_slot_reset(MINION_PROG_SLOT* pSlot);
+int minion_ctx_bind(MINION* pMi, MINION_PROG* pProg);
+int minion_ctx_bind_slot(MINION* pMi, MINION_PROG_SLOT* pSlot);
+void minion_ctx_unbind(MINION* pMi);
+void minion_ctx_init_ext(MINION* pMi, MINION_CFG* pCfg, void* pStkMem, size_t stkSize);
+MINION* minion_ctx_array_alloc(const MINION_ALLOCATOR* pAlloc, int n);
+void minion_ctx_array_free(const MINION_ALLOCATOR* pAlloc, MINION* pCtxs);
+void* minion_mem_alloc(const MINION_ALLOCATOR* pAlloc, size_t size);
+void minion_mem_free(const MINION_ALLOCATOR* pAlloc, void* p);
 void minion_init(MINION* pMi, MINION_BIN* pBin);
 void minion_release(MINION* pMi);
-void minion_set_silent(int flg);
-void minion_enable_alt_regnames(int flg);
-void minion_enable_alt_mnemonics(int flg);
+void minion_set_default_log(const MINION_LOG* pLog);
+void minion_set_log(MINION* pMi, const MINION_LOG* pLog);
+void minion_log(MINION* pMi, int level, const char* pFmt, ...);
 
 void minion_instr(MINION* pMi, uint32_t instr, uint32_t mode);
 uint32_t minion_fetch_pc_instr(MINION* pMi);
@@ -164,8 +697,8 @@ void minion_set_fa0_d(MINION* pMi, double val);
 double minion_get_fa1_d(MINION* pMi);
 void minion_set_fa1_d(MINION* pMi, double val);
 
-const char* minion_get_reg_name(int reg);
-const char* minion_get_f_reg_name(int reg);
+const char* minion_get_reg_name(MINION* pMi, int reg);
+const char* minion_get_f_reg_name(MINION* pMi, int reg);
 void minion_dump_regs(MINION* pMi);
 void minion_dump_fregs_s(MINION* pMi);
 void minion_dump_fregs_d(MINION* pMi);
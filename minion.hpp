@@ -0,0 +1,231 @@
+/* minion: rv32g ISA simulator */
+/* SPDX-License-Identifier: MIT */
+/* SPDX-FileCopyrightText: 2023 Sergey Chaban <sergey.chaban@gmail.com> */
+
+/* typed C++ calls: ILP32D register assignment is worked out at compile time, C++14 */
+
+#ifndef MINION_HPP
+#define MINION_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+#include <utility>
+#if defined(__cpp_exceptions) || defined(__EXCEPTIONS) || defined(_CPPUNWIND)
+#	include <stdexcept>
+#	define MINION_HPP_THROW(_msg) throw std::runtime_error(_msg)
+#else
+#	define MINION_HPP_THROW(_msg) minion_sys_err("%s\n", _msg)
+#endif
+
+#include "minion.h"
+
+namespace minion {
+
+/* guest address, passed in an integer register as is */
+struct VPtr {
+	uint32_t v;
+};
+
+namespace detail {
+
+enum Kind { K_INT, K_I64, K_F32, K_F64 };
+
+template <typename T, typename = void> struct Traits;
+
+template <typename T> struct Traits<T, typename std::enable_if<std::is_integral<T>::value && sizeof(T) <= 4>::type> {
+	static const Kind kind = K_INT;
+	static uint64_t bits(T v) { return (uint32_t)(int32_t)v; }
+	static T get(const MINION* pMi) { return (T)pMi->regs[10]; }
+};
+
+template <typename T> struct Traits<T, typename std::enable_if<std::is_integral<T>::value && sizeof(T) == 8>::type> {
+	static const Kind kind = K_I64;
+	static uint64_t bits(T v) { return (uint64_t)v; }
+	static T get(const MINION* pMi) { return (T)(((uint64_t)(uint32_t)pMi->regs[11] << 32) | (uint32_t)pMi->regs[10]); }
+};
+
+template <> struct Traits<VPtr> {
+	static const Kind kind = K_INT;
+	static uint64_t bits(VPtr v) { return v.v; }
+	static VPtr get(const MINION* pMi) { VPtr p = { (uint32_t)pMi->regs[10] }; return p; }
+};
+
+template <> struct Traits<float> {
+	static const Kind kind = K_F32;
+	static uint64_t bits(float v) { uint32_t w; memcpy(&w, &v, 4); return w; }
+	static float get(MINION* pMi) { return minion_get_freg_s(pMi, 10); }
+};
+
+template <> struct Traits<double> {
+	static const Kind kind = K_F64;
+	static uint64_t bits(double v) { uint64_t w; memcpy(&w, &v, 8); return w; }
+	static double get(MINION* pMi) { return minion_get_freg_d(pMi, 10); }
+};
+
+/* ireg/nireg: integer registers used (a 64-bit value may be split with a7), freg: fa index, stk: offset of the rest on the stack */
+struct Slot {
+	int ireg;
+	int nireg;
+	int freg;
+	int stk;
+};
+
+template <std::size_t N> struct Layout {
+	Slot s[N + 1];
+	uint32_t stkSize;
+};
+
+/* compile-time twin of call_plan in minion.c for scalar signatures, the two must assign registers the same way */
+template <typename... A> constexpr Layout<sizeof...(A)> make_layout() {
+	const Kind kinds[] = { Traits<A>::kind..., K_INT };
+	Layout<sizeof...(A)> lay = {};
+	int ni = 0;
+	int nf = 0;
+	uint32_t stk = 0;
+	for (std::size_t i = 0; i < sizeof...(A); ++i) {
+		Slot s = { -1, 0, -1, -1 };
+		Kind k = kinds[i];
+		int words = (k == K_I64 || k == K_F64) ? 2 : 1;
+		if ((k == K_F32 || k == K_F64) && nf < 8) {
+			s.freg = nf++;
+		} else if (ni < 8) {
+			s.ireg = ni;
+			s.nireg = words <= 8 - ni ? words : 8 - ni;
+			ni += s.nireg;
+			if (s.nireg < words) {
+				s.stk = (int)stk;
+				stk += 4;
+			}
+		} else {
+			if (words == 2) stk = (stk + 7) & ~7U;
+			s.stk = (int)stk;
+			stk += 4 * words;
+		}
+		lay.s[i] = s;
+	}
+	lay.stkSize = (stk + 15) & ~15U;
+	return lay;
+}
+
+template <typename... A> struct Frame {
+	static constexpr Layout<sizeof...(A)> layout = make_layout<A...>();
+};
+
+template <typename... A> constexpr Layout<sizeof...(A)> Frame<A...>::layout;
+
+template <typename T, std::size_t I, typename... A> inline void put_arg(MINION* pMi, uint32_t stkBase, T v) {
+	constexpr Slot s = Frame<A...>::layout.s[I];
+	constexpr Kind k = Traits<T>::kind;
+	uint64_t w = Traits<T>::bits(v);
+	if (s.freg >= 0) {
+		/* floats live in the low half of the 64-bit register, as in minion_set_freg_s */
+		memcpy(&pMi->fregs[10 + s.freg], &w, k == K_F32 ? 4 : 8);
+	} else {
+		if (s.nireg > 0) pMi->regs[10 + s.ireg] = (int32_t)(uint32_t)w;
+		if (s.nireg > 1) pMi->regs[11 + s.ireg] = (int32_t)(uint32_t)(w >> 32);
+		if (s.stk >= 0) {
+			if (s.nireg == 1) {
+				uint32_t hi = (uint32_t)(w >> 32);
+				minion_write(pMi, stkBase + s.stk, &hi, 4);
+			} else {
+				minion_write(pMi, stkBase + s.stk, &w, (k == K_INT || k == K_F32) ? 4 : 8);
+			}
+		}
+	}
+}
+
+template <typename... A, std::size_t... I> inline void put_args(MINION* pMi, uint32_t stkBase, std::index_sequence<I...>, A... args) {
+	int dummy[] = { 0, (put_arg<A, I, A...>(pMi, stkBase, args), 0)... };
+	(void)dummy;
+}
+
+template <typename R> struct Ret {
+	static R get(MINION* pMi) { return Traits<R>::get(pMi); }
+};
+
+template <> struct Ret<void> {
+	static void get(MINION*) {}
+};
+
+} /* detail */
+
+template <typename Sig> class Function;
+
+template <typename R, typename... A> class Function<R(A...)> {
+public:
+	Function() : mhFn(NULL) {}
+	explicit Function(MINION_FUNC_HANDLE hFn) : mhFn(hFn) {}
+
+	bool valid() const { return mhFn != NULL; }
+	MINION_FUNC_HANDLE handle() const { return mhFn; }
+
+	R operator()(MINION* pMi, A... args) const {
+		const uint32_t sp0 = (uint32_t)pMi->regs[2];
+		const uint32_t stkBase = ((sp0 & ~15U) - detail::Frame<A...>::layout.stkSize) & ~15U;
+		detail::put_args<A...>(pMi, stkBase, std::index_sequence_for<A...>(), args...);
+		pMi->regs[2] = (int32_t)stkBase;
+		minion_set_ra(pMi, MINION_PC_NATIVE);
+		minion_set_pc_to_func_handle(pMi, mhFn);
+		minion_exec(pMi);
+		pMi->regs[2] = (int32_t)sp0;
+		return detail::Ret<R>::get(pMi);
+	}
+
+private:
+	MINION_FUNC_HANDLE mhFn;
+};
+
+class Program {
+public:
+	explicit Program(const char* pPath) {
+		memset(&mBin, 0, sizeof(mBin));
+		minion_bin_load(&mBin, pPath);
+		if (!mBin.pBinMem) {
+			MINION_HPP_THROW("minion: can't load program");
+		}
+		minion_cfg_init(&mCfg, &mBin);
+	}
+
+	~Program() { minion_bin_free(&mBin); }
+
+	Program(const Program&) = delete;
+	Program& operator=(const Program&) = delete;
+
+	MINION_BIN* bin() { return &mBin; }
+	MINION_CFG* cfg() { return &mCfg; }
+
+	/* fails here, not at the call site, when the symbol is missing */
+	template <typename Sig> Function<Sig> get(const char* pName) const {
+		int ifn = minion_bin_find_func(const_cast<MINION_BIN*>(&mBin), pName);
+		if (ifn < 0) {
+			MINION_HPP_THROW("minion: function not found");
+			return Function<Sig>();
+		}
+		return Function<Sig>(&mBin.pFuncs[ifn]);
+	}
+
+private:
+	MINION_BIN mBin;
+	MINION_CFG mCfg;
+};
+
+class Context {
+public:
+	explicit Context(Program& prog) { minion_ctx_init(&mMi, prog.cfg()); }
+	~Context() { minion_release(&mMi); }
+
+	Context(const Context&) = delete;
+	Context& operator=(const Context&) = delete;
+
+	MINION* get() { return &mMi; }
+	operator MINION*() { return &mMi; }
+
+private:
+	MINION mMi;
+};
+
+} /* minion */
+
+#endif
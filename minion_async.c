@@ -0,0 +1,251 @@
+/* minion: rv32g ISA simulator */
+/* SPDX-License-Identifier: MIT */
+/* SPDX-FileCopyrightText: 2023 Sergey Chaban <sergey.chaban@gmail.com> */
+
+/* async ecalls: handlers run on a register snapshot in a worker thread, results are posted to a guest-visible ring */
+
+#ifndef MINION_NO_THREADS
+#	include <pthread.h>
+
+typedef struct _MINION_ASYNC_SYS {
+	pthread_mutex_t mtx;
+	pthread_cond_t workCv;
+	pthread_cond_t doneCv;
+	pthread_t threads[MINION_ASYNC_MAX_WORKERS];
+	int nthreads;
+	int quit;
+} MINION_ASYNC_SYS;
+
+#	define ASYNC_SYS(_pAsync) ((MINION_ASYNC_SYS*)(_pAsync)->pSys)
+
+static void async_lock(MINION_ASYNC* pAsync) {
+	if (pAsync->pSys) pthread_mutex_lock(&ASYNC_SYS(pAsync)->mtx);
+}
+
+static void async_unlock(MINION_ASYNC* pAsync) {
+	if (pAsync->pSys) pthread_mutex_unlock(&ASYNC_SYS(pAsync)->mtx);
+}
+#else
+static void async_lock(MINION_ASYNC* pAsync) {}
+static void async_unlock(MINION_ASYNC* pAsync) {}
+#endif
+
+static void async_run(MINION_ASYNC_JOB* pJob) {
+	MINION_CFG* pCfg = pJob->snap.pCfg;
+	uint32_t id = (uint32_t)pJob->snap.regs[17];
+	pCfg->ecalls[id].invoke(&pJob->snap, &pCfg->ecalls[id]);
+}
+
+/* under the lock: the submit check guarantees the ring has room */
+static void async_post(MINION_ASYNC* pAsync, int ijob) {
+	MINION_ASYNC_JOB* pJob = &pAsync->jobs[ijob];
+	MINION_ASYNC_DONE done;
+	done.ticket = pJob->ticket;
+	done.id = (uint32_t)pJob->snap.regs[17];
+	done.res[0] = pJob->snap.regs[10];
+	done.res[1] = pJob->snap.regs[11];
+	minion_ring_put(pAsync->pDone, &done, 1);
+	pJob->next = pAsync->freeHead;
+	pAsync->freeHead = ijob;
+	--pAsync->inflight;
+}
+
+#ifndef MINION_NO_THREADS
+static void* async_worker(void* pArg) {
+	MINION_ASYNC* pAsync = (MINION_ASYNC*)pArg;
+	MINION_ASYNC_SYS* pSys = ASYNC_SYS(pAsync);
+	pthread_mutex_lock(&pSys->mtx);
+	while (1) {
+		int ijob;
+		while (pAsync->queueHead < 0 && !pSys->quit) {
+			pthread_cond_wait(&pSys->workCv, &pSys->mtx);
+		}
+		/* queued jobs are drained before quitting */
+		if (pAsync->queueHead < 0) break;
+		ijob = pAsync->queueHead;
+		pAsync->queueHead = pAsync->jobs[ijob].next;
+		if (pAsync->queueHead < 0) {
+			pAsync->queueTail = -1;
+		}
+		pthread_mutex_unlock(&pSys->mtx);
+		async_run(&pAsync->jobs[ijob]);
+		pthread_mutex_lock(&pSys->mtx);
+		async_post(pAsync, ijob);
+		pthread_cond_broadcast(&pSys->doneCv);
+	}
+	pthread_mutex_unlock(&pSys->mtx);
+	return NULL;
+}
+#endif
+
+/* the ring must be set up with elemSize = sizeof(MINION_ASYNC_DONE), nworkers = 0 runs every job inline at submit */
+int minion_async_init(MINION_ASYNC* pAsync, MINION_RING* pDone, int nworkers) {
+	int i;
+	if (!pAsync || !pDone) return -1;
+	if (pDone->elemSize != sizeof(MINION_ASYNC_DONE)) {
+		minion_sys_err("completion ring element size %d != %d\n", pDone->elemSize, (int)sizeof(MINION_ASYNC_DONE));
+		return -1;
+	}
+	memset(pAsync, 0, sizeof(MINION_ASYNC));
+	pAsync->pDone = pDone;
+	for (i = 0; i < MINION_ASYNC_MAX_JOBS; ++i) {
+		pAsync->jobs[i].next = i + 1 < MINION_ASYNC_MAX_JOBS ? i + 1 : -1;
+	}
+	pAsync->freeHead = 0;
+	pAsync->queueHead = -1;
+	pAsync->queueTail = -1;
+#ifndef MINION_NO_THREADS
+	if (nworkers > MINION_ASYNC_MAX_WORKERS) {
+		nworkers = MINION_ASYNC_MAX_WORKERS;
+	}
+	if (nworkers > 0) {
+		MINION_ASYNC_SYS* pSys = (MINION_ASYNC_SYS*)malloc(sizeof(MINION_ASYNC_SYS));
+		if (!pSys) return -1;
+		memset(pSys, 0, sizeof(MINION_ASYNC_SYS));
+		pthread_mutex_init(&pSys->mtx, NULL);
+		pthread_cond_init(&pSys->workCv, NULL);
+		pthread_cond_init(&pSys->doneCv, NULL);
+		pAsync->pSys = pSys;
+		for (i = 0; i < nworkers; ++i) {
+			if (pthread_create(&pSys->threads[i], NULL, async_worker, pAsync) != 0) break;
+			++pSys->nthreads;
+		}
+		if (pSys->nthreads == 0) {
+			minion_sys_err("can't start async workers\n");
+			minion_async_release(pAsync);
+			return -1;
+		}
+	}
+#endif
+	return 0;
+}
+
+static void async_submit(MINION* pMi, const MINION_NATIVE* pNat) {
+	MINION_ASYNC* pAsync = pMi->pCold->pAsync;
+	MINION_CFG* pCfg = pMi->pCfg;
+	uint32_t id = (uint32_t)minion_get_a0(pMi);
+	MINION_ASYNC_JOB* pJob;
+	uint32_t ticket;
+	int ijob;
+	(void)pNat;
+	minion_set_a0(pMi, 0);
+	if (!pAsync || id >= MINION_MAX_ECALLS || !pCfg->ecalls[id].invoke || !(pCfg->ecalls[id].flags & MINION_NATIVE_FLG_ASYNC_SAFE)) return;
+	async_lock(pAsync);
+	ijob = pAsync->freeHead;
+	if (ijob < 0 || pAsync->inflight + minion_ring_count(pAsync->pDone) > pAsync->pDone->mask) {
+		async_unlock(pAsync);
+		return;
+	}
+	pJob = &pAsync->jobs[ijob];
+	pAsync->freeHead = pJob->next;
+	pJob->snap = *pMi;
+	memcpy(&pJob->snap.regs[10], &pMi->regs[11], 6 * sizeof(int32_t));
+	pJob->snap.regs[17] = (int32_t)id;
+	pJob->snap.pCmdRing = NULL;
+	memset(&pJob->cold, 0, sizeof(MINION_COLD));
+	pJob->cold.log = pMi->pCold->log;
+	pJob->snap.pCold = &pJob->cold;
+	ticket = ++pAsync->nextTicket;
+	if (ticket == 0) {
+		ticket = ++pAsync->nextTicket;
+	}
+	pJob->ticket = ticket;
+	pJob->next = -1;
+	++pAsync->inflight;
+	++pMi->pCold->ecallCounts[id];
+#ifndef MINION_NO_THREADS
+	if (pAsync->pSys) {
+		if (pAsync->queueTail < 0) {
+			pAsync->queueHead = ijob;
+		} else {
+			pAsync->jobs[pAsync->queueTail].next = ijob;
+		}
+		pAsync->queueTail = ijob;
+		pthread_cond_signal(&ASYNC_SYS(pAsync)->workCv);
+	} else
+#endif
+	{
+		async_run(pJob);
+		async_post(pAsync, ijob);
+	}
+	async_unlock(pAsync);
+	minion_set_a0(pMi, (int32_t)ticket);
+}
+
+static void async_wait_for(MINION_ASYNC* pAsync, uint32_t want) {
+#ifndef MINION_NO_THREADS
+	if (pAsync->pSys) {
+		while (minion_ring_count(pAsync->pDone) < want && pAsync->inflight > 0) {
+			pthread_cond_wait(&ASYNC_SYS(pAsync)->doneCv, &ASYNC_SYS(pAsync)->mtx);
+		}
+	}
+#endif
+}
+
+static void async_wait(MINION* pMi, const MINION_NATIVE* pNat) {
+	MINION_ASYNC* pAsync = pMi->pCold->pAsync;
+	uint32_t n;
+	(void)pNat;
+	if (!pAsync) {
+		minion_set_a0(pMi, 0);
+		return;
+	}
+	async_lock(pAsync);
+	async_wait_for(pAsync, (uint32_t)minion_get_a0(pMi));
+	n = minion_ring_count(pAsync->pDone);
+	async_unlock(pAsync);
+	minion_set_a0(pMi, (int32_t)n);
+}
+
+int minion_async_register(MINION_CFG* pCfg, uint32_t firstId) {
+	if (!pCfg || firstId + MINION_ASYNC_NUM_ECALLS > MINION_MAX_ECALLS) return -1;
+	minion_register_ecall_raw(pCfg, firstId + MINION_ASYNC_SUBMIT, async_submit, NULL);
+	minion_register_ecall_raw(pCfg, firstId + MINION_ASYNC_WAIT, async_wait, NULL);
+	return 0;
+}
+
+/* returns the guest address of the completion ring */
+uint32_t minion_async_attach(MINION* pMi, MINION_ASYNC* pAsync) {
+	uint32_t vptr;
+	if (!pMi || !pMi->pCold || !pAsync) return 0;
+	vptr = minion_ring_map(pMi, pAsync->pDone);
+	if (vptr) {
+		pAsync->doneVptr = vptr;
+		pMi->pCold->pAsync = pAsync;
+	}
+	return vptr;
+}
+
+/* jobs in flight still point into this instance's memory, so this waits for them */
+void minion_async_detach(MINION* pMi) {
+	MINION_ASYNC* pAsync;
+	if (!pMi || !pMi->pCold || !pMi->pCold->pAsync) return;
+	pAsync = pMi->pCold->pAsync;
+	async_lock(pAsync);
+	async_wait_for(pAsync, MINION_ASYNC_MAX_JOBS + pAsync->pDone->mask + 1);
+	async_unlock(pAsync);
+	minion_mem_unmap(pMi, pAsync->doneVptr);
+	pAsync->doneVptr = 0;
+	pMi->pCold->pAsync = NULL;
+}
+
+void minion_async_release(MINION_ASYNC* pAsync) {
+#ifndef MINION_NO_THREADS
+	MINION_ASYNC_SYS* pSys;
+	int i;
+	if (!pAsync || !pAsync->pSys) return;
+	pSys = ASYNC_SYS(pAsync);
+	pthread_mutex_lock(&pSys->mtx);
+	pSys->quit = 1;
+	pthread_cond_broadcast(&pSys->workCv);
+	pthread_mutex_unlock(&pSys->mtx);
+	for (i = 0; i < pSys->nthreads; ++i) {
+		pthread_join(pSys->threads[i], NULL);
+	}
+	pthread_cond_destroy(&pSys->doneCv);
+	pthread_cond_destroy(&pSys->workCv);
+	pthread_mutex_destroy(&pSys->mtx);
+	free(pSys);
+	pAsync->pSys = NULL;
+#endif
+}
@@ -0,0 +1,298 @@
+/* minion: rv32g ISA simulator */
+/* SPDX-License-Identifier: MIT */
+/* SPDX-FileCopyrightText: 2023 Sergey Chaban <sergey.chaban@gmail.com> */
+
+/* MINION v2: binary container, header and image laid out for mmap */
+
+static uint32_t bin2_page_size(void) {
+#ifdef MINION_NO_MMAP
+	return MINION_BIN2_ALIGN;
+#else
+	long pgSize = sysconf(_SC_PAGESIZE);
+	return pgSize > 0 ? (uint32_t)pgSize : MINION_BIN2_ALIGN;
+#endif
+}
+
+int minion_bin2_ck_magic(const void* pMem, size_t memSize) {
+	return pMem && memSize >= 8 && memcmp(pMem, MINION_BIN2_MAGIC, 8) == 0;
+}
+
+static int bin2_ck_head(const MINION_BIN2_HEAD* pHead, size_t fileSize) {
+	uint64_t funcsEnd = (uint64_t)pHead->funcsOffs + (uint64_t)pHead->nfuncs * sizeof(MINION_BIN2_FUNC);
+	uint64_t hashEnd = (uint64_t)pHead->hashOffs + (uint64_t)pHead->hashSize * sizeof(uint32_t);
+	uint64_t strEnd = (uint64_t)pHead->strOffs + pHead->strSize;
+	uint64_t imgEnd = (uint64_t)pHead->imgOffs + pHead->imgSize;
+	if (!minion_bin2_ck_magic(pHead, fileSize)) return 0;
+	if (pHead->version != 2 || pHead->headSize < sizeof(MINION_BIN2_HEAD)) return 0;
+	if (funcsEnd > fileSize || hashEnd > fileSize) return 0;
+	if (strEnd > fileSize || imgEnd > fileSize) return 0;
+	if (pHead->hashSize & (pHead->hashSize - 1)) return 0;
+	if (pHead->strSize == 0 || ((const char*)pHead)[pHead->strOffs + pHead->strSize - 1] != 0) return 0;
+	if ((uint64_t)pHead->imgSize + pHead->bssSize > 0xFFFFFFFFU - pHead->codeOrg) return 0;
+	return 1;
+}
+
+/* fixes up the function table and hash index against a metadata block that stays resident */
+static int bin2_setup_meta(MINION_BIN* pBin, const uint8_t* pMeta) {
+	int i;
+	const MINION_BIN2_HEAD* pHead = (const MINION_BIN2_HEAD*)pMeta;
+	const MINION_BIN2_FUNC* pSrcFuncs = (const MINION_BIN2_FUNC*)(pMeta + pHead->funcsOffs);
+	pBin->version = 2;
+	pBin->codeOrg = pHead->codeOrg;
+	pBin->dataOrg = pHead->dataOrg;
+	pBin->sdataOrg = pHead->sdataOrg;
+	pBin->gpIni = pHead->gpIni;
+	pBin->bssSize = pHead->bssSize;
+	pBin->binSize = pHead->imgSize + pHead->bssSize;
+	pBin->nfuncs = (int)pHead->nfuncs;
+	pBin->pNameMem = (char*)(pMeta + pHead->strOffs);
+	pBin->flags |= MINION_BIN_FLG_NAMES_REF;
+	if (pHead->hashSize > 0) {
+		pBin->pFuncHash = (uint32_t*)(pMeta + pHead->hashOffs);
+		pBin->funcHashMask = pHead->hashSize - 1;
+		pBin->flags |= MINION_BIN_FLG_HASH_REF;
+	}
+	if (pBin->nfuncs > 0) {
+		pBin->pFuncs = (MINION_FUNC_INFO*)minion_mem_alloc(&pBin->alloc, pBin->nfuncs * sizeof(MINION_FUNC_INFO));
+		if (!pBin->pFuncs) return 0;
+		for (i = 0; i < pBin->nfuncs; ++i) {
+			uint32_t nameOffs = pSrcFuncs[i].nameOffs;
+			if (nameOffs >= pHead->strSize) nameOffs = pHead->strSize - 1;
+			pBin->pFuncs[i].pName = pBin->pNameMem + nameOffs;
+			pBin->pFuncs[i].addr = pSrcFuncs[i].addr;
+			pBin->pFuncs[i].size = pSrcFuncs[i].size;
+			pBin->pFuncs[i].hash = pSrcFuncs[i].hash;
+		}
+	}
+	return 1;
+}
+
+void minion_bin2_from_mem(MINION_BIN* pBin, const void* pMem, size_t memSize) {
+	const MINION_BIN2_HEAD* pHead = (const MINION_BIN2_HEAD*)pMem;
+	size_t metaSize;
+	if (!pBin || !pMem || memSize < sizeof(MINION_BIN2_HEAD) || !bin2_ck_head(pHead, memSize)) {
+		minion_sys_err("Invalid MINION v2 data!\n");
+		return;
+	}
+	/* the caller keeps ownership of pMem, so metadata and image are copied */
+	metaSize = pHead->strOffs + pHead->strSize;
+	if (metaSize < pHead->funcsOffs + pHead->nfuncs * sizeof(MINION_BIN2_FUNC)) {
+		metaSize = pHead->funcsOffs + pHead->nfuncs * sizeof(MINION_BIN2_FUNC);
+	}
+	if (metaSize < pHead->hashOffs + pHead->hashSize * sizeof(uint32_t)) {
+		metaSize = pHead->hashOffs + pHead->hashSize * sizeof(uint32_t);
+	}
+	pBin->pMetaMem = minion_mem_alloc(&pBin->alloc, metaSize);
+	pBin->pBinMem = minion_mem_alloc(&pBin->alloc, (size_t)pHead->imgSize + pHead->bssSize);
+	if (!pBin->pMetaMem || !pBin->pBinMem) {
+		minion_sys_err("Can't allocate MINION v2 memory!\n");
+		return;
+	}
+	pBin->metaSize = metaSize;
+	memcpy(pBin->pMetaMem, pMem, metaSize);
+	memcpy(pBin->pBinMem, (const uint8_t*)pMem + pHead->imgOffs, pHead->imgSize);
+	memset((uint8_t*)pBin->pBinMem + pHead->imgSize, 0, pHead->bssSize);
+	bin2_setup_meta(pBin, (const uint8_t*)pBin->pMetaMem);
+}
+
+#ifdef MINION_NO_MMAP
+void minion_bin2_load(MINION_BIN* pBin, const char* pPath) {
+	FILE* pFile = pPath ? fopen(pPath, "rb") : NULL;
+	if (pFile) {
+		long len = 0;
+		void* pMem = NULL;
+		if (fseek(pFile, 0, SEEK_END) == 0) {
+			len = ftell(pFile);
+			fseek(pFile, 0, SEEK_SET);
+		}
+		if (len > 0) {
+			pMem = malloc((size_t)len);
+		}
+		if (pMem && fread(pMem, 1, (size_t)len, pFile) == (size_t)len) {
+			minion_bin2_from_mem(pBin, pMem, (size_t)len);
+		} else {
+			minion_sys_err("Can't read \"%s\".\n", pPath);
+		}
+		if (pMem) free(pMem);
+		fclose(pFile);
+	} else {
+		minion_sys_err("Can't find \"%s\".\n", pPath);
+	}
+}
+#else
+void minion_bin2_load(MINION_BIN* pBin, const char* pPath) {
+	struct stat st;
+	const MINION_BIN2_HEAD* pHead;
+	uint8_t* pMeta;
+	uint8_t* pImg;
+	size_t metaSize;
+	size_t imgMapSize;
+	uint32_t pgSize = bin2_page_size();
+	int fd;
+	if (!pBin || !pPath) return;
+	fd = open(pPath, O_RDONLY);
+	if (fd < 0) {
+		minion_sys_err("Can't find \"%s\".\n", pPath);
+		return;
+	}
+	if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(MINION_BIN2_HEAD)) {
+		minion_sys_err("Invalid MINION v2 file \"%s\".\n", pPath);
+		close(fd);
+		return;
+	}
+	pMeta = (uint8_t*)mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (pMeta == MAP_FAILED) {
+		minion_sys_err("Can't map \"%s\".\n", pPath);
+		close(fd);
+		return;
+	}
+	pHead = (const MINION_BIN2_HEAD*)pMeta;
+	if (!bin2_ck_head(pHead, (size_t)st.st_size)) {
+		minion_sys_err("Invalid MINION v2 file \"%s\".\n", pPath);
+		munmap(pMeta, (size_t)st.st_size);
+		close(fd);
+		return;
+	}
+	metaSize = (size_t)st.st_size;
+
+	/* zero-filled reservation for image + bss, file pages mapped copy-on-write on top */
+	imgMapSize = ((size_t)pHead->imgSize + pHead->bssSize + pgSize - 1) & ~(size_t)(pgSize - 1);
+	if (imgMapSize == 0) imgMapSize = pgSize;
+	pImg = (uint8_t*)mmap(NULL, imgMapSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (pImg == MAP_FAILED) {
+		minion_sys_err("Can't reserve MINION v2 image.\n");
+		munmap(pMeta, metaSize);
+		close(fd);
+		return;
+	}
+	if (pHead->imgSize > 0) {
+		if ((pHead->imgOffs % pgSize) == 0) {
+			void* pFix = mmap(pImg, pHead->imgSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, fd, pHead->imgOffs);
+			if (pFix == MAP_FAILED) {
+				memcpy(pImg, pMeta + pHead->imgOffs, pHead->imgSize);
+			} else if ((pHead->imgSize % pgSize) && (size_t)st.st_size > (size_t)pHead->imgOffs + pHead->imgSize) {
+				/* the tail of the last file page is bss */
+				size_t tail = pgSize - (pHead->imgSize % pgSize);
+				memset(pImg + pHead->imgSize, 0, tail);
+			}
+		} else {
+			memcpy(pImg, pMeta + pHead->imgOffs, pHead->imgSize);
+		}
+	}
+	close(fd);
+
+	pBin->pBinMem = pImg;
+	pBin->binMapSize = imgMapSize;
+	pBin->pMetaMem = pMeta;
+	pBin->metaSize = metaSize;
+	pBin->flags |= MINION_BIN_FLG_BIN_MAPPED | MINION_BIN_FLG_META_MAPPED;
+	if (!bin2_setup_meta(pBin, pMeta)) {
+		minion_sys_err("Can't allocate MINION v2 function table.\n");
+	}
+}
+#endif
+
+static void bin2_unmap(void* p, size_t size) {
+#ifndef MINION_NO_MMAP
+	if (p) munmap(p, size);
+#endif
+}
+
+static int bin2_write_pad(FILE* pFile, long offs) {
+	static const uint8_t zeros[64] = { 0 };
+	long cur = ftell(pFile);
+	while (cur < offs) {
+		long n = offs - cur;
+		if (n > (long)sizeof(zeros)) n = (long)sizeof(zeros);
+		if (fwrite(zeros, 1, (size_t)n, pFile) != (size_t)n) return 0;
+		cur += n;
+	}
+	return 1;
+}
+
+int minion_bin_save_v2(MINION_BIN* pBin, const char* pPath) {
+	MINION_BIN2_HEAD head;
+	MINION_BIN2_FUNC* pFuncs = NULL;
+	uint32_t* pHash = NULL;
+	uint32_t hashSize = 0;
+	uint32_t strSize = 1;
+	uint32_t imgSize, strOffs;
+	const uint8_t* pImg;
+	FILE* pFile;
+	int i, ok = 0;
+
+	if (!pBin || !pBin->pBinMem || !pPath) return 0;
+	pImg = (const uint8_t*)pBin->pBinMem;
+
+	/* trailing zeros become bss: they cost nothing to map */
+	imgSize = pBin->binSize;
+	while (imgSize > 0 && pImg[imgSize - 1] == 0) {
+		--imgSize;
+	}
+	imgSize = (imgSize + 3) & ~3U;
+	if (imgSize > pBin->binSize) imgSize = pBin->binSize;
+
+	for (i = 0; i < pBin->nfuncs; ++i) {
+		strSize += (uint32_t)strlen(pBin->pFuncs[i].pName) + 1;
+	}
+	if (pBin->nfuncs > 0) {
+		hashSize = minion_func_hash_size(pBin->nfuncs);
+		pFuncs = (MINION_BIN2_FUNC*)calloc(pBin->nfuncs, sizeof(MINION_BIN2_FUNC));
+		pHash = (uint32_t*)calloc(hashSize, sizeof(uint32_t));
+		if (!pFuncs || !pHash) goto done;
+		strOffs = 1;
+		for (i = 0; i < pBin->nfuncs; ++i) {
+			pFuncs[i].nameOffs = strOffs;
+			pFuncs[i].addr = pBin->pFuncs[i].addr;
+			pFuncs[i].size = pBin->pFuncs[i].size;
+			pFuncs[i].hash = minion_name_hash(pBin->pFuncs[i].pName);
+			strOffs += (uint32_t)strlen(pBin->pFuncs[i].pName) + 1;
+		}
+		minion_func_hash_build(pBin->pFuncs, pBin->nfuncs, pHash, hashSize - 1);
+	}
+
+	memset(&head, 0, sizeof(head));
+	memcpy(head.magic, MINION_BIN2_MAGIC, 8);
+	head.version = 2;
+	head.headSize = sizeof(MINION_BIN2_HEAD);
+	head.codeOrg = pBin->codeOrg;
+	head.dataOrg = pBin->dataOrg;
+	head.sdataOrg = pBin->sdataOrg;
+	head.gpIni = pBin->gpIni;
+	head.nfuncs = (uint32_t)pBin->nfuncs;
+	head.funcsOffs = head.headSize;
+	head.hashSize = hashSize;
+	head.hashOffs = head.funcsOffs + head.nfuncs * sizeof(MINION_BIN2_FUNC);
+	head.strOffs = head.hashOffs + hashSize * sizeof(uint32_t);
+	head.strSize = strSize;
+	head.imgOffs = (head.strOffs + strSize + MINION_BIN2_ALIGN - 1) & ~(MINION_BIN2_ALIGN - 1);
+	head.imgSize = imgSize;
+	head.bssSize = pBin->binSize - imgSize;
+
+	pFile = fopen(pPath, "wb");
+	if (!pFile) {
+		minion_sys_err("Can't create \"%s\".\n", pPath);
+		goto done;
+	}
+	ok = fwrite(&head, sizeof(head), 1, pFile) == 1;
+	if (pBin->nfuncs > 0) {
+		ok = ok && fwrite(pFuncs, sizeof(MINION_BIN2_FUNC), pBin->nfuncs, pFile) == (size_t)pBin->nfuncs;
+		ok = ok && fwrite(pHash, sizeof(uint32_t), hashSize, pFile) == hashSize;
+	}
+	ok = ok && fputc(0, pFile) != EOF;
+	for (i = 0; ok && i < pBin->nfuncs; ++i) {
+		const char* pName = pBin->pFuncs[i].pName;
+		ok = fwrite(pName, 1, strlen(pName) + 1, pFile) == strlen(pName) + 1;
+	}
+	ok = ok && bin2_write_pad(pFile, (long)head.imgOffs);
+	ok = ok && fwrite(pImg, 1, imgSize, pFile) == imgSize;
+	fclose(pFile);
+	if (!ok) {
+		minion_sys_err("Error writing \"%s\".\n", pPath);
+	}
+
+done:
+	if (pFuncs) free(pFuncs);
+	if (pHash) free(pHash);
+	return ok;
+}
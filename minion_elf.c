@@ -0,0 +1,279 @@
+/* minion: rv32g ISA simulator */
+/* SPDX-License-Identifier: MIT */
+/* SPDX-FileCopyrightText: 2023 Sergey Chaban <sergey.chaban@gmail.com> */
+
+/* RV32 ELF executables: PT_LOAD segments + .symtab, no packaging step */
+
+#define MINION_ELF_EM_RISCV 243
+#define MINION_ELF_PT_LOAD 1
+#define MINION_ELF_SHT_SYMTAB 2
+#define MINION_ELF_STT_FUNC 2
+#define MINION_ELF_MAX_IMAGE 0x10000000 /* lowest to highest PT_LOAD address */
+#define MINION_ELF_MAX_GAP 0x100000 /* between consecutive PT_LOADs, wider means a layout meant for separate regions */
+
+typedef struct _MINION_ELF_EHDR {
+	uint8_t ident[16];
+	uint16_t type;
+	uint16_t machine;
+	uint32_t version;
+	uint32_t entry;
+	uint32_t phoff;
+	uint32_t shoff;
+	uint32_t flags;
+	uint16_t ehsize;
+	uint16_t phentsize;
+	uint16_t phnum;
+	uint16_t shentsize;
+	uint16_t shnum;
+	uint16_t shstrndx;
+} MINION_ELF_EHDR;
+
+typedef struct _MINION_ELF_PHDR {
+	uint32_t type;
+	uint32_t offset;
+	uint32_t vaddr;
+	uint32_t paddr;
+	uint32_t filesz;
+	uint32_t memsz;
+	uint32_t flags;
+	uint32_t align;
+} MINION_ELF_PHDR;
+
+typedef struct _MINION_ELF_SHDR {
+	uint32_t name;
+	uint32_t type;
+	uint32_t flags;
+	uint32_t addr;
+	uint32_t offset;
+	uint32_t size;
+	uint32_t link;
+	uint32_t info;
+	uint32_t addralign;
+	uint32_t entsize;
+} MINION_ELF_SHDR;
+
+typedef struct _MINION_ELF_SYM {
+	uint32_t name;
+	uint32_t value;
+	uint32_t size;
+	uint8_t info;
+	uint8_t other;
+	uint16_t shndx;
+} MINION_ELF_SYM;
+
+int minion_elf_ck_magic(const void* pMem, size_t memSize) {
+	return pMem && memSize >= 4 && memcmp(pMem, "\x7F" "ELF", 4) == 0;
+}
+
+/* the file buffer has no alignment guarantees, so headers and symbols are copied out */
+static int elf_shdr(const uint8_t* pElf, size_t size, const MINION_ELF_EHDR* pEhdr, int idx, MINION_ELF_SHDR* pSh) {
+	uint64_t offs = (uint64_t)pEhdr->shoff + (uint64_t)idx * pEhdr->shentsize;
+	if (idx < 0 || idx >= pEhdr->shnum || offs + sizeof(MINION_ELF_SHDR) > size) return 0;
+	memcpy(pSh, pElf + offs, sizeof(MINION_ELF_SHDR));
+	return 1;
+}
+
+/* the table bounds are checked once in minion_bin_elf_from_mem */
+static void elf_phdr(const uint8_t* pElf, const MINION_ELF_EHDR* pEhdr, int idx, MINION_ELF_PHDR* pPh) {
+	memcpy(pPh, pElf + pEhdr->phoff + (size_t)idx * pEhdr->phentsize, sizeof(MINION_ELF_PHDR));
+}
+
+static const char* elf_str(const uint8_t* pElf, size_t size, const MINION_ELF_SHDR* pStrSec, uint32_t offs) {
+	if (!pStrSec || offs >= pStrSec->size || (uint64_t)pStrSec->offset + pStrSec->size > size) return "";
+	if (pElf[pStrSec->offset + pStrSec->size - 1] != 0) return "";
+	return (const char*)(pElf + pStrSec->offset + offs);
+}
+
+static int elf_find_sect(const uint8_t* pElf, size_t size, const MINION_ELF_EHDR* pEhdr, const char* pName, MINION_ELF_SHDR* pSh) {
+	MINION_ELF_SHDR shStr;
+	int i;
+	int hasStr = elf_shdr(pElf, size, pEhdr, pEhdr->shstrndx, &shStr);
+	for (i = 0; i < pEhdr->shnum; ++i) {
+		if (elf_shdr(pElf, size, pEhdr, i, pSh) && strcmp(elf_str(pElf, size, hasStr ? &shStr : NULL, pSh->name), pName) == 0) {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+static void elf_load_syms(MINION_BIN* pBin, const uint8_t* pElf, size_t size, const MINION_ELF_EHDR* pEhdr) {
+	int i, pass;
+	MINION_ELF_SHDR symSec;
+	MINION_ELF_SHDR strSec;
+	int hasStr;
+	uint32_t nsyms;
+	size_t nameMemSize = 0;
+	char* pName = NULL;
+	int ifn = 0;
+
+	for (i = 0; i < pEhdr->shnum; ++i) {
+		if (elf_shdr(pElf, size, pEhdr, i, &symSec) && symSec.type == MINION_ELF_SHT_SYMTAB) break;
+	}
+	if (i >= pEhdr->shnum || (uint64_t)symSec.offset + symSec.size > size) return;
+	hasStr = elf_shdr(pElf, size, pEhdr, (int)symSec.link, &strSec);
+	nsyms = symSec.size / sizeof(MINION_ELF_SYM);
+
+	/* pass 0 counts, pass 1 fills */
+	for (pass = 0; pass < 2; ++pass) {
+		for (i = 0; i < (int)nsyms; ++i) {
+			MINION_ELF_SYM sym;
+			const char* pSymName;
+			memcpy(&sym, pElf + symSec.offset + (size_t)i * sizeof(MINION_ELF_SYM), sizeof(MINION_ELF_SYM));
+			pSymName = elf_str(pElf, size, hasStr ? &strSec : NULL, sym.name);
+			if (pass == 0 && strcmp(pSymName, "__global_pointer$") == 0) {
+				pBin->gpIni = sym.value;
+			}
+			if ((sym.info & 0xF) != MINION_ELF_STT_FUNC || sym.shndx == 0 || !*pSymName) {
+				continue;
+			}
+			if (pass == 0) {
+				++pBin->nfuncs;
+				nameMemSize += strlen(pSymName) + 1;
+			} else {
+				size_t len = strlen(pSymName) + 1;
+				memcpy(pName, pSymName, len);
+				pBin->pFuncs[ifn].pName = pName;
+				pBin->pFuncs[ifn].addr = sym.value;
+				pBin->pFuncs[ifn].size = sym.size;
+				pName += len;
+				++ifn;
+			}
+		}
+		if (pass == 0) {
+			if (pBin->nfuncs == 0) return;
+			pBin->pFuncs = (MINION_FUNC_INFO*)minion_mem_alloc(&pBin->alloc, pBin->nfuncs * sizeof(MINION_FUNC_INFO));
+			pBin->pNameMem = (char*)minion_mem_alloc(&pBin->alloc, nameMemSize);
+			if (!pBin->pFuncs || !pBin->pNameMem) {
+				minion_sys_err("Can't allocate ELF symbols!\n");
+				pBin->nfuncs = 0;
+				return;
+			}
+			pName = pBin->pNameMem;
+		}
+	}
+
+	bin_index_funcs(pBin);
+}
+
+/* segments go to their place in the image one by one, only the gaps between them and their bss are cleared */
+void minion_bin_elf_from_mem(MINION_BIN* pBin, const void* pMem, size_t memSize) {
+	const uint8_t* pElf = (const uint8_t*)pMem;
+	MINION_ELF_EHDR ehdr;
+	MINION_ELF_PHDR ph;
+	MINION_ELF_SHDR sh;
+	uint8_t* pImg;
+	uint32_t lo = 0xFFFFFFFFU;
+	uint32_t hi = 0;
+	uint32_t fileHi = 0;
+	uint32_t cur;
+	int i;
+
+	if (!pBin || !minion_elf_ck_magic(pMem, memSize) || memSize < sizeof(MINION_ELF_EHDR)) {
+		minion_sys_err("Not an ELF!\n");
+		return;
+	}
+	memcpy(&ehdr, pMem, sizeof(MINION_ELF_EHDR));
+	if (ehdr.ident[4] != 1 || ehdr.ident[5] != 1 || ehdr.machine != MINION_ELF_EM_RISCV) {
+		minion_sys_err("Not an RV32 little-endian ELF!\n");
+		return;
+	}
+	if (ehdr.phentsize < sizeof(MINION_ELF_PHDR) || (uint64_t)ehdr.phoff + (uint64_t)ehdr.phnum * ehdr.phentsize > memSize) {
+		minion_sys_err("Invalid ELF program headers!\n");
+		return;
+	}
+
+	/* segments are vetted here, the copy below relies on them being inside [lo, hi), sorted and disjoint */
+	for (i = 0; i < ehdr.phnum; ++i) {
+		elf_phdr(pElf, &ehdr, i, &ph);
+		if (ph.type != MINION_ELF_PT_LOAD) continue;
+		if (ph.filesz > ph.memsz || (uint64_t)ph.vaddr + ph.memsz > 0xFFFFFFFFU || (uint64_t)ph.offset + ph.filesz > memSize) {
+			minion_sys_err("Invalid ELF segment #%d!\n", i);
+			return;
+		}
+		if (ph.memsz == 0) continue;
+		if (hi > lo && (ph.vaddr < hi || ph.vaddr - hi > MINION_ELF_MAX_GAP)) {
+			minion_sys_err("ELF segment #%d @ 0x%X doesn't follow the previous one (end 0x%X)!\n", i, ph.vaddr, hi);
+			return;
+		}
+		if (ph.vaddr < lo) lo = ph.vaddr;
+		hi = ph.vaddr + ph.memsz;
+		fileHi = ph.vaddr + ph.filesz;
+	}
+	if (hi <= lo) {
+		minion_sys_err("No loadable ELF segments!\n");
+		return;
+	}
+	if (hi - lo > MINION_ELF_MAX_IMAGE) {
+		minion_sys_err("ELF segments span 0x%X bytes!\n", hi - lo);
+		return;
+	}
+
+	pBin->version = 1;
+	pBin->codeOrg = lo;
+	if (ehdr.shentsize == sizeof(MINION_ELF_SHDR)) {
+		/* headers loaded below .text must not eat into the stack */
+		if (elf_find_sect(pElf, memSize, &ehdr, ".text", &sh) && sh.addr > lo && sh.addr < hi) {
+			pBin->codeOrg = sh.addr;
+		}
+		if (elf_find_sect(pElf, memSize, &ehdr, ".data", &sh)) {
+			pBin->dataOrg = sh.addr;
+		}
+		if (elf_find_sect(pElf, memSize, &ehdr, ".sdata", &sh)) {
+			pBin->sdataOrg = sh.addr;
+		}
+	}
+	pBin->binSize = hi - pBin->codeOrg;
+	pBin->bssSize = fileHi < hi ? hi - (fileHi > pBin->codeOrg ? fileHi : pBin->codeOrg) : 0;
+	pBin->pBinMem = minion_mem_alloc(&pBin->alloc, pBin->binSize);
+	if (!pBin->pBinMem) {
+		minion_sys_err("Can't allocate ELF image!\n");
+		return;
+	}
+	pImg = (uint8_t*)pBin->pBinMem;
+
+	cur = pBin->codeOrg;
+	for (i = 0; i < ehdr.phnum; ++i) {
+		uint32_t start, fileEnd, end;
+		elf_phdr(pElf, &ehdr, i, &ph);
+		if (ph.type != MINION_ELF_PT_LOAD || ph.memsz == 0) continue;
+		end = ph.vaddr + ph.memsz;
+		if (end <= pBin->codeOrg) continue;
+		start = ph.vaddr > pBin->codeOrg ? ph.vaddr : pBin->codeOrg;
+		fileEnd = ph.vaddr + ph.filesz;
+		if (fileEnd < start) fileEnd = start;
+		memset(pImg + (cur - pBin->codeOrg), 0, start - cur);
+		if (fileEnd > start) {
+			memcpy(pImg + (start - pBin->codeOrg), pElf + ph.offset + (start - ph.vaddr), fileEnd - start);
+		}
+		memset(pImg + (fileEnd - pBin->codeOrg), 0, end - fileEnd);
+		cur = end;
+	}
+
+	if (ehdr.shentsize == sizeof(MINION_ELF_SHDR)) {
+		elf_load_syms(pBin, pElf, memSize, &ehdr);
+	}
+}
+
+void minion_bin_load_elf(MINION_BIN* pBin, const char* pPath) {
+	FILE* pFile = pPath ? fopen(pPath, "rb") : NULL;
+	if (pFile) {
+		long len = 0;
+		void* pMem = NULL;
+		if (fseek(pFile, 0, SEEK_END) == 0) {
+			len = ftell(pFile);
+			fseek(pFile, 0, SEEK_SET);
+		}
+		if (len > 0 && pBin) {
+			pMem = minion_mem_alloc(&pBin->alloc, (size_t)len);
+		}
+		if (pMem && fread(pMem, 1, (size_t)len, pFile) == (size_t)len) {
+			minion_bin_elf_from_mem(pBin, pMem, (size_t)len);
+		} else {
+			minion_sys_err("Can't read \"%s\".\n", pPath);
+		}
+		if (pMem) minion_mem_free(&pBin->alloc, pMem);
+		fclose(pFile);
+	} else {
+		minion_sys_err("Can't find \"%s\".\n", pPath);
+	}
+}
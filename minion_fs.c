@@ -0,0 +1,345 @@
+/* minion: rv32g ISA simulator */
+/* SPDX-License-Identifier: MIT */
+/* SPDX-FileCopyrightText: 2023 Sergey Chaban <sergey.chaban@gmail.com> */
+
+/* file ecalls: guest paths are relative to a host directory, mmap maps file windows into a memMap slot */
+
+#if !defined(_WIN32)
+#	include <limits.h>
+#	include <fcntl.h>
+#	include <unistd.h>
+#endif
+#ifndef MINION_NO_THREADS
+#	include <pthread.h>
+#endif
+
+#define MINION_FS_PATH_MAX 1024
+
+/* slot tables only: held across a read or write so a concurrent close can't pull the FILE away */
+static void fs_lock(MINION_FS* pFs) {
+#ifndef MINION_NO_THREADS
+	if (pFs->pLock) pthread_mutex_lock((pthread_mutex_t*)pFs->pLock);
+#endif
+}
+
+static void fs_unlock(MINION_FS* pFs) {
+#ifndef MINION_NO_THREADS
+	if (pFs->pLock) pthread_mutex_unlock((pthread_mutex_t*)pFs->pLock);
+#endif
+}
+
+int minion_fs_init(MINION_FS* pFs, const char* pRoot) {
+	if (!pFs || !pRoot) return -1;
+	memset(pFs, 0, sizeof(MINION_FS));
+#if defined(_WIN32)
+	if (strlen(pRoot) >= sizeof(pFs->root)) return -1;
+	strcpy(pFs->root, pRoot);
+#else
+	{
+		char real[PATH_MAX];
+		if (!realpath(pRoot, real) || strlen(real) >= sizeof(pFs->root)) {
+			minion_sys_err("Bad file sandbox root \"%s\"!\n", pRoot);
+			return -1;
+		}
+		strcpy(pFs->root, real);
+	}
+#endif
+#ifndef MINION_NO_THREADS
+	pFs->pLock = malloc(sizeof(pthread_mutex_t));
+	if (!pFs->pLock) return -1;
+	pthread_mutex_init((pthread_mutex_t*)pFs->pLock, NULL);
+#endif
+	return 0;
+}
+
+#if !defined(_WIN32)
+static int fs_inside(const MINION_FS* pFs, const char* pPath) {
+	char real[PATH_MAX];
+	size_t lroot = strlen(pFs->root);
+	if (!realpath(pPath, real)) return -1;
+	return strncmp(real, pFs->root, lroot) == 0 && (real[lroot] == '/' || real[lroot] == 0) ? 1 : 0;
+}
+#endif
+
+/* relative names only, no ".." components; directory symlinks out of the root are caught by realpath,
+   the last component is opened with O_NOFOLLOW by fs_fopen; the check and the open are still racy against
+   a host process swapping directories underneath */
+static int fs_path(MINION* pMi, const MINION_FS* pFs, uint32_t vptr, char* pDst) {
+	char name[MINION_FS_PATH_MAX];
+	const char* pCh;
+	size_t len = 0;
+	size_t lroot = strlen(pFs->root);
+	while (1) {
+		if (len >= sizeof(name) || !minion_read(pMi, vptr + (uint32_t)len, &name[len], 1)) return -1;
+		if (name[len] == 0) break;
+		++len;
+	}
+	if (len == 0 || name[0] == '/' || name[0] == '\\' || strchr(name, ':')) return -1;
+	for (pCh = name; *pCh; ) {
+		size_t lcomp = strcspn(pCh, "/\\");
+		if (lcomp == 2 && pCh[0] == '.' && pCh[1] == '.') return -1;
+		pCh += lcomp;
+		if (*pCh) ++pCh;
+	}
+	if (lroot + 1 + len >= MINION_FS_PATH_MAX) return -1;
+	memcpy(pDst, pFs->root, lroot);
+	pDst[lroot] = '/';
+	memcpy(pDst + lroot + 1, name, len + 1);
+#if !defined(_WIN32)
+	{
+		int res = fs_inside(pFs, pDst);
+		if (res < 0) {
+			/* not there yet (or a dangling link): vet the directory it would be created in */
+			char* pSep = strrchr(pDst, '/');
+			*pSep = 0;
+			res = fs_inside(pFs, pDst);
+			*pSep = '/';
+		}
+		if (res != 1) return -1;
+	}
+#endif
+	return 0;
+}
+
+static FILE* fs_fopen(const char* pPath, int32_t mode) {
+	static const char* modes[] = { "rb", "wb", "ab" };
+#if defined(_WIN32)
+	return fopen(pPath, modes[mode]);
+#else
+	static const int flags[] = { O_RDONLY, O_WRONLY | O_CREAT | O_TRUNC, O_WRONLY | O_CREAT | O_APPEND };
+	FILE* pFile;
+	int fd = open(pPath, flags[mode] | O_NOFOLLOW, 0666);
+	if (fd < 0) return NULL;
+	pFile = fdopen(fd, modes[mode]);
+	if (!pFile) {
+		close(fd);
+	}
+	return pFile;
+#endif
+}
+
+static void fs_release_map(MINION_FS_MAP* pMap) {
+#ifndef MINION_NO_MMAP
+	if (pMap->isMapped) {
+		munmap(pMap->pBase, pMap->baseSize);
+	} else
+#endif
+	{
+		free(pMap->pBase);
+	}
+	memset(pMap, 0, sizeof(MINION_FS_MAP));
+}
+
+static FILE* fs_file(const MINION_FS* pFs, int32_t h) {
+	return (h >= 0 && h < MINION_FS_MAX_FILES) ? pFs->pFiles[h] : NULL;
+}
+
+static void fs_open(MINION* pMi, const MINION_NATIVE* pNat) {
+	MINION_FS* pFs = (MINION_FS*)pNat->pUser;
+	char path[MINION_FS_PATH_MAX];
+	uint32_t vPath = (uint32_t)minion_get_a0(pMi);
+	int32_t mode = minion_get_a1(pMi);
+	int h;
+	minion_set_a0(pMi, -1);
+	if (mode < MINION_FS_MODE_READ || mode > MINION_FS_MODE_APPEND) return;
+	if (fs_path(pMi, pFs, vPath, path) != 0) return;
+	fs_lock(pFs);
+	for (h = 0; h < MINION_FS_MAX_FILES; ++h) {
+		if (!pFs->pFiles[h]) break;
+	}
+	if (h < MINION_FS_MAX_FILES) {
+		pFs->pFiles[h] = fs_fopen(path, mode);
+		if (pFs->pFiles[h]) {
+			minion_set_a0(pMi, h);
+		}
+	}
+	fs_unlock(pFs);
+}
+
+static void fs_read(MINION* pMi, const MINION_NATIVE* pNat) {
+	MINION_FS* pFs = (MINION_FS*)pNat->pUser;
+	uint32_t len = (uint32_t)minion_get_a2(pMi);
+	void* pDst = minion_span_w(pMi, (uint32_t)minion_get_a1(pMi), len);
+	FILE* pFile;
+	int32_t res = -1;
+	fs_lock(pFs);
+	pFile = fs_file(pFs, minion_get_a0(pMi));
+	if (pFile && pDst) {
+		res = (int32_t)fread(pDst, 1, len, pFile);
+	}
+	fs_unlock(pFs);
+	minion_set_a0(pMi, res);
+}
+
+static void fs_write(MINION* pMi, const MINION_NATIVE* pNat) {
+	MINION_FS* pFs = (MINION_FS*)pNat->pUser;
+	uint32_t len = (uint32_t)minion_get_a2(pMi);
+	void* pSrc = minion_span(pMi, (uint32_t)minion_get_a1(pMi), len);
+	FILE* pFile;
+	int32_t res = -1;
+	fs_lock(pFs);
+	pFile = fs_file(pFs, minion_get_a0(pMi));
+	if (pFile && pSrc) {
+		res = (int32_t)fwrite(pSrc, 1, len, pFile);
+	}
+	fs_unlock(pFs);
+	minion_set_a0(pMi, res);
+}
+
+static void fs_close(MINION* pMi, const MINION_NATIVE* pNat) {
+	MINION_FS* pFs = (MINION_FS*)pNat->pUser;
+	int32_t h = minion_get_a0(pMi);
+	FILE* pFile;
+	fs_lock(pFs);
+	pFile = fs_file(pFs, h);
+	if (pFile) {
+		pFs->pFiles[h] = NULL;
+	}
+	fs_unlock(pFs);
+	minion_set_a0(pMi, pFile && fclose(pFile) == 0 ? 0 : -1);
+}
+
+static int64_t fs_size(FILE* pFile) {
+#if defined(_WIN32)
+	long pos = ftell(pFile);
+	long size;
+	if (pos < 0 || fseek(pFile, 0, SEEK_END) != 0) return -1;
+	size = ftell(pFile);
+	fseek(pFile, pos, SEEK_SET);
+	return size;
+#else
+	struct stat st;
+	return fstat(fileno(pFile), &st) == 0 ? (int64_t)st.st_size : -1;
+#endif
+}
+
+static void fs_stat(MINION* pMi, const MINION_NATIVE* pNat) {
+	char path[MINION_FS_PATH_MAX];
+	int64_t size = -1;
+	if (fs_path(pMi, (MINION_FS*)pNat->pUser, (uint32_t)minion_get_a0(pMi), path) == 0) {
+		FILE* pFile = fs_fopen(path, MINION_FS_MODE_READ);
+		if (pFile) {
+			size = fs_size(pFile);
+			fclose(pFile);
+		}
+	}
+	minion_set_a0(pMi, (int32_t)(uint32_t)size);
+	minion_set_a1(pMi, (int32_t)(uint32_t)((uint64_t)size >> 32));
+}
+
+/* RO maps are PROT_READ, host writers go through minion_span_w which refuses them */
+static uint32_t fs_map_file(MINION* pMi, MINION_FS* pFs) {
+	FILE* pFile = fs_file(pFs, minion_get_a0(pMi));
+	uint32_t offs = (uint32_t)minion_get_a1(pMi);
+	uint32_t len = (uint32_t)minion_get_a2(pMi);
+	uint32_t flags = (uint32_t)minion_get_a3(pMi) == MINION_FS_MAP_COW ? 0 : MINION_MEM_RO;
+	MINION_FS_MAP* pMap = NULL;
+	int64_t size;
+	uint32_t delta = 0;
+	int i;
+	if (!pFile) return 0;
+	for (i = 0; i < MINION_FS_MAX_MAPS; ++i) {
+		if (!pFs->maps[i].pBase) {
+			pMap = &pFs->maps[i];
+			break;
+		}
+	}
+	size = fs_size(pFile);
+	if (!pMap || size < 0 || (int64_t)offs >= size) return 0;
+	if ((int64_t)len > size - offs) {
+		len = (uint32_t)(size - offs);
+	}
+	if (len == 0 || len > (1U << MINION_VPTR_BITS)) return 0;
+#ifndef MINION_NO_MMAP
+	{
+		uint32_t pageMask = (uint32_t)sysconf(_SC_PAGESIZE) - 1;
+		void* p;
+		delta = offs & pageMask;
+		p = mmap(NULL, len + delta, flags & MINION_MEM_RO ? PROT_READ : PROT_READ | PROT_WRITE, MAP_PRIVATE, fileno(pFile), (off_t)(offs - delta));
+		if (p == MAP_FAILED) return 0;
+		pMap->pBase = p;
+		pMap->isMapped = 1;
+	}
+#else
+	{
+		long pos = ftell(pFile);
+		pMap->pBase = malloc(len);
+		if (!pMap->pBase) return 0;
+		if (fseek(pFile, (long)offs, SEEK_SET) != 0 || fread(pMap->pBase, 1, len, pFile) != len) {
+			memset(pMap->pBase, 0, len);
+		}
+		fseek(pFile, pos, SEEK_SET);
+		pMap->isMapped = 0;
+	}
+#endif
+	pMap->baseSize = len + delta;
+	pMap->vptr = minion_mem_map_ext(pMi, (uint8_t*)pMap->pBase + delta, len, flags);
+	if (!pMap->vptr) {
+		fs_release_map(pMap);
+	}
+	return pMap->vptr;
+}
+
+static void fs_mmap(MINION* pMi, const MINION_NATIVE* pNat) {
+	MINION_FS* pFs = (MINION_FS*)pNat->pUser;
+	uint32_t vptr;
+	fs_lock(pFs);
+	vptr = fs_map_file(pMi, pFs);
+	fs_unlock(pFs);
+	minion_set_a0(pMi, (int32_t)vptr);
+}
+
+static void fs_munmap(MINION* pMi, const MINION_NATIVE* pNat) {
+	MINION_FS* pFs = (MINION_FS*)pNat->pUser;
+	uint32_t vptr = (uint32_t)minion_get_a0(pMi);
+	int i;
+	fs_lock(pFs);
+	for (i = 0; i < MINION_FS_MAX_MAPS; ++i) {
+		if (pFs->maps[i].pBase && pFs->maps[i].vptr == vptr) {
+			minion_mem_unmap(pMi, vptr);
+			fs_release_map(&pFs->maps[i]);
+			break;
+		}
+	}
+	fs_unlock(pFs);
+}
+
+int minion_fs_register(MINION_CFG* pCfg, MINION_FS* pFs, uint32_t firstId) {
+	static const MINION_NATIVE_RAW_FN fns[MINION_FS_NUM_ECALLS] = {
+		fs_open, fs_read, fs_write, fs_close, fs_stat, fs_mmap, fs_munmap
+	};
+	int i;
+	if (!pCfg || !pFs || firstId + MINION_FS_NUM_ECALLS > MINION_MAX_ECALLS) return -1;
+	for (i = 0; i < MINION_FS_NUM_ECALLS; ++i) {
+		minion_register_ecall_raw(pCfg, firstId + i, fns[i], pFs);
+	}
+	/* read/write look the handle up under the lock and stat shares nothing, open/close/mmap stay on the calling thread */
+	minion_set_ecall_flags(pCfg, firstId + MINION_FS_READ, MINION_NATIVE_FLG_ASYNC_SAFE);
+	minion_set_ecall_flags(pCfg, firstId + MINION_FS_WRITE, MINION_NATIVE_FLG_ASYNC_SAFE);
+	minion_set_ecall_flags(pCfg, firstId + MINION_FS_STAT, MINION_NATIVE_FLG_ASYNC_SAFE);
+	return 0;
+}
+
+void minion_fs_release(MINION* pMi, MINION_FS* pFs) {
+	int i;
+	if (!pFs) return;
+	for (i = 0; i < MINION_FS_MAX_MAPS; ++i) {
+		if (pFs->maps[i].pBase) {
+			if (pMi) minion_mem_unmap(pMi, pFs->maps[i].vptr);
+			fs_release_map(&pFs->maps[i]);
+		}
+	}
+	for (i = 0; i < MINION_FS_MAX_FILES; ++i) {
+		if (pFs->pFiles[i]) {
+			fclose(pFs->pFiles[i]);
+			pFs->pFiles[i] = NULL;
+		}
+	}
+#ifndef MINION_NO_THREADS
+	if (pFs->pLock) {
+		pthread_mutex_destroy((pthread_mutex_t*)pFs->pLock);
+		free(pFs->pLock);
+		pFs->pLock = NULL;
+	}
+#endif
+}
@@ -0,0 +1,138 @@
+/* minion: rv32g ISA simulator */
+/* SPDX-License-Identifier: MIT */
+/* SPDX-FileCopyrightText: 2023 Sergey Chaban <sergey.chaban@gmail.com> */
+
+/* harts: register contexts sharing the main instance's stack memory and maps, one host thread per started hart */
+
+#ifndef MINION_NO_THREADS
+typedef struct _MINION_HARTS_SYS {
+	pthread_t threads[MINION_MAX_HARTS];
+} MINION_HARTS_SYS;
+
+static void* hart_thread(void* pArg) {
+	minion_exec((MINION*)pArg);
+	return NULL;
+}
+#endif
+
+/* hart 0 is pMain and keeps the top slice, stkSlice = 0 splits the stack evenly */
+int minion_harts_init(MINION_HARTS* pHarts, MINION* pMain, int nharts, uint32_t stkSlice) {
+	int i;
+	if (!pHarts || !pMain || !pMain->pStkMem || !pMain->pCold || nharts < 1 || nharts > MINION_MAX_HARTS) return -1;
+	memset(pHarts, 0, sizeof(MINION_HARTS));
+	if (stkSlice == 0) {
+		stkSlice = pMain->codeOrg / (uint32_t)nharts;
+	}
+	stkSlice &= ~15U;
+	if (stkSlice < 0x100 || (uint64_t)stkSlice * (uint32_t)nharts > pMain->codeOrg) {
+		minion_err(pMain, "harts: %d stack slices of 0x%X don't fit below 0x%X\n", nharts, stkSlice, pMain->codeOrg);
+		return -1;
+	}
+	pHarts->pMain = pMain;
+	pHarts->nharts = nharts;
+	pHarts->stkSlice = stkSlice;
+	if (nharts > 1) {
+		pHarts->pCtxs = minion_ctx_array_alloc(&pMain->pCfg->alloc, nharts);
+		pHarts->pColds = (MINION_COLD*)minion_mem_alloc(&pMain->pCfg->alloc, nharts * sizeof(MINION_COLD));
+		if (!pHarts->pCtxs || !pHarts->pColds) {
+			minion_harts_release(pHarts);
+			return -1;
+		}
+		memset(pHarts->pColds, 0, nharts * sizeof(MINION_COLD));
+	}
+	for (i = 1; i < nharts; ++i) {
+		MINION* pCtx = &pHarts->pCtxs[i];
+		pCtx->pCfg = pMain->pCfg;
+		pCtx->pCold = &pHarts->pColds[i];
+		pCtx->pCold->log = pMain->pCold->log;
+		pCtx->pBinMem = pMain->pBinMem;
+		pCtx->codeOrg = pMain->codeOrg;
+		pCtx->binSize = pMain->binSize;
+		pCtx->pStkMem = pMain->pStkMem;
+		pCtx->hartId = (uint32_t)i;
+		pCtx->pCold->pHarts = pHarts;
+	}
+#ifndef MINION_NO_THREADS
+	if (nharts > 1) {
+		pHarts->pSys = malloc(sizeof(MINION_HARTS_SYS));
+		if (!pHarts->pSys) {
+			minion_harts_release(pHarts);
+			return -1;
+		}
+	}
+#endif
+	pMain->hartId = 0;
+	pMain->pCold->pHarts = pHarts;
+	return 0;
+}
+
+/* entry(arg, hart) runs until it returns, without threads it runs to completion right here */
+int minion_hart_start(MINION_HARTS* pHarts, int hart, uint32_t entry, uint32_t arg) {
+	MINION* pCtx;
+	if (!pHarts || hart < 1 || hart >= pHarts->nharts) return -1;
+	if (!MINION_ATOMIC_CAS(&pHarts->busy[hart], 0, 1)) return -1;
+	pCtx = &pHarts->pCtxs[hart];
+	memset(pCtx->regs, 0, sizeof(pCtx->regs));
+	minion_set_ra(pCtx, MINION_PC_NATIVE);
+	minion_set_sp(pCtx, pCtx->codeOrg - (uint32_t)hart * pHarts->stkSlice);
+	pCtx->regs[3] = pHarts->pMain->regs[3];
+	pCtx->regs[4] = hart;
+	pCtx->regs[10] = (int32_t)arg;
+	pCtx->regs[11] = hart;
+	pCtx->pc = entry;
+	pCtx->pcStatus = 0;
+	pCtx->faultFlags = 0;
+	pCtx->resvValid = 0;
+#ifndef MINION_NO_THREADS
+	if (pthread_create(&((MINION_HARTS_SYS*)pHarts->pSys)->threads[hart], NULL, hart_thread, pCtx) != 0) {
+		minion_err(pHarts->pMain, "harts: can't start hart %d\n", hart);
+		MINION_STORE_REL(&pHarts->busy[hart], 0);
+		return -1;
+	}
+#else
+	minion_exec(pCtx);
+#endif
+	return 0;
+}
+
+int32_t minion_hart_join(MINION_HARTS* pHarts, int hart) {
+	if (!pHarts || hart < 1 || hart >= pHarts->nharts || !MINION_LOAD_ACQ(&pHarts->busy[hart])) return 0;
+#ifndef MINION_NO_THREADS
+	pthread_join(((MINION_HARTS_SYS*)pHarts->pSys)->threads[hart], NULL);
+#endif
+	MINION_STORE_REL(&pHarts->busy[hart], 0);
+	return pHarts->pCtxs[hart].regs[10];
+}
+
+static void hart_start_ecall(MINION* pMi, const MINION_NATIVE* pNat) {
+	(void)pNat;
+	minion_set_a0(pMi, minion_hart_start(pMi->pCold->pHarts, minion_get_a0(pMi), (uint32_t)minion_get_a1(pMi), (uint32_t)minion_get_a2(pMi)));
+}
+
+static void hart_join_ecall(MINION* pMi, const MINION_NATIVE* pNat) {
+	(void)pNat;
+	minion_set_a0(pMi, minion_hart_join(pMi->pCold->pHarts, minion_get_a0(pMi)));
+}
+
+int minion_harts_register(MINION_CFG* pCfg, uint32_t firstId) {
+	if (!pCfg || firstId + MINION_HART_NUM_ECALLS > MINION_MAX_ECALLS) return -1;
+	minion_register_ecall_raw(pCfg, firstId + MINION_HART_START, hart_start_ecall, NULL);
+	minion_register_ecall_raw(pCfg, firstId + MINION_HART_JOIN, hart_join_ecall, NULL);
+	return 0;
+}
+
+/* harts still running are waited for */
+void minion_harts_release(MINION_HARTS* pHarts) {
+	int i;
+	if (!pHarts) return;
+	for (i = 1; i < pHarts->nharts; ++i) {
+		minion_hart_join(pHarts, i);
+	}
+	if (pHarts->pMain) {
+		pHarts->pMain->pCold->pHarts = NULL;
+		minion_ctx_array_free(&pHarts->pMain->pCfg->alloc, pHarts->pCtxs);
+		minion_mem_free(&pHarts->pMain->pCfg->alloc, pHarts->pColds);
+	}
+	free(pHarts->pSys);
+	memset(pHarts, 0, sizeof(MINION_HARTS));
+}
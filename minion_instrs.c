@@ -2,7 +2,7 @@
 /* SPDX-License-Identifier: MIT */
 /* SPDX-FileCopyrightText: 2023 Sergey Chaban <sergey.chaban@gmail.com> */
 
-static int s_altMnemonics = 1;
+#define ALT_MNEMONICS(_pMi) ((ctx_log(_pMi)->flags & MINION_LOG_STD_MNEMONICS) == 0)
 
 static void dispatch_F(MINION* pMi, uint32_t instr, uint32_t mode);
 static void dispatch_M(MINION* pMi, uint32_t instr, uint32_t mode);
@@ -150,9 +150,9 @@ static void arith_R(MINION* pMi, uint32_t instr, uint32_t mode) {
 	if (mode & MINION_IMODE_ECHO) {
 		minion_msg(pMi, "%08X: %08X  %s  %s, %s, %s\n",
 		           pMi->pc, instr, pOpName,
-		           minion_get_reg_name(rd),
-		           minion_get_reg_name(rs1),
-		           minion_get_reg_name(rs2)
+		           minion_get_reg_name(pMi, rd),
+		           minion_get_reg_name(pMi, rs1),
+		           minion_get_reg_name(pMi, rs2)
 		);
 	}
 
@@ -184,7 +184,7 @@ static void arith_I(MINION* pMi, uint32_t instr, uint32_t mode) {
 	switch (fn3) {
 		case 0:
 			pOpName = "addi";
-			if (s_altMnemonics) {
+			if (ALT_MNEMONICS(pMi)) {
 				isNOP = (rd == 0) & (rs1 == 0);
 				isLI = (rs1 == 0);
 				isMV = (imm == 0) & (!isLI);
@@ -232,20 +232,20 @@ static void arith_I(MINION* pMi, uint32_t instr, uint32_t mode) {
 		} else if (isMV) {
 			minion_msg(pMi, "%08X: %08X  mv   %s, %s\n",
 				pMi->pc, instr,
-				minion_get_reg_name(rd),
-				minion_get_reg_name(rs1)
+				minion_get_reg_name(pMi, rd),
+				minion_get_reg_name(pMi, rs1)
 			);
 		} else if (isLI) {
 			minion_msg(pMi, "%08X: %08X  li   %s, %d\n",
 				pMi->pc, instr,
-				minion_get_reg_name(rd),
+				minion_get_reg_name(pMi, rd),
 				imm
 			);
 		} else {
 			minion_msg(pMi, "%08X: %08X  %s %s, %s, %d\n",
 		           pMi->pc, instr, pOpName,
-		           minion_get_reg_name(rd),
-		           minion_get_reg_name(rs1),
+		           minion_get_reg_name(pMi, rd),
+		           minion_get_reg_name(pMi, rs1),
 		           imm
 			);
 		}
@@ -256,19 +256,198 @@ static void arith_I(MINION* pMi, uint32_t instr, uint32_t mode) {
 	}
 }
 
+#define AMO_LR 0x02
+#define AMO_SC 0x03
+
+static int32_t amo_apply(uint32_t op, int32_t x, int32_t v) {
+	switch (op) {
+		case 0x00: return x + v;
+		case 0x01: return v;
+		case 0x04: return x ^ v;
+		case 0x08: return x | v;
+		case 0x0C: return x & v;
+		case 0x10: return x < v ? x : v;
+		case 0x14: return x > v ? x : v;
+		case 0x18: return (uint32_t)x < (uint32_t)v ? x : v;
+		case 0x1C: return (uint32_t)x > (uint32_t)v ? x : v;
+	}
+	return x;
+}
+
+/* AMOs are CAS loops on the host word; sc.w compares against the value lr.w saw, so it can't see ABA writes */
+static void amo_ops(MINION* pMi, uint32_t instr, uint32_t mode) {
+	static const char* opNames[32] = {
+		"amoadd.w", "amoswap.w", "lr.w", "sc.w", "amoxor.w", NULL, NULL, NULL,
+		"amoor.w", NULL, NULL, NULL, "amoand.w", NULL, NULL, NULL,
+		"amomin.w", NULL, NULL, NULL, "amomax.w", NULL, NULL, NULL,
+		"amominu.w", NULL, NULL, NULL, "amomaxu.w", NULL, NULL, NULL
+	};
+	uint32_t op = instr >> 27;
+	int rd = get_rd(instr);
+	int rs1 = get_rs1(instr);
+	int rs2 = get_rs2(instr);
+	const char* pOpName = get_funct3(instr) == 2 ? opNames[op] : NULL;
+
+	if (mode & MINION_IMODE_ECHO) {
+		if (!pOpName) {
+			minion_msg(pMi, "%08X: %08X  <invalid_amo>\n", pMi->pc, instr);
+		} else if (op == AMO_LR) {
+			minion_msg(pMi, "%08X: %08X  %s  %s, (%s)\n", pMi->pc, instr, pOpName,
+			           minion_get_reg_name(pMi, rd), minion_get_reg_name(pMi, rs1));
+		} else {
+			minion_msg(pMi, "%08X: %08X  %s  %s, %s, (%s)\n", pMi->pc, instr, pOpName,
+			           minion_get_reg_name(pMi, rd), minion_get_reg_name(pMi, rs2), minion_get_reg_name(pMi, rs1));
+		}
+	}
+
+	if ((mode & MINION_IMODE_EXEC) && pOpName) {
+		uint32_t vaddr = (uint32_t)pMi->regs[rs1];
+		int32_t v = pMi->regs[rs2];
+		int32_t* p = NULL;
+		int32_t x;
+		if ((vaddr & 3) == 0 && (op == AMO_LR || !mem_map_ro(pMi, vaddr))) {
+			p = (int32_t*)minion_span(pMi, vaddr, 4);
+		}
+		/* mapped host buffers need not be aligned even when the guest address is, and host atomics need it */
+		if (!p || ((uintptr_t)p & 3) != 0) {
+			minion_err(pMi, "%s: bad address %X\n", pOpName, vaddr);
+			pMi->faultFlags |= 1;
+			return;
+		}
+		if (op == AMO_LR) {
+			x = (int32_t)MINION_LOAD_ACQ(p);
+			pMi->resvAddr = vaddr;
+			pMi->resvVal = x;
+			pMi->resvValid = 1;
+		} else if (op == AMO_SC) {
+			x = (pMi->resvValid && pMi->resvAddr == vaddr && MINION_ATOMIC_CAS(p, pMi->resvVal, v)) ? 0 : 1;
+			pMi->resvValid = 0;
+		} else {
+			do {
+				x = (int32_t)MINION_LOAD_ACQ(p);
+			} while (!MINION_ATOMIC_CAS(p, x, amo_apply(op, x, v)));
+		}
+		if (rd != 0) {
+			pMi->regs[rd] = x;
+		}
+	}
+}
+
 static void dispatch_A(MINION* pMi, uint32_t instr, uint32_t mode) {
-	if (pMi->aext_fn) {
+	if (pMi->pCfg->aext_fn) {
 		uint32_t op = instr >> 27;
 		int rd = get_rd(instr);
 		int rs1 = get_rs1(instr);
 		int rs2 = get_rs2(instr);
-		pMi->aext_fn(pMi, op, rd, rs1, rs2, instr, mode);
+		pMi->pCfg->aext_fn(pMi, op, rd, rs1, rs2, instr, mode);
+	} else {
+		amo_ops(pMi, instr, mode);
+	}
+}
+
+static void invalid_op(MINION* pMi, uint32_t instr, uint32_t mode) {
+	if (mode & MINION_IMODE_ECHO) {
+		minion_msg(pMi, "%08X: %08X  <invalid>\n", pMi->pc, instr);
+	}
+	if (mode & MINION_IMODE_EXEC) {
+		minion_err(pMi, "illegal instruction %08X @ %X\n", instr, pMi->pc);
+		pMi->faultFlags |= 1;
+	}
+}
+
+/* fflags/frm are plain storage: FP ops neither raise flags nor honour the rounding mode */
+static const char* csr_name(uint32_t csr) {
+	switch (csr) {
+		case 0x001: return "fflags";
+		case 0x002: return "frm";
+		case 0x003: return "fcsr";
+		case 0xC00: return "cycle";
+		case 0xC02: return "instret";
+		case 0xF14: return "mhartid";
+	}
+	return NULL;
+}
+
+static uint32_t csr_read(MINION* pMi, uint32_t csr) {
+	switch (csr) {
+		case 0x001: return pMi->fcsr & 0x1F;
+		case 0x002: return (pMi->fcsr >> 5) & 7;
+		case 0x003: return pMi->fcsr & 0xFF;
+		case 0xC00:
+		case 0xC02: return pMi->instrsExecuted;
+		case 0xF14: return pMi->hartId;
+	}
+	return 0;
+}
+
+/* only the FP CSRs are writable, csr_ops faults on writes to the others */
+static void csr_write(MINION* pMi, uint32_t csr, uint32_t val) {
+	switch (csr) {
+		case 0x001: pMi->fcsr = (pMi->fcsr & ~0x1FU) | (val & 0x1F); break;
+		case 0x002: pMi->fcsr = (pMi->fcsr & ~0xE0U) | ((val & 7) << 5); break;
+		case 0x003: pMi->fcsr = val & 0xFF; break;
+	}
+}
+
+static void csr_ops(MINION* pMi, uint32_t instr, uint32_t mode) {
+	static const char* opNames[8] = { NULL, "csrrw", "csrrs", "csrrc", NULL, "csrrwi", "csrrsi", "csrrci" };
+	uint32_t csr = (instr >> 20) & 0xFFF;
+	int fn3 = get_funct3(instr);
+	int rd = get_rd(instr);
+	int rs1 = get_rs1(instr);
+	const char* pCsrName = csr_name(csr);
+
+	if (mode & MINION_IMODE_ECHO) {
+		char csrStr[16];
+		if (pCsrName) {
+			sprintf(csrStr, "%s", pCsrName);
+		} else {
+			sprintf(csrStr, "0x%03X", csr);
+		}
+		if (!opNames[fn3]) {
+			minion_msg(pMi, "%08X: %08X  <invalid_csr>\n", pMi->pc, instr);
+		} else if (ALT_MNEMONICS(pMi) && fn3 == 2 && rs1 == 0) {
+			minion_msg(pMi, "%08X: %08X  csrr  %s, %s\n", pMi->pc, instr, minion_get_reg_name(pMi, rd), csrStr);
+		} else if (fn3 & 4) {
+			minion_msg(pMi, "%08X: %08X  %s %s, %s, %d\n", pMi->pc, instr, opNames[fn3], minion_get_reg_name(pMi, rd), csrStr, rs1);
+		} else {
+			minion_msg(pMi, "%08X: %08X  %s %s, %s, %s\n", pMi->pc, instr, opNames[fn3],
+			           minion_get_reg_name(pMi, rd), csrStr, minion_get_reg_name(pMi, rs1));
+		}
+	}
+
+	if ((mode & MINION_IMODE_EXEC) && opNames[fn3]) {
+		uint32_t src = (fn3 & 4) ? (uint32_t)rs1 : (uint32_t)pMi->regs[rs1];
+		uint32_t old;
+		if (!pCsrName || (csr > 0x003 && ((fn3 & 3) == 1 || rs1 != 0))) {
+			invalid_op(pMi, instr, MINION_IMODE_EXEC);
+			return;
+		}
+		old = csr_read(pMi, csr);
+		switch (fn3 & 3) {
+			case 1:
+				csr_write(pMi, csr, src);
+				break;
+			case 2:
+				if (rs1 != 0) csr_write(pMi, csr, old | src);
+				break;
+			case 3:
+				if (rs1 != 0) csr_write(pMi, csr, old & ~src);
+				break;
+		}
+		if (rd != 0) {
+			pMi->regs[rd] = (int32_t)old;
+		}
 	}
 }
 
 static void sys_ops(MINION* pMi, uint32_t instr, uint32_t mode) {
 	int32_t imm = get_I_imm(instr);
 	const char* pOpName = "<sys>";
+	if (get_funct3(instr) != 0) {
+		csr_ops(pMi, instr, mode);
+		return;
+	}
 	if (imm == 0) {
 		pOpName = "ecall";
 	} else if (imm == 1) {
@@ -284,12 +463,21 @@ static void sys_ops(MINION* pMi, uint32_t instr, uint32_t mode) {
 
 	if (mode & MINION_IMODE_EXEC) {
 		if (imm == 0) {
-			if (pMi->ecall_fn) {
-				pMi->ecall_fn(pMi);
+			MINION_CFG* pCfg = pMi->pCfg;
+			uint32_t id = (uint32_t)pMi->regs[17];
+			if (id < MINION_MAX_ECALLS) {
+				++pMi->pCold->ecallCounts[id];
+				if (pCfg->ecalls[id].invoke) {
+					pCfg->ecalls[id].invoke(pMi, &pCfg->ecalls[id]);
+					return;
+				}
+			}
+			if (pCfg->ecall_fn) {
+				pCfg->ecall_fn(pMi);
 			}
 		} else if (imm == 1) {
-			if (pMi->ebreak_fn) {
-				pMi->ebreak_fn(pMi);
+			if (pMi->pCfg->ebreak_fn) {
+				pMi->pCfg->ebreak_fn(pMi);
 			}
 		}
 	}
@@ -329,31 +517,59 @@ static void load_ops(MINION* pMi, uint32_t instr, uint32_t mode) {
 	if (mode & MINION_IMODE_ECHO) {
 		minion_msg(pMi, "%08X: %08X  %s   %s,%d(%s)\n",
 		           pMi->pc, instr, pOpName,
-		           minion_get_reg_name(rd),
+		           minion_get_reg_name(pMi, rd),
 		           imm,
-		           minion_get_reg_name(rs1)
+		           minion_get_reg_name(pMi, rs1)
 		);
 	}
 
 	if (mode & MINION_IMODE_EXEC) {
-		if (rd != 0 && size != 0) {
-			void* pNativeSrc = minion_resolve_vptr(pMi, pMi->regs[rs1] + imm);
+		uint32_t vaddr = pMi->regs[rs1] + imm;
+		if (size != 0 && minion_is_io_vptr(vaddr)) {
+			uint32_t val = io_load(pMi, vaddr, size < 0 ? -size : size);
+			if (rd != 0) {
+				switch (size) {
+					case -1:
+						pMi->regs[rd] = (int8_t)val;
+						break;
+					case -2:
+						pMi->regs[rd] = (int16_t)val;
+						break;
+					case 1:
+						pMi->regs[rd] = (uint8_t)val;
+						break;
+					case 2:
+						pMi->regs[rd] = (uint16_t)val;
+						break;
+					case 4:
+						pMi->regs[rd] = (int32_t)val;
+						break;
+				}
+			}
+		} else if (rd != 0 && size != 0) {
+			void* pNativeSrc = minion_resolve_vptr(pMi, vaddr);
 			if (pNativeSrc) {
 				switch (size) {
 					case -1:
 						pMi->regs[rd] = *(int8_t*)pNativeSrc;
 						break;
-					case -2:
-						pMi->regs[rd] = *(int16_t*)pNativeSrc;
+					case -2: {
+						int16_t val;
+						memcpy(&val, pNativeSrc, sizeof(val));
+						pMi->regs[rd] = val;
 						break;
+					}
 					case 1:
 						pMi->regs[rd] = *(uint8_t*)pNativeSrc;
 						break;
-					case 2:
-						pMi->regs[rd] = *(uint16_t*)pNativeSrc;
+					case 2: {
+						uint16_t val;
+						memcpy(&val, pNativeSrc, sizeof(val));
+						pMi->regs[rd] = val;
 						break;
+					}
 					case 4:
-						pMi->regs[rd] = *(int32_t*)pNativeSrc;
+						memcpy(&pMi->regs[rd], pNativeSrc, sizeof(uint32_t));
 						break;
 				}
 			}
@@ -387,15 +603,18 @@ static void store_ops(MINION* pMi, uint32_t instr, uint32_t mode) {
 	if (mode & MINION_IMODE_ECHO) {
 		minion_msg(pMi, "%08X: %08X  %s   %s,%d(%s)\n",
 		           pMi->pc, instr, pOpName,
-		           minion_get_reg_name(rs2),
+		           minion_get_reg_name(pMi, rs2),
 		           imm,
-		           minion_get_reg_name(rs1)
+		           minion_get_reg_name(pMi, rs1)
 		);
 	}
 
 	if (mode & MINION_IMODE_EXEC) {
-		if (size > 0) {
-			void* pNativeDst = minion_resolve_vptr(pMi, pMi->regs[rs1] + imm);
+		uint32_t vaddr = pMi->regs[rs1] + imm;
+		if (size > 0 && minion_is_io_vptr(vaddr)) {
+			io_store(pMi, vaddr, pMi->regs[rs2], size);
+		} else if (size > 0) {
+			void* pNativeDst = resolve_store(pMi, vaddr);
 			if (pNativeDst) {
 				void* pRegSrc = &pMi->regs[rs2];
 				memcpy(pNativeDst, pRegSrc, size);
@@ -434,8 +653,8 @@ static void branch_ops(MINION* pMi, uint32_t instr, uint32_t mode) {
 		}
 		minion_msg(pMi, "%08X: %08X  b%s  %s, %s, %X\n", pMi->pc, instr,
 		           pCmpName,
-		           minion_get_reg_name(rs1),
-		           minion_get_reg_name(rs2),
+		           minion_get_reg_name(pMi, rs1),
+		           minion_get_reg_name(pMi, rs2),
 		           pMi->pc + imm
 		);
 	}
@@ -479,12 +698,12 @@ static void jalr_op(MINION* pMi, uint32_t instr, uint32_t mode) {
 	int isRet = (instr == 0x8067);
 
 	if (mode & MINION_IMODE_ECHO) {
-		if (isRet && s_altMnemonics) {
+		if (isRet && ALT_MNEMONICS(pMi)) {
 			minion_msg(pMi, "%08X: %08X  ret\n", pMi->pc, instr);
 		} else {
 			minion_msg(pMi, "%08X: %08X  jalr  %s, %s, %d\n", pMi->pc, instr,
-		           minion_get_reg_name(rd),
-		           minion_get_reg_name(rs1),
+		           minion_get_reg_name(pMi, rd),
+		           minion_get_reg_name(pMi, rs1),
 		           imm
 			);
 		}
@@ -500,6 +719,9 @@ static void jalr_op(MINION* pMi, uint32_t instr, uint32_t mode) {
 		if (isRet) {
 			pMi->pcStatus |= MINION_PCSTATUS_RET;
 		}
+		if ((uint32_t)newPC - MINION_PC_IMPORT < MINION_MAX_NATIVES * 4) {
+			native_thunk(pMi, ((uint32_t)newPC - MINION_PC_IMPORT) >> 2);
+		}
 	}
 }
 
@@ -507,11 +729,11 @@ static void jal_op(MINION* pMi, uint32_t instr, uint32_t mode) {
 	int rd = get_rd(instr);
 	int32_t imm = get_UJ_imm(instr);
 	if (mode & MINION_IMODE_ECHO) {
-		if (s_altMnemonics && rd == 0) {
+		if (ALT_MNEMONICS(pMi) && rd == 0) {
 			minion_msg(pMi, "%08X: %08X  j    %X\n", pMi->pc, instr, pMi->pc + imm);
 		} else {
 			minion_msg(pMi, "%08X: %08X  jal  %s, %X\n", pMi->pc, instr,
-		               minion_get_reg_name(rd), pMi->pc + imm);
+		               minion_get_reg_name(pMi, rd), pMi->pc + imm);
 		}
 	}
 
@@ -526,11 +748,91 @@ static void jal_op(MINION* pMi, uint32_t instr, uint32_t mode) {
 }
 
 static void fence_ops(MINION* pMi, uint32_t instr, uint32_t mode) {
+	if (mode & MINION_IMODE_ECHO) {
+		minion_msg(pMi, "%08X: %08X  fence\n", pMi->pc, instr);
+	}
+	if (mode & MINION_IMODE_EXEC) {
+		MINION_FENCE();
+	}
 }
 
-static void invalid_op(MINION* pMi, uint32_t instr, uint32_t mode) {
+/* runs the host implementation and then the guest copy nested, the guest results are the ones kept;
+   both see the same memory, so only pure functions with a scalar result are registered for checking */
+static void repl_check(MINION* pMi, MINION_REPLACED* pRep) {
+	int32_t regs[32];
+	double fregs[32];
+	int32_t a0, a1;
+	float f0, gf0;
+	double d0, gd0;
+	uint32_t ra = (uint32_t)pMi->regs[1];
+	int same = 1;
+
+	memcpy(regs, pMi->regs, sizeof(regs));
+	memcpy(fregs, pMi->fregs, sizeof(fregs));
+	pRep->nat.invoke(pMi, &pRep->nat);
+	a0 = pMi->regs[10];
+	a1 = pMi->regs[11];
+	f0 = minion_get_freg_s(pMi, 10);
+	d0 = pMi->fregs[10];
+	memcpy(pMi->regs, regs, sizeof(regs));
+	memcpy(pMi->fregs, fregs, sizeof(fregs));
+
+	pMi->regs[1] = (int32_t)MINION_PC_NATIVE;
+	minion_instr(pMi, pRep->origInstr, MINION_IMODE_EXEC);
+	while (!(pMi->pcStatus & MINION_PCSTATUS_NATIVE)) {
+		minion_instr(pMi, minion_fetch_pc_instr(pMi), MINION_IMODE_EXEC);
+	}
+	pMi->regs[1] = (int32_t)ra;
+	if (pMi->faultFlags) return;
+
+	switch (pRep->retType) {
+		case MINION_SIG_I64:
+			same = a0 == pMi->regs[10] && a1 == pMi->regs[11];
+			break;
+		case MINION_SIG_F32:
+			gf0 = minion_get_freg_s(pMi, 10);
+			same = f0 == gf0 || fabsf(f0 - gf0) <= 1e-5f * fmaxf(1.0f, fabsf(gf0));
+			break;
+		case MINION_SIG_F64:
+			gd0 = pMi->fregs[10];
+			same = d0 == gd0 || fabs(d0 - gd0) <= 1e-12 * fmax(1.0, fabs(gd0));
+			break;
+		default:
+			same = a0 == pMi->regs[10];
+			break;
+	}
+	MINION_ATOMIC_INC(&pRep->nchecked);
+	if (!same && MINION_ATOMIC_INC(&pRep->nmismatches) == 1) {
+		minion_err(pMi, "native %s disagrees with the guest copy\n", pRep->nat.pName);
+	}
+}
+
+/* custom-0: entry of a replaced guest function, bits 7+ index pCfg->repls */
+static void custom0_op(MINION* pMi, uint32_t instr, uint32_t mode) {
+	uint32_t irep = instr >> 7;
+	MINION_REPLACED* pRep = irep < (uint32_t)pMi->pCfg->nrepls ? &pMi->pCfg->repls[irep] : NULL;
+
 	if (mode & MINION_IMODE_ECHO) {
-		minion_msg(pMi, "%08X: %08X  <invalid>\n", pMi->pc, instr);
+		minion_msg(pMi, "%08X: %08X  native %s\n", pMi->pc, instr, pRep ? pRep->nat.pName : "<unbound>");
+	}
+
+	if (mode & MINION_IMODE_EXEC) {
+		uint32_t n;
+		if (!pRep) {
+			minion_err(pMi, "unbound native replacement @ %X\n", pMi->pc);
+			pMi->faultFlags |= 1;
+			return;
+		}
+		n = MINION_ATOMIC_INC(&pRep->ncalls);
+		if (pRep->checkEvery && n % pRep->checkEvery == 0) {
+			repl_check(pMi, pRep);
+			if (pMi->faultFlags) return;
+		} else {
+			pRep->nat.invoke(pMi, &pRep->nat);
+		}
+		/* the nested guest run leaves NATIVE behind */
+		pMi->pc = (uint32_t)pMi->regs[1];
+		pMi->pcStatus = MINION_PCSTATUS_JALR | MINION_PCSTATUS_RET;
 	}
 }
 
@@ -539,7 +841,7 @@ static void lui_op(MINION* pMi, uint32_t instr, uint32_t mode) {
 	uint32_t imm = get_U_imm(instr);
 	if (mode & MINION_IMODE_ECHO) {
 		minion_msg(pMi, "%08X: %08X  lui  %s, 0x%X\n", pMi->pc, instr,
-		           minion_get_reg_name(rd), imm
+		           minion_get_reg_name(pMi, rd), imm
 		);
 	}
 	if (mode & MINION_IMODE_EXEC) {
@@ -554,7 +856,7 @@ static void auipc_op(MINION* pMi, uint32_t instr, uint32_t mode) {
 	uint32_t imm = get_U_imm(instr);
 	if (mode & MINION_IMODE_ECHO) {
 		minion_msg(pMi, "%08X: %08X  auipc %s, 0x%X\n", pMi->pc, instr,
-		           minion_get_reg_name(rd), imm
+		           minion_get_reg_name(pMi, rd), imm
 		);
 	}
 	if (mode & MINION_IMODE_EXEC) {
@@ -586,15 +888,19 @@ static void f_load_ops(MINION* pMi, uint32_t instr, uint32_t mode) {
 	if (mode & MINION_IMODE_ECHO) {
 		minion_msg(pMi, "%08X: %08X  %s   %s,%d(%s)\n",
 		           pMi->pc, instr, pOpName,
-		           minion_get_f_reg_name(rd),
+		           minion_get_f_reg_name(pMi, rd),
 		           imm,
-		           minion_get_reg_name(rs1)
+		           minion_get_reg_name(pMi, rs1)
 		);
 	}
 
 	if (mode & MINION_IMODE_EXEC) {
-		if (size > 0) {
-			void* pNativeSrc = minion_resolve_vptr(pMi, pMi->regs[rs1] + imm);
+		uint32_t vaddr = pMi->regs[rs1] + imm;
+		if (size == sizeof(float) && minion_is_io_vptr(vaddr)) {
+			uint32_t val = io_load(pMi, vaddr, (int)size);
+			memcpy(&pMi->fregs[rd], &val, size);
+		} else if (size > 0) {
+			void* pNativeSrc = minion_resolve_vptr(pMi, vaddr);
 			if (pNativeSrc) {
 				memcpy(&pMi->fregs[rd], pNativeSrc, size);
 			}
@@ -624,15 +930,20 @@ static void f_store_ops(MINION* pMi, uint32_t instr, uint32_t mode) {
 	if (mode & MINION_IMODE_ECHO) {
 		minion_msg(pMi, "%08X: %08X  %s   %s,%d(%s)\n",
 		           pMi->pc, instr, pOpName,
-		           minion_get_f_reg_name(rs2),
+		           minion_get_f_reg_name(pMi, rs2),
 		           imm,
-		           minion_get_reg_name(rs1)
+		           minion_get_reg_name(pMi, rs1)
 		);
 	}
 
 	if (mode & MINION_IMODE_EXEC) {
-		if (size > 0) {
-			void* pNativeDst = minion_resolve_vptr(pMi, pMi->regs[rs1] + imm);
+		uint32_t vaddr = pMi->regs[rs1] + imm;
+		if (size == sizeof(float) && minion_is_io_vptr(vaddr)) {
+			uint32_t val;
+			memcpy(&val, &pMi->fregs[rs2], size);
+			io_store(pMi, vaddr, val, (int)size);
+		} else if (size > 0) {
+			void* pNativeDst = resolve_store(pMi, vaddr);
 			if (pNativeDst) {
 				memcpy(pNativeDst, &pMi->fregs[rs2], size);
 			}
@@ -670,7 +981,7 @@ static void f_calc_common_s(MINION* pMi, uint32_t instr, uint32_t mode) {
 			case 4:
 				if (0 == fn3) {
 					pOpName = "fsgnj.s";
-					if (s_altMnemonics && (rs1 == rs2)) {
+					if (ALT_MNEMONICS(pMi) && (rs1 == rs2)) {
 						pOpName = "fmv.s";
 						fmt = 1;
 					} else {
@@ -678,7 +989,7 @@ static void f_calc_common_s(MINION* pMi, uint32_t instr, uint32_t mode) {
 					}
 				} else if (1 == fn3) {
 					pOpName = "fsgnjn.s";
-					if (s_altMnemonics && (rs1 == rs2)) {
+					if (ALT_MNEMONICS(pMi) && (rs1 == rs2)) {
 						pOpName = "fneg.s";
 						fmt = 1;
 					} else {
@@ -686,7 +997,7 @@ static void f_calc_common_s(MINION* pMi, uint32_t instr, uint32_t mode) {
 					}
 				} else if (2 == fn3) {
 					pOpName = "fsgnjx.s";
-					if (s_altMnemonics && (rs1 == rs2)) {
+					if (ALT_MNEMONICS(pMi) && (rs1 == rs2)) {
 						pOpName = "fabs.s";
 						fmt = 1;
 					} else {
@@ -755,34 +1066,34 @@ static void f_calc_common_s(MINION* pMi, uint32_t instr, uint32_t mode) {
 			} else if (0 == fmt) {
 				minion_msg(pMi, "%08X: %08X  %s  %s, %s, %s\n", pMi->pc, instr,
 				           pOpName,
-				           minion_get_f_reg_name(rd),
-				           minion_get_f_reg_name(rs1),
-				           minion_get_f_reg_name(rs2)
+				           minion_get_f_reg_name(pMi, rd),
+				           minion_get_f_reg_name(pMi, rs1),
+				           minion_get_f_reg_name(pMi, rs2)
 				);
 			} else if (1 == fmt) {
 				minion_msg(pMi, "%08X: %08X  %s  %s, %s\n", pMi->pc, instr,
 				           pOpName,
-				           minion_get_f_reg_name(rd),
-				           minion_get_f_reg_name(rs1)
+				           minion_get_f_reg_name(pMi, rd),
+				           minion_get_f_reg_name(pMi, rs1)
 				);
 			} else if (2 == fmt) {
 				minion_msg(pMi, "%08X: %08X  %s  %s, %s, %s\n", pMi->pc, instr,
 				           pOpName,
-				           minion_get_reg_name(rd),
-				           minion_get_f_reg_name(rs1),
-				           minion_get_f_reg_name(rs2)
+				           minion_get_reg_name(pMi, rd),
+				           minion_get_f_reg_name(pMi, rs1),
+				           minion_get_f_reg_name(pMi, rs2)
 				);
 			} else if (3 == fmt) {
 				minion_msg(pMi, "%08X: %08X  %s  %s, %s\n", pMi->pc, instr,
 				           pOpName,
-				           minion_get_reg_name(rd),
-				           minion_get_f_reg_name(rs1)
+				           minion_get_reg_name(pMi, rd),
+				           minion_get_f_reg_name(pMi, rs1)
 				);
 			} else if (4 == fmt) {
 				minion_msg(pMi, "%08X: %08X  %s  %s, %s\n", pMi->pc, instr,
 				           pOpName,
-				           minion_get_f_reg_name(rd),
-				           minion_get_reg_name(rs1)
+				           minion_get_f_reg_name(pMi, rd),
+				           minion_get_reg_name(pMi, rs1)
 				);
 			} else {
 				minion_msg(pMi, "%08X: %08X  %s fmt%d\n", pMi->pc, instr, pOpName, fmt);
@@ -964,10 +1275,10 @@ static void f_calc_fused_s(MINION* pMi, uint32_t instr, uint32_t mode) {
 		}
 		minion_msg(pMi, "%08X: %08X  %s  %s, %s, %s, %s\n", pMi->pc, instr,
 		           pOpName,
-		           minion_get_f_reg_name(rd),
-		           minion_get_f_reg_name(rs1),
-		           minion_get_f_reg_name(rs2),
-		           minion_get_f_reg_name(rs3)
+		           minion_get_f_reg_name(pMi, rd),
+		           minion_get_f_reg_name(pMi, rs1),
+		           minion_get_f_reg_name(pMi, rs2),
+		           minion_get_f_reg_name(pMi, rs3)
 		);
 	}
 
@@ -1122,9 +1433,9 @@ static void dispatch_M(MINION* pMi, uint32_t instr, uint32_t mode) {
 	if (mode & MINION_IMODE_ECHO) {
 		minion_msg(pMi, "%08X: %08X  %s  %s, %s, %s\n",
 		           pMi->pc, instr, pOpName,
-		           minion_get_reg_name(rd),
-		           minion_get_reg_name(rs1),
-		           minion_get_reg_name(rs2)
+		           minion_get_reg_name(pMi, rd),
+		           minion_get_reg_name(pMi, rs1),
+		           minion_get_reg_name(pMi, rs2)
 		);
 	}
 
@@ -1189,6 +1500,8 @@ void minion_instr(MINION* pMi, uint32_t instr, uint32_t mode) {
 	} else if (op1 == 2)  {
 		if (op2 == 2) {
 			dispatch_F(pMi, instr, mode);
+		} else if (op2 == 0) {
+			custom0_op(pMi, instr, mode);
 		} else {
 			invalid_op(pMi, instr, mode);
 		}
@@ -1244,6 +1557,12 @@ void minion_instr(MINION* pMi, uint32_t instr, uint32_t mode) {
 		} else {
 			if (pMi->pc == MINION_PC_NATIVE) {
 				pMi->pcStatus |= MINION_PCSTATUS_NATIVE;
+				if (pMi->pCmdRing) {
+					minion_cmd_flush(pMi);
+				}
+				if (pMi->pCold->pOut && pMi->pCold->pOut->flushOnReturn) {
+					minion_out_flush(pMi);
+				}
 			}
 		}
 	}
@@ -1255,8 +1574,24 @@ uint32_t minion_fetch_pc_instr(MINION* pMi) {
 		uint32_t binOffs = pMi->pc - pMi->codeOrg;
 		if (binOffs < pMi->binSize) {
 			memcpy(&instr, ((uint8_t*)pMi->pBinMem) + binOffs, sizeof(uint32_t));
+		} else if (pMi->pCfg->nmods > 0) {
+			void* pInstr = mod_span(pMi->pCfg, pMi->pc, sizeof(uint32_t));
+			if (pInstr) {
+				memcpy(&instr, pInstr, sizeof(uint32_t));
+			}
 		}
 	}
 	return instr;
 }
 
+/* runs until the guest returns to MINION_PC_NATIVE or faults */
+uint32_t minion_exec(MINION* pMi) {
+	uint32_t n0;
+	if (!pMi) return 0;
+	n0 = pMi->instrsExecuted;
+	while (1) {
+		minion_instr(pMi, minion_fetch_pc_instr(pMi), MINION_IMODE_EXEC);
+		if (pMi->pcStatus & MINION_PCSTATUS_NATIVE) break;
+	}
+	return pMi->instrsExecuted - n0;
+}
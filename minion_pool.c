@@ -0,0 +1,279 @@
+/* minion: rv32g ISA simulator */
+/* SPDX-License-Identifier: MIT */
+/* SPDX-FileCopyrightText: 2023 Sergey Chaban <sergey.chaban@gmail.com> */
+
+/* instance pool: one guest instance per worker thread, per-worker job queues, idle workers steal */
+
+#ifndef MINION_NO_THREADS
+#	include <sched.h>
+
+typedef struct _MINION_POOL_SYS {
+	pthread_mutex_t mtx;
+	pthread_cond_t idleCv;
+	pthread_t threads[MINION_POOL_MAX_WORKERS];
+	int nthreads;
+	uint32_t quit;
+} MINION_POOL_SYS;
+
+#	define POOL_SYS(_pPool) ((MINION_POOL_SYS*)(_pPool)->pSys)
+#endif
+
+static uint64_t pool_nanos(void) {
+#if defined(_WIN32)
+	return (uint64_t)((double)clock() * 1.0e9 / CLOCKS_PER_SEC);
+#else
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000U + (uint64_t)ts.tv_nsec;
+#endif
+}
+
+/* Vyukov's bounded queue: cell seq says whether the cell is free for pos (seq == pos) or holds pos (seq == pos + 1) */
+static int pool_queue_put(MINION_POOL_WORKER* pW, MINION_POOL_JOB* pJob) {
+	uint32_t pos = MINION_LOAD_ACQ(&pW->head);
+	while (1) {
+		MINION_POOL_CELL* pCell = &pW->cells[pos & (MINION_POOL_QUEUE_SIZE - 1)];
+		int32_t dif = (int32_t)(MINION_LOAD_ACQ(&pCell->seq) - pos);
+		if (dif == 0) {
+			if (MINION_ATOMIC_CAS(&pW->head, pos, pos + 1)) {
+				pCell->pJob = pJob;
+				MINION_STORE_REL(&pCell->seq, pos + 1);
+				return 1;
+			}
+		} else if (dif < 0) {
+			return 0;
+		}
+		pos = MINION_LOAD_ACQ(&pW->head);
+	}
+}
+
+static MINION_POOL_JOB* pool_queue_get(MINION_POOL_WORKER* pW) {
+	uint32_t pos = MINION_LOAD_ACQ(&pW->tail);
+	while (1) {
+		MINION_POOL_CELL* pCell = &pW->cells[pos & (MINION_POOL_QUEUE_SIZE - 1)];
+		int32_t dif = (int32_t)(MINION_LOAD_ACQ(&pCell->seq) - (pos + 1));
+		if (dif == 0) {
+			if (MINION_ATOMIC_CAS(&pW->tail, pos, pos + 1)) {
+				MINION_POOL_JOB* pJob = pCell->pJob;
+				MINION_STORE_REL(&pCell->seq, pos + MINION_POOL_QUEUE_SIZE);
+				return pJob;
+			}
+		} else if (dif < 0) {
+			return NULL;
+		}
+		pos = MINION_LOAD_ACQ(&pW->tail);
+	}
+}
+
+static int pool_queue_empty(MINION_POOL_WORKER* pW) {
+	return MINION_LOAD_ACQ(&pW->head) == MINION_LOAD_ACQ(&pW->tail);
+}
+
+static void pool_run(MINION_POOL* pPool, MINION_POOL_WORKER* pW, MINION_POOL_JOB* pJob) {
+	MINION* pMi = &pPool->pCtxs[pW->idx];
+	uint64_t t0 = pool_nanos();
+	pJob->ok = minion_call(pMi, pJob->hFn, pJob->pSig, pJob->args, &pJob->ret);
+	MINION_STORE_REL64(&pW->busyNanos, pW->busyNanos + (pool_nanos() - t0));
+	MINION_STORE_REL(&pW->njobs, pW->njobs + 1);
+	if (pJob->done_fn) {
+		pJob->done_fn(pJob);
+	} else {
+		MINION_STORE_REL(&pJob->done, 1);
+	}
+}
+
+#ifndef MINION_NO_THREADS
+/* other queues are scanned starting next to the thief, so thieves spread out */
+static MINION_POOL_JOB* pool_steal(MINION_POOL* pPool, int idx) {
+	int i;
+	for (i = 1; i < pPool->nworkers; ++i) {
+		MINION_POOL_JOB* pJob = pool_queue_get(&pPool->pWorkers[(idx + i) % pPool->nworkers]);
+		if (pJob) return pJob;
+	}
+	return NULL;
+}
+
+static int pool_has_work(MINION_POOL* pPool) {
+	int i;
+	for (i = 0; i < pPool->nworkers; ++i) {
+		if (!pool_queue_empty(&pPool->pWorkers[i])) return 1;
+	}
+	return 0;
+}
+
+/* the submitter checks nsleeping after its put, the sleeper rechecks the queues after announcing itself */
+static void pool_idle(MINION_POOL* pPool) {
+	MINION_POOL_SYS* pSys = POOL_SYS(pPool);
+	pthread_mutex_lock(&pSys->mtx);
+	MINION_ATOMIC_INC(&pPool->nsleeping);
+	MINION_FENCE();
+	if (!pool_has_work(pPool) && !MINION_LOAD_ACQ(&pSys->quit)) {
+		pthread_cond_wait(&pSys->idleCv, &pSys->mtx);
+	}
+	MINION_ATOMIC_DEC(&pPool->nsleeping);
+	pthread_mutex_unlock(&pSys->mtx);
+}
+
+static void* pool_worker(void* pArg) {
+	MINION_POOL_WORKER* pW = (MINION_POOL_WORKER*)pArg;
+	MINION_POOL* pPool = pW->pPool;
+	while (1) {
+		MINION_POOL_JOB* pJob = pool_queue_get(pW);
+		if (!pJob) {
+			pJob = pool_steal(pPool, pW->idx);
+			if (pJob) {
+				MINION_STORE_REL(&pW->nstolen, pW->nstolen + 1);
+			}
+		}
+		if (pJob) {
+			pool_run(pPool, pW, pJob);
+		} else if (MINION_LOAD_ACQ(&POOL_SYS(pPool)->quit)) {
+			break;
+		} else {
+			pool_idle(pPool);
+		}
+	}
+	return NULL;
+}
+#endif
+
+int minion_pool_init(MINION_POOL* pPool, MINION_CFG* pCfg, int nworkers) {
+	int i, j;
+	if (!pPool || !pCfg || !pCfg->pBin) return -1;
+	memset(pPool, 0, sizeof(MINION_POOL));
+	if (nworkers < 1) nworkers = 1;
+	if (nworkers > MINION_POOL_MAX_WORKERS) nworkers = MINION_POOL_MAX_WORKERS;
+	pPool->pCfg = pCfg;
+	pPool->pCtxs = minion_ctx_array_alloc(&pCfg->alloc, nworkers);
+	pPool->pWorkers = (MINION_POOL_WORKER*)minion_mem_alloc(&pCfg->alloc, nworkers * sizeof(MINION_POOL_WORKER));
+	if (!pPool->pCtxs || !pPool->pWorkers) {
+		minion_sys_err("can't allocate pool workers\n");
+		minion_pool_release(pPool);
+		return -1;
+	}
+	memset(pPool->pWorkers, 0, nworkers * sizeof(MINION_POOL_WORKER));
+	pPool->nworkers = nworkers;
+	for (i = 0; i < nworkers; ++i) {
+		MINION_POOL_WORKER* pW = &pPool->pWorkers[i];
+		minion_ctx_init(&pPool->pCtxs[i], pCfg);
+		for (j = 0; j < MINION_POOL_QUEUE_SIZE; ++j) {
+			pW->cells[j].seq = (uint32_t)j;
+		}
+		pW->pPool = pPool;
+		pW->idx = i;
+	}
+	pPool->t0 = pool_nanos();
+#ifndef MINION_NO_THREADS
+	{
+		MINION_POOL_SYS* pSys = (MINION_POOL_SYS*)malloc(sizeof(MINION_POOL_SYS));
+		if (!pSys) {
+			minion_pool_release(pPool);
+			return -1;
+		}
+		memset(pSys, 0, sizeof(MINION_POOL_SYS));
+		pthread_mutex_init(&pSys->mtx, NULL);
+		pthread_cond_init(&pSys->idleCv, NULL);
+		pPool->pSys = pSys;
+		for (i = 0; i < nworkers; ++i) {
+			if (pthread_create(&pSys->threads[i], NULL, pool_worker, &pPool->pWorkers[i]) != 0) break;
+			++pSys->nthreads;
+		}
+		if (pSys->nthreads < nworkers) {
+			/* a worker without a thread would strand the jobs put in its queue */
+			minion_sys_err("can't start pool workers\n");
+			minion_pool_release(pPool);
+			return -1;
+		}
+	}
+#endif
+	return 0;
+}
+
+/* returns 0 when every queue is full */
+int minion_pool_submit(MINION_POOL* pPool, MINION_POOL_JOB* pJob) {
+	int i;
+	uint32_t iw;
+	if (!pPool || !pJob || !pPool->pWorkers) return 0;
+	pJob->done = 0;
+	pJob->ok = 0;
+#ifndef MINION_NO_THREADS
+	if (pPool->pSys) {
+		iw = MINION_ATOMIC_INC(&pPool->nextWorker);
+		for (i = 0; i < pPool->nworkers; ++i) {
+			if (pool_queue_put(&pPool->pWorkers[(iw + i) % pPool->nworkers], pJob)) {
+				MINION_FENCE();
+				if (MINION_LOAD_ACQ(&pPool->nsleeping)) {
+					MINION_POOL_SYS* pSys = POOL_SYS(pPool);
+					pthread_mutex_lock(&pSys->mtx);
+					pthread_cond_signal(&pSys->idleCv);
+					pthread_mutex_unlock(&pSys->mtx);
+				}
+				return 1;
+			}
+		}
+		return 0;
+	}
+#endif
+	(void)i;
+	(void)iw;
+	pool_run(pPool, &pPool->pWorkers[0], pJob);
+	return 1;
+}
+
+int minion_pool_job_done(const MINION_POOL_JOB* pJob) {
+	return pJob ? MINION_LOAD_ACQ(&pJob->done) != 0 : 0;
+}
+
+/* for jobs without done_fn */
+void minion_pool_wait(MINION_POOL* pPool, MINION_POOL_JOB* pJob) {
+	if (!pPool || !pJob) return;
+	while (!minion_pool_job_done(pJob)) {
+#ifndef MINION_NO_THREADS
+		sched_yield();
+#endif
+	}
+}
+
+void minion_pool_stats(MINION_POOL* pPool, int iworker, MINION_POOL_STATS* pStats) {
+	MINION_POOL_WORKER* pW;
+	double elapsed;
+	if (!pStats) return;
+	memset(pStats, 0, sizeof(MINION_POOL_STATS));
+	if (!pPool || iworker < 0 || iworker >= pPool->nworkers) return;
+	pW = &pPool->pWorkers[iworker];
+	pStats->njobs = MINION_LOAD_ACQ(&pW->njobs);
+	pStats->nstolen = MINION_LOAD_ACQ(&pW->nstolen);
+	pStats->busySecs = (double)MINION_LOAD_ACQ64(&pW->busyNanos) * 1.0e-9;
+	elapsed = (double)(pool_nanos() - pPool->t0) * 1.0e-9;
+	pStats->utilization = elapsed > 0.0 ? pStats->busySecs / elapsed : 0.0;
+}
+
+/* queued jobs are run before the workers exit */
+void minion_pool_release(MINION_POOL* pPool) {
+	int i;
+	if (!pPool) return;
+#ifndef MINION_NO_THREADS
+	if (pPool->pSys) {
+		MINION_POOL_SYS* pSys = POOL_SYS(pPool);
+		pthread_mutex_lock(&pSys->mtx);
+		MINION_STORE_REL(&pSys->quit, 1);
+		pthread_cond_broadcast(&pSys->idleCv);
+		pthread_mutex_unlock(&pSys->mtx);
+		for (i = 0; i < pSys->nthreads; ++i) {
+			pthread_join(pSys->threads[i], NULL);
+		}
+		pthread_cond_destroy(&pSys->idleCv);
+		pthread_mutex_destroy(&pSys->mtx);
+		free(pSys);
+		pPool->pSys = NULL;
+	}
+#endif
+	if (pPool->pCtxs) {
+		for (i = 0; i < pPool->nworkers; ++i) {
+			minion_release(&pPool->pCtxs[i]);
+		}
+		minion_ctx_array_free(&pPool->pCfg->alloc, pPool->pCtxs);
+	}
+	minion_mem_free(&pPool->pCfg->alloc, pPool->pWorkers);
+	memset(pPool, 0, sizeof(MINION_POOL));
+}
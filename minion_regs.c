@@ -2,9 +2,7 @@
 /* SPDX-License-Identifier: MIT */
 /* SPDX-FileCopyrightText: 2023 Sergey Chaban <sergey.chaban@gmail.com> */
 
-static int s_altRegNames = 1;
-
-const char* minion_get_reg_name(int reg) {
+const char* minion_get_reg_name(MINION* pMi, int reg) {
 	const char* pName;
 	static const char* nameTbl[] = {
 		"x0", "zero",
@@ -41,14 +39,14 @@ const char* minion_get_reg_name(int reg) {
 		"x31", "t6"
 	};
 	if (reg >= 0 && reg <= 31) {
-		pName = nameTbl[reg*2 + (s_altRegNames ? 1 : 0)];
+		pName = nameTbl[reg*2 + ((ctx_log(pMi)->flags & MINION_LOG_STD_REGNAMES) ? 0 : 1)];
 	} else {
 		pName = "<invalid-reg>";
 	}
 	return pName;
 }
 
-const char* minion_get_f_reg_name(int reg) {
+const char* minion_get_f_reg_name(MINION* pMi, int reg) {
 	const char* pName;
 	static const char* nameTbl[] = {
 		"f0", "ft0",
@@ -85,7 +83,7 @@ const char* minion_get_f_reg_name(int reg) {
 		"f31", "ft11"
 	};
 	if (reg >= 0 && reg <= 31) {
-		pName = nameTbl[reg*2 + (s_altRegNames ? 1 : 0)];
+		pName = nameTbl[reg*2 + ((ctx_log(pMi)->flags & MINION_LOG_STD_REGNAMES) ? 0 : 1)];
 	} else {
 		pName = "<invalid-freg>";
 	}
@@ -169,7 +167,7 @@ void minion_dump_regs(MINION* pMi) {
 	int i;
 	if (!pMi) return;
 	for (i = 0; i < 32; ++i) {
-		minion_msg(pMi, "%s: 0x%08X (%d)\n", minion_get_reg_name(i), pMi->regs[i], pMi->regs[i]);
+		minion_msg(pMi, "%s: 0x%08X (%d)\n", minion_get_reg_name(pMi, i), pMi->regs[i], pMi->regs[i]);
 	}
 }
 
@@ -177,7 +175,7 @@ void minion_dump_fregs_s(MINION* pMi) {
 	int i;
 	if (!pMi) return;
 	for (i = 0; i < 32; ++i) {
-		minion_msg(pMi, "%s: %f\n", minion_get_f_reg_name(i), minion_get_freg_s(pMi, i));
+		minion_msg(pMi, "%s: %f\n", minion_get_f_reg_name(pMi, i), minion_get_freg_s(pMi, i));
 	}
 }
 
@@ -185,7 +183,7 @@ void minion_dump_fregs_d(MINION* pMi) {
 	int i;
 	if (!pMi) return;
 	for (i = 0; i < 32; ++i) {
-		minion_msg(pMi, "%s: %f\n", minion_get_f_reg_name(i), minion_get_freg_d(pMi, i));
+		minion_msg(pMi, "%s: %f\n", minion_get_f_reg_name(pMi, i), minion_get_freg_d(pMi, i));
 	}
 }
 
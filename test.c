@@ -112,6 +112,13 @@ int peek32(int32_t* p) {
 	return *p;
 }
 
+void io_double(volatile uint32_t* pPort) {
+	uint32_t n = pPort[1];
+	while (n--) {
+		pPort[0] = pPort[0] * 2;
+	}
+}
+
 uint32_t fib(uint32_t x) {
 	if (x >= 2) {
 		x = fib(x - 1) + fib(x - 2);
@@ -176,6 +183,240 @@ static void envcall_void(uint32_t id, uintptr_t ptr) {
 	);
 }
 
+static float envcall_f(uint32_t id, float x, float y) {
+	register float argRes __asm("fa0") = x;
+	register float arg1 __asm("fa1") = y;
+	register uint32_t callId __asm("a7") = id;
+	__asm volatile(
+		"ecall"
+		: "+f" (argRes)
+		: "f" (arg1), "r" (callId)
+		: "memory"
+	);
+	return argRes;
+}
+
+static uint32_t envcall_mathv(int32_t func, float* pDst, const float* pX, const float* pY, uint32_t n) {
+	register int32_t argRes __asm("a0") = func;
+	register uintptr_t arg1 __asm("a1") = (uintptr_t)pDst;
+	register uintptr_t arg2 __asm("a2") = (uintptr_t)pX;
+	register uintptr_t arg3 __asm("a3") = (uintptr_t)pY;
+	register uint32_t arg4 __asm("a4") = n;
+	register uint32_t callId __asm("a7") = ECALL_MATHV;
+	__asm volatile(
+		"ecall"
+		: "+r" (argRes)
+		: "r" (arg1), "r" (arg2), "r" (arg3), "r" (arg4), "r" (callId)
+		: "memory"
+	);
+	return (uint32_t)argRes;
+}
+
+/* generic form: arguments in a0-a5, id in a6, 64-bit result in a0/a1 */
+int64_t ecall_raw(uint32_t a0, uint32_t a1, uint32_t a2, uint32_t a3, uint32_t a4, uint32_t a5, uint32_t id) {
+	register uint32_t argRes0 __asm("a0") = a0;
+	register uint32_t argRes1 __asm("a1") = a1;
+	register uint32_t arg2 __asm("a2") = a2;
+	register uint32_t arg3 __asm("a3") = a3;
+	register uint32_t arg4 __asm("a4") = a4;
+	register uint32_t arg5 __asm("a5") = a5;
+	register uint32_t callId __asm("a7") = id;
+	__asm volatile(
+		"ecall"
+		: "+r" (argRes0), "+r" (argRes1)
+		: "r" (arg2), "r" (arg3), "r" (arg4), "r" (arg5), "r" (callId)
+		: "memory"
+	);
+	return (int64_t)(((uint64_t)argRes1 << 32) | argRes0);
+}
+
+/* layout must match MINION_RING in minion.h */
+typedef struct _MINION_RING {
+	uint32_t head;
+	uint32_t pad0[15];
+	uint32_t tail;
+	uint32_t pad1[15];
+	uint32_t mask;
+	uint32_t elemSize;
+	uint32_t pad2[14];
+} MINION_RING;
+
+static void ring_fence() {
+	__asm volatile("fence rw, rw" ::: "memory");
+}
+
+static void ring_copy(uint32_t* pDst, const uint32_t* pSrc, uint32_t nwords) {
+	while (nwords--) {
+		*pDst++ = *pSrc++;
+	}
+}
+
+int ring_put(MINION_RING* pRing, const void* pSrc) {
+	volatile MINION_RING* pR = pRing;
+	uint32_t head = pR->head;
+	uint32_t* pData;
+	if (head - pR->tail > pR->mask) {
+		return 0;
+	}
+	pData = (uint32_t*)(pRing + 1) + (head & pR->mask) * (pR->elemSize >> 2);
+	ring_copy(pData, (const uint32_t*)pSrc, pR->elemSize >> 2);
+	ring_fence();
+	pR->head = head + 1;
+	return 1;
+}
+
+int ring_get(MINION_RING* pRing, void* pDst) {
+	volatile MINION_RING* pR = pRing;
+	uint32_t tail = pR->tail;
+	uint32_t* pData;
+	if (pR->head == tail) {
+		return 0;
+	}
+	ring_fence();
+	pData = (uint32_t*)(pRing + 1) + (tail & pR->mask) * (pR->elemSize >> 2);
+	ring_copy((uint32_t*)pDst, pData, pR->elemSize >> 2);
+	ring_fence();
+	pR->tail = tail + 1;
+	return 1;
+}
+
+int ring_double(MINION_RING* pIn, MINION_RING* pOut) {
+	int n = 0;
+	int32_t val;
+	while (ring_get(pIn, &val)) {
+		val *= 2;
+		if (!ring_put(pOut, &val)) {
+			break;
+		}
+		++n;
+	}
+	return n;
+}
+
+/* layout must match MINION_CMD in minion.h */
+typedef struct _MINION_CMD {
+	uint32_t id;
+	uint32_t args[3];
+} MINION_CMD;
+
+/* queued ecalls: no trap until the ring fills up, arguments pointing to guest memory must stay valid until the host drains them */
+static void cmd_put(MINION_RING* pCmds, uint32_t id, uint32_t arg) {
+	MINION_CMD cmd;
+	cmd.id = id;
+	cmd.args[0] = arg;
+	cmd.args[1] = 0;
+	cmd.args[2] = 0;
+	while (!ring_put(pCmds, &cmd)) {
+		envcall_void(ECALL_CMDFLUSH, 0);
+	}
+}
+
+void q_str(MINION_RING* pCmds, const char* pStr) { cmd_put(pCmds, ECALL_OUTSTR, (uintptr_t)pStr); }
+void q_int(MINION_RING* pCmds, int i) { cmd_put(pCmds, ECALL_PUTINT, (uint32_t)i); }
+void q_hex(MINION_RING* pCmds, int i) { cmd_put(pCmds, ECALL_PUTHEX, (uint32_t)i); }
+void q_eol(MINION_RING* pCmds) { q_str(pCmds, "\n"); }
+void q_flush() { envcall_void(ECALL_CMDFLUSH, 0); }
+
+void test_cmds(MINION_RING* pCmds) {
+	int i;
+	q_str(pCmds, "Queued from minion...");
+	q_eol(pCmds);
+	for (i = 0; i < 100; ++i) {
+		q_int(pCmds, i);
+		q_str(pCmds, " ");
+	}
+	q_eol(pCmds);
+}
+
+int sum10(int a, int b, int c, int d, int e, int f, int g, int h, int i, int j) {
+	return a + b + c + d + e + f + g + h + i + j;
+}
+
+int64_t add_i64(int64_t a, int64_t b) {
+	return a + b;
+}
+
+float mix_if(int i, float x) {
+	return x + (float)i;
+}
+
+int64_t tail_i64(int a, int b, int c, int d, int e, int f, int g, int64_t l) {
+	return l;
+}
+
+float sum9f(float a, float b, float c, float d, float e, float f, float g, float h, float i) {
+	return a + b + c + d + e + f + g + h + i;
+}
+
+typedef struct _VEC4I {
+	int32_t x, y, z, w;
+} VEC4I;
+
+VEC4I vec4i_scale(VEC4I v, int s) {
+	VEC4I r;
+	r.x = v.x * s;
+	r.y = v.y * s;
+	r.z = v.z * s;
+	r.w = v.w * s;
+	return r;
+}
+
+typedef struct _VEC2S {
+	float x, y;
+} VEC2S;
+
+typedef struct _CPLXD {
+	double re, im;
+} CPLXD;
+
+VEC2S vec2s_scale(VEC2S v, float s) {
+	v.x *= s;
+	v.y *= s;
+	return v;
+}
+
+void cplxd_store(CPLXD a, CPLXD b, CPLXD* p) {
+	p[0] = a;
+	p[1] = b;
+}
+
+CPLXD cplxd_load(const CPLXD* p) {
+	return *p;
+}
+
+/* fa0-fa6 are taken, so v needs a0/a1 */
+float vec2s_after7f(float a, float b, float c, float d, float e, float f, float g, VEC2S v) {
+	return v.x - v.y;
+}
+
+float dot_s(const float* p, const float* q, int n) {
+	int i;
+	float d = 0.0f;
+	for (i = 0; i < n; ++i) {
+		d += p[i] * q[i];
+	}
+	return d;
+}
+
+double ident_d(double x) {
+	return x;
+}
+
+/* import stub: ebreak if left unresolved, minion_bin_link/minion_bin_link_natives turn it into a jump to the library export or a native thunk */
+#define MINION_IMPORT(_ret, _name, _args) \
+	__attribute__((naked, noinline)) _ret __imp_##_name _args { __asm volatile("ebreak\n\tret"); }
+
+MINION_IMPORT(int, ext_twice, (int x))
+
+int call_ext(int x) {
+	return __imp_ext_twice(x) + 1;
+}
+
+/* fn may be a native thunk address (MINION_PC_IMPORT + idx*4) */
+int call_fn_i(int (*fn)(int), int x) {
+	return fn(x) + 1;
+}
+
 void* get_code_org() {
 	ENV_INFO info = {};
 	envcall_void(ECALL_ENVINFO, (uintptr_t)&info);
@@ -187,41 +428,201 @@ size_t e_strlen(const char* pStr) {
 }
 
 void o_str(const char* pStr) { envcall_void(ECALL_OUTSTR, (uintptr_t)pStr); }
-void o_int(int i) { envcall_void(ECALL_OUTINT, (uintptr_t)&i); }
-void o_hex(int i) { envcall_void(ECALL_OUTHEX, (uintptr_t)&i); }
+void o_int(int i) { envcall_void(ECALL_PUTINT, (uintptr_t)i); }
+void o_hex(int i) { envcall_void(ECALL_PUTHEX, (uintptr_t)i); }
 void o_ptr(void* p) { envcall_void(ECALL_OUTPTR, (uintptr_t)p); }
-void o_f32(float x) { envcall_void(ECALL_OUTF32, (uintptr_t)&x); }
+void o_f32(float x) { envcall_f(ECALL_PUTF32, x, 0.0f); }
 void o_eol() { o_str("\n"); }
 
-float e_sinf(float x) {
-	EMATH_ARGS args;
-	args.func = EMATH_SIN;
-	args.x = x;
-	envcall_void(ECALL_MATH, (uintptr_t)&args);
-	return args.res;
+float e_sinf(float x) { return envcall_f(ECALL_SINF, x, 0.0f); }
+float e_cosf(float x) { return envcall_f(ECALL_COSF, x, 0.0f); }
+float e_powf(float x, float y) { return envcall_f(ECALL_POWF, x, y); }
+
+/* legacy pointer forms, still served by the host for old binaries */
+void o_int_p(const int* p) { envcall_void(ECALL_OUTINT, (uintptr_t)p); }
+
+float e_math_p(EMATH_ARGS* pArgs) {
+	envcall_void(ECALL_MATH, (uintptr_t)pArgs);
+	return pArgs->res;
+}
+
+/* batched: one ecall per array */
+void e_sinv(float* pDst, const float* pSrc, uint32_t n) { envcall_mathv(EMATH_SIN, pDst, pSrc, 0, n); }
+void e_cosv(float* pDst, const float* pSrc, uint32_t n) { envcall_mathv(EMATH_COS, pDst, pSrc, 0, n); }
+void e_powv(float* pDst, const float* pX, const float* pY, uint32_t n) { envcall_mathv(EMATH_POW, pDst, pX, pY, n); }
+void e_expv(float* pDst, const float* pSrc, uint32_t n) { envcall_mathv(EMATH_EXP, pDst, pSrc, 0, n); }
+void e_logv(float* pDst, const float* pSrc, uint32_t n) { envcall_mathv(EMATH_LOG, pDst, pSrc, 0, n); }
+void e_sqrtv(float* pDst, const float* pSrc, uint32_t n) { envcall_mathv(EMATH_SQRT, pDst, pSrc, 0, n); }
+void e_rsqrtv(float* pDst, const float* pSrc, uint32_t n) { envcall_mathv(EMATH_RSQRT, pDst, pSrc, 0, n); }
+void e_muladdv(float* pDst, const float* pX, const float* pY, uint32_t n) { envcall_mathv(EMATH_MULADD, pDst, pX, pY, n); }
+
+int e_fopen(const char* pPath, int mode) { return (int)ecall_raw((uintptr_t)pPath, mode, 0, 0, 0, 0, ECALL_FOPEN); }
+int e_fread(int h, void* pDst, uint32_t len) { return (int)ecall_raw(h, (uintptr_t)pDst, len, 0, 0, 0, ECALL_FREAD); }
+int e_fwrite(int h, const void* pSrc, uint32_t len) { return (int)ecall_raw(h, (uintptr_t)pSrc, len, 0, 0, 0, ECALL_FWRITE); }
+int e_fclose(int h) { return (int)ecall_raw(h, 0, 0, 0, 0, 0, ECALL_FCLOSE); }
+int64_t e_fstat(const char* pPath) { return ecall_raw((uintptr_t)pPath, 0, 0, 0, 0, 0, ECALL_FSTAT); }
+void* e_fmmap(int h, uint32_t offs, uint32_t len, int mapMode) { return (void*)(uintptr_t)ecall_raw(h, offs, len, mapMode, 0, 0, ECALL_FMMAP); }
+void e_fmunmap(void* p) { ecall_raw((uintptr_t)p, 0, 0, 0, 0, 0, ECALL_FMUNMAP); }
+
+/* sums a file through a read-only map window at a time */
+uint32_t file_sum(const char* pPath) {
+	uint32_t sum = 0;
+	uint32_t offs = 0;
+	int64_t size = e_fstat(pPath);
+	int h = e_fopen(pPath, EFILE_READ);
+	if (h < 0 || size < 0) return 0;
+	while (offs < (uint64_t)size) {
+		uint32_t len = (uint64_t)size - offs < 0x10000 ? (uint32_t)((uint64_t)size - offs) : 0x10000;
+		const uint8_t* p = (const uint8_t*)e_fmmap(h, offs, len, EFILE_MAP_RO);
+		uint32_t i;
+		if (!p) break;
+		for (i = 0; i < len; ++i) {
+			sum += p[i];
+		}
+		e_fmunmap((void*)p);
+		offs += len;
+	}
+	e_fclose(h);
+	return sum;
+}
+
+/* layout must match MINION_ASYNC_DONE in minion.h */
+typedef struct _ASYNC_DONE {
+	uint32_t ticket;
+	uint32_t id;
+	int32_t res[2];
+} ASYNC_DONE;
+
+uint32_t e_async_sqrtv(float* pDst, const float* pSrc, uint32_t n) {
+	return (uint32_t)ecall_raw(ECALL_MATHV, EMATH_SQRT, (uintptr_t)pDst, (uintptr_t)pSrc, 0, n, ECALL_ASYNC);
+}
+
+uint32_t e_await(uint32_t n) { return (uint32_t)ecall_raw(n, 0, 0, 0, 0, 0, ECALL_AWAIT); }
+
+/* host computes square roots of both halves while the guest sums the input */
+float test_async(MINION_RING* pDone, float* pDst, const float* pSrc, uint32_t n) {
+	ASYNC_DONE done;
+	float sum = 0.0f;
+	uint32_t half = n / 2;
+	uint32_t nsub = 0;
+	uint32_t i;
+	nsub += e_async_sqrtv(pDst, pSrc, half) != 0;
+	nsub += e_async_sqrtv(pDst + half, pSrc + half, n - half) != 0;
+	for (i = 0; i < n; ++i) {
+		sum += pSrc[i];
+	}
+	e_await(nsub);
+	while (nsub > 0 && ring_get(pDone, &done)) {
+		--nsub;
+	}
+	return sum;
+}
+
+uint32_t hart_id() {
+	uint32_t id;
+	__asm volatile ("csrr %0, mhartid" : "=r"(id));
+	return id;
 }
 
-float e_cosf(float x) {
-	EMATH_ARGS args;
-	args.func = EMATH_COS;
-	args.x = x;
-	envcall_void(ECALL_MATH, (uintptr_t)&args);
-	return args.res;
+int e_hart_start(int hart, int (*pEntry)(void*, int), void* pArg) {
+	return (int)ecall_raw(hart, (uintptr_t)pEntry, (uintptr_t)pArg, 0, 0, 0, ECALL_HART_START);
 }
 
-float e_powf(float x, float y) {
-	EMATH_ARGS args;
-	args.func = EMATH_POW;
-	args.x = x;
-	args.y = y;
-	envcall_void(ECALL_MATH, (uintptr_t)&args);
-	return args.res;
+int e_hart_join(int hart) { return (int)ecall_raw(hart, 0, 0, 0, 0, 0, ECALL_HART_JOIN); }
+
+/* amoadd 5, then lr/sc +1: expects *p + 6 */
+int amo_test(int32_t* p) {
+	int32_t old, val, fail;
+	__asm volatile ("amoadd.w %0, %1, (%2)" : "=r"(old) : "r"(5), "r"(p) : "memory");
+	__asm volatile ("lr.w %0, (%1)" : "=r"(val) : "r"(p) : "memory");
+	__asm volatile ("sc.w %0, %1, (%2)" : "=r"(fail) : "r"(val + 1), "r"(p) : "memory");
+	return *p + fail;
+}
+
+/* p[0] += 1000 with amoadd, p[1] += 100 * (hart + 1) with lr/sc loops */
+int hart_count(int32_t* p) {
+	int32_t inc = (int32_t)hart_id() + 1;
+	int i;
+	for (i = 0; i < 1000; ++i) {
+		__asm volatile ("amoadd.w zero, %0, (%1)" : : "r"(1), "r"(p) : "memory");
+	}
+	for (i = 0; i < 100; ++i) {
+		int32_t val, fail;
+		do {
+			__asm volatile ("lr.w %0, (%1)" : "=r"(val) : "r"(p + 1) : "memory");
+			__asm volatile ("sc.w %0, %1, (%2)" : "=r"(fail) : "r"(val + inc), "r"(p + 1) : "memory");
+		} while (fail);
+	}
+	return (int)hart_id();
+}
+
+typedef struct _SORT_PART {
+	int64_t* p;
+	uint32_t n;
+} SORT_PART;
+
+static int sort_part(void* pArg, int hart) {
+	SORT_PART* pPart = (SORT_PART*)pArg;
+	sort_i64(pPart->p, pPart->n);
+	return hart;
+}
+
+static void merge_i64(int64_t* pDst, const int64_t* pA, uint32_t na, const int64_t* pB, uint32_t nb) {
+	uint32_t i = 0, j = 0, k = 0;
+	while (i < na && j < nb) {
+		pDst[k++] = pB[j] < pA[i] ? pB[j++] : pA[i++];
+	}
+	while (i < na) pDst[k++] = pA[i++];
+	while (j < nb) pDst[k++] = pB[j++];
+}
+
+/* parts are sorted on harts 1..nharts-1 and this one, then merged pairwise through pWk */
+void sort_i64_par(int64_t* p, int64_t* pWk, uint32_t n, uint32_t nharts) {
+	SORT_PART parts[8];
+	uint32_t i, w;
+	if (nharts < 1) nharts = 1;
+	if (nharts > 8) nharts = 8;
+	for (i = 0; i < nharts; ++i) {
+		uint32_t org = (uint32_t)(((uint64_t)n * i) / nharts);
+		parts[i].p = p + org;
+		parts[i].n = (uint32_t)(((uint64_t)n * (i + 1)) / nharts) - org;
+	}
+	for (i = 1; i < nharts; ++i) {
+		if (e_hart_start(i, sort_part, &parts[i]) != 0) {
+			sort_part(&parts[i], 0);
+		}
+	}
+	sort_part(&parts[0], 0);
+	for (i = 1; i < nharts; ++i) {
+		e_hart_join(i);
+	}
+	for (w = 1; w < nharts; w *= 2) {
+		for (i = 0; i + w < nharts; i += 2 * w) {
+			uint32_t iend = i + 2 * w < nharts ? i + 2 * w : nharts;
+			uint32_t na = (uint32_t)(parts[i + w].p - parts[i].p);
+			uint32_t nb = (uint32_t)(parts[iend - 1].p + parts[iend - 1].n - parts[i + w].p);
+			uint32_t k;
+			merge_i64(pWk, parts[i].p, na, parts[i + w].p, nb);
+			for (k = 0; k < na + nb; ++k) {
+				parts[i].p[k] = pWk[k];
+			}
+		}
+	}
 }
 
-void test_ecalls() {
+/* returns the number of vector math mismatches */
+int test_ecalls() {
 	const char* pTestStr = "RISC-V";
 	float testX = 1.23f;
 	float testY = 5.53f;
+	float testV[4] = { 1.0f, 4.0f, 16.0f, 64.0f };
+	float powX[4] = { 2.0f, 3.0f, 4.0f, 1.5f };
+	float powY[4] = { 2.0f, 0.5f, -1.0f, 3.0f };
+	float vres[4];
+	int nbad = 0;
+	int legacyInt = 1234;
+	EMATH_ARGS mathArgs;
+	int i;
 
 	o_str("Hello from minion...");
 	o_eol();
@@ -258,6 +659,37 @@ void test_ecalls() {
 	o_str(") = ");
 	o_f32(e_powf(testX, testY));
 	o_eol();
+
+	mathArgs.func = EMATH_SIN;
+	mathArgs.x = testX;
+	mathArgs.y = 0.0f;
+	o_str("legacy: ");
+	o_int_p(&legacyInt);
+	o_str(", sin(");
+	o_f32(testX);
+	o_str(") = ");
+	o_f32(e_math_p(&mathArgs));
+	o_eol();
+
+	e_rsqrtv(testV, testV, 4);
+	o_str("rsqrt[1, 4, 16, 64] = ");
+	for (i = 0; i < 4; ++i) {
+		o_f32(testV[i]);
+		o_str(" ");
+	}
+	o_eol();
+
+	/* the vector forms must agree with the scalar ecalls, which run the same host functions */
+	e_powv(vres, powX, powY, 4);
+	for (i = 0; i < 4; ++i) {
+		if (vres[i] != e_powf(powX[i], powY[i])) ++nbad;
+	}
+	e_sinv(vres, powX, 4);
+	for (i = 0; i < 4; ++i) {
+		if (vres[i] != e_sinf(powX[i])) ++nbad;
+	}
+	if (envcall_mathv(EMATH_MAX, vres, powX, 0, 4) != 0) ++nbad;
+	return nbad;
 }
 
 
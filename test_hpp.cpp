@@ -0,0 +1,38 @@
+/* minion: rv32g ISA simulator */
+/* SPDX-License-Identifier: MIT */
+/* SPDX-FileCopyrightText: 2023 Sergey Chaban <sergey.chaban@gmail.com> */
+
+/* minion.hpp smoke test: cc -O2 -c minion.c && c++ -std=c++14 -O2 -o test_hpp test_hpp.cpp minion.o -lm -lpthread */
+
+#include "minion.hpp"
+
+int main(int argc, char* argv[]) {
+	const char* pBinPath = argc > 1 ? argv[1] : "out/test.elf";
+	int nbad = 0;
+	minion::Program prog(pBinPath);
+	minion::Context ctx(prog);
+	minion::Function<uint32_t(uint32_t)> fib = prog.get<uint32_t(uint32_t)>("fib");
+	minion::Function<float(int, float)> mixIf = prog.get<float(int, float)>("mix_if");
+	minion::Function<int64_t(int, int, int, int, int, int, int, int64_t)> tailI64 = prog.get<int64_t(int, int, int, int, int, int, int, int64_t)>("tail_i64");
+	uint32_t f10;
+	float m;
+	int64_t t;
+
+	if (!fib.valid() || !mixIf.valid() || !tailI64.valid()) {
+		minion_sys_err("!!! hpp: missing functions\n");
+		return 1;
+	}
+	f10 = fib(ctx, 10);
+	m = mixIf(ctx, 3, 0.5f);
+	/* the 64-bit value is split between a7 and the stack */
+	t = tailI64(ctx, 0, 1, 2, 3, 4, 5, 6, 0x123456789ABCDEFLL);
+	minion_sys_msg("hpp: fib(10) = %d, mix_if(3, 0.5) = %f, tail_i64 = 0x%llX\n", f10, m, (unsigned long long)t);
+	if (f10 != 55) ++nbad;
+	if (m != 3.5f) ++nbad;
+	if (t != 0x123456789ABCDEFLL) ++nbad;
+	if ((uint32_t)minion_get_sp(ctx) != ctx.get()->codeOrg) ++nbad;
+	if (nbad) {
+		minion_sys_msg("!!! hpp: %d mismatches\n", nbad);
+	}
+	return nbad ? 1 : 0;
+}
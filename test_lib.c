@@ -0,0 +1,9 @@
+#include <stddef.h>
+#include <stdint.h>
+
+/* library module: PROJ_NAME=test_lib CODE_ORG=200000 LD_OPTS=--no-relax ./build_rv32.sh */
+/* no gp relaxation, gp belongs to the main module */
+
+int ext_twice(int x) {
+	return x * 2;
+}
@@ -9,7 +9,10 @@ static int s_dbgFregs = 0;
 static int s_execProfile = 0;
 
 static int s_perfNative = 0;
+static int s_perfBatch = 0;
 static int s_perfCount = 0;
+static int s_perfReplace = -1;
+static int s_perfHarts = 0;
 
 static int s_binMem = 0;
 const char* s_pBinPath = NULL;
@@ -20,6 +23,11 @@ static const char* s_pTestName = NULL;
 
 static const char* s_pDumpFuncName = NULL;
 
+static const char* s_pSaveV2Path = NULL;
+static const char* s_pFsRoot = "out";
+static MINION_LOG s_log = { NULL, NULL, MINION_LOG_MSG, 0 };
+static const char* s_pLibPath = "out/test_lib.elf";
+
 #include "utils.c"
 
 #include "sincos.c"
@@ -29,12 +37,18 @@ static const char* s_pDumpFuncName = NULL;
 
 #include "ecalls.h"
 
+#if defined(__SSE__) || defined(_M_X64)
+#	include <xmmintrin.h>
+#	define EMATHV_SSE
+#endif
+
 static void test_func_dump(MINION* pMi) {
 	const char* pFuncName = s_pDumpFuncName ? s_pDumpFuncName : "sin_s";
-	minion_set_pc_to_func(pMi, pFuncName);
-	if (minion_valid_pc(pMi)) {
+	MINION_FUNC_HANDLE hFn = minion_get_func(pMi, pFuncName);
+	minion_set_pc_to_func_handle(pMi, hFn);
+	if (hFn && minion_valid_pc(pMi)) {
 		uint32_t i;
-		uint32_t n = minion_get_func_instr_count(pMi, pFuncName);
+		uint32_t n = hFn->size >> 2;
 		minion_msg(pMi, "----------------------------------\n");
 		minion_msg(pMi, "func %s @ %X, %d instrs\n", pFuncName, pMi->pc, n);
 		for (i = 0; i < n; i++) {
@@ -166,6 +180,149 @@ static void test_mapped_mem(MINION* pMi) {
 	minion_mem_unmap(pMi, vptr);
 }
 
+static void test_bulk_mem(MINION* pMi) {
+	uint32_t vptrBuf;
+	uint32_t bufSize;
+	int32_t* pSpan;
+	int32_t vals[4];
+	int32_t res[4];
+	MINION_IOVEC vec[2];
+	int i, n;
+	int ifnGetDataBuf = minion_find_func(pMi, "get_data_buf");
+	int ifnGetDataBufSize = minion_find_func(pMi, "get_data_buf_size");
+	int ifnPeek32 = minion_find_func(pMi, "peek32");
+
+	minion_set_pc_to_func_idx(pMi, ifnGetDataBuf);
+	test_exec_from_pc(pMi);
+	vptrBuf = minion_get_a0(pMi);
+	minion_set_pc_to_func_idx(pMi, ifnGetDataBufSize);
+	test_exec_from_pc(pMi);
+	bufSize = minion_get_a0(pMi);
+
+	pSpan = (int32_t*)minion_span(pMi, vptrBuf, bufSize);
+	minion_msg(pMi, "span 0x%X, %d bytes -> %p\n", vptrBuf, bufSize, pSpan);
+	if (!pSpan) {
+		minion_err(pMi, "!!! span failed\n");
+		return;
+	}
+	if (minion_span(pMi, vptrBuf, pMi->binSize)) {
+		minion_err(pMi, "!!! out of range span accepted\n");
+	}
+
+	n = sizeof(vals) / sizeof(vals[0]);
+	if (bufSize < sizeof(vals)) {
+		n = bufSize / 4;
+	}
+	for (i = 0; i < n; ++i) {
+		vals[i] = (i + 1) * 11;
+	}
+	minion_write(pMi, vptrBuf, vals, n * 4);
+	for (i = 0; i < n; ++i) {
+		int peekVal;
+		minion_set_a0(pMi, vptrBuf + i*4);
+		minion_set_pc_to_func_idx(pMi, ifnPeek32);
+		test_exec_from_pc(pMi);
+		peekVal = minion_get_a0(pMi);
+		minion_msg(pMi, "<-- peek(0x%X): %d\n", vptrBuf + i*4, peekVal);
+		if (peekVal != vals[i]) {
+			minion_msg(pMi, "!!! bulk write mismatch @ %d\n", i);
+		}
+	}
+
+	memset(res, 0, sizeof(res));
+	vec[0].vptr = vptrBuf;
+	vec[0].p = &res[0];
+	vec[0].size = 4;
+	vec[1].vptr = vptrBuf + (n - 1)*4;
+	vec[1].p = &res[1];
+	vec[1].size = 4;
+	if (minion_readv(pMi, vec, 2) != 2 || res[0] != vals[0] || res[1] != vals[n - 1]) {
+		minion_msg(pMi, "!!! gather mismatch\n");
+	} else {
+		minion_msg(pMi, "gather: %d, %d\n", res[0], res[1]);
+	}
+}
+
+static uint32_t test_io_rd(MINION* pMi, MINION_IO_REGION* pIO, uint32_t offs, int size) {
+	return 0;
+}
+
+static void test_io_wr(MINION* pMi, MINION_IO_REGION* pIO, uint32_t offs, uint32_t val, int size) {
+	minion_msg(pMi, "io write overflow: +%X <- %d\n", offs, val);
+}
+
+static void test_io_fifo(MINION* pMi) {
+	uint32_t src[8];
+	uint32_t dst[8];
+	MINION_IO_REGION* pIO;
+	int i;
+	int n = sizeof(src) / sizeof(src[0]);
+	int ifn = minion_find_func(pMi, "io_double");
+	uint32_t vptr = minion_io_map_fifo(pMi, src, n, dst, n);
+	pIO = minion_io_region(pMi, vptr);
+	pIO->read_fn = test_io_rd;
+	pIO->write_fn = test_io_wr;
+	for (i = 0; i < n; ++i) {
+		src[i] = i + 1;
+		dst[i] = 0;
+	}
+	minion_msg(pMi, "io fifo @ %X\n", vptr);
+	minion_set_a0(pMi, vptr);
+	minion_set_pc_to_func_idx(pMi, ifn);
+	test_exec_from_pc(pMi);
+	minion_msg(pMi, "out: %d words\n", pIO->fifoOutPos);
+	for (i = 0; i < n; ++i) {
+		minion_msg(pMi, "%d -> %d\n", src[i], dst[i]);
+		if (dst[i] != src[i] * 2) {
+			minion_msg(pMi, "!!! io fifo mismatch @ %d\n", i);
+		}
+	}
+	minion_io_unmap(pMi, vptr);
+}
+
+static void test_ring(MINION* pMi) {
+	static uint32_t memIn[(sizeof(MINION_RING) + 16*4) / 4];
+	static uint32_t memOut[(sizeof(MINION_RING) + 16*4) / 4];
+	int32_t src[12];
+	int32_t dst[12];
+	int i, res;
+	uint32_t nput, nget;
+	int n = sizeof(src) / sizeof(src[0]);
+	int ifn = minion_find_func(pMi, "ring_double");
+	MINION_RING* pIn = minion_ring_init(memIn, sizeof(memIn), sizeof(int32_t));
+	MINION_RING* pOut = minion_ring_init(memOut, sizeof(memOut), sizeof(int32_t));
+	uint32_t vptrIn = minion_ring_map(pMi, pIn);
+	uint32_t vptrOut = minion_ring_map(pMi, pOut);
+
+	for (i = 0; i < n; ++i) {
+		src[i] = i * 3 - 7;
+	}
+	nput = minion_ring_put(pIn, src, n);
+	minion_msg(pMi, "ring in @ %X: %d queued\n", vptrIn, nput);
+
+	minion_set_a0(pMi, vptrIn);
+	minion_set_a1(pMi, vptrOut);
+	minion_set_pc_to_func_idx(pMi, ifn);
+	test_exec_from_pc(pMi);
+	res = minion_get_a0(pMi);
+
+	memset(dst, 0, sizeof(dst));
+	nget = minion_ring_get(pOut, dst, n);
+	minion_msg(pMi, "ring out @ %X: guest moved %d, %d dequeued\n", vptrOut, res, nget);
+	if (nget != nput) {
+		minion_msg(pMi, "!!! ring count mismatch\n");
+	}
+	for (i = 0; i < (int)nget; ++i) {
+		if (dst[i] != src[i] * 2) {
+			minion_msg(pMi, "!!! ring data mismatch @ %d\n", i);
+			break;
+		}
+	}
+
+	minion_mem_unmap(pMi, vptrIn);
+	minion_mem_unmap(pMi, vptrOut);
+}
+
 
 static int feq_s(float x, float y) {
 	float diff = x - y;
@@ -447,16 +604,20 @@ uint32_t fib(uint32_t x) {
 
 static void test_fib(MINION* pMi) {
 	int i;
-	int ifn = minion_find_func(pMi, "fib");
+	MINION_FUNC_HANDLE hFib = minion_get_func(pMi, "fib");
+	if (!hFib) {
+		minion_err(pMi, "!!! fib not found\n");
+		return;
+	}
 	minion_msg(pMi, "----------------------------------\n");
-	minion_msg(pMi, "fib @ func[%d]\n", ifn);
+	minion_msg(pMi, "fib @ %X, %d instrs\n", hFib->addr, hFib->size >> 2);
 
 	pMi->instrsExecuted = 0;
 
 	for (i = 0; i < 13; i++) {
 		int res;
 		int ref = fib(i);
-		minion_set_pc_to_func_idx(pMi, ifn);
+		minion_set_pc_to_func_handle(pMi, hFib);
 		minion_set_a0(pMi, i);
 		test_exec_from_pc(pMi);
 		res = minion_get_a0(pMi);
@@ -469,6 +630,436 @@ static void test_fib(MINION* pMi) {
 	minion_msg(pMi, "instrs executed: %d\n", pMi->instrsExecuted);
 }
 
+static void test_ctx_array(MINION* pMi) {
+	int i;
+	int n = 8;
+	int ifn = minion_find_func(pMi, "fib");
+	MINION* pCtxs = minion_ctx_array_alloc(&pMi->pCfg->alloc, n);
+	if (!pCtxs) return;
+	minion_msg(pMi, "%d contexts, %d bytes each, shared cfg @ %p\n", n, (int)sizeof(MINION), pMi->pCfg);
+	for (i = 0; i < n; ++i) {
+		minion_ctx_init(&pCtxs[i], pMi->pCfg);
+		minion_set_a0(&pCtxs[i], i + 5);
+		minion_set_pc_to_func_idx(&pCtxs[i], ifn);
+	}
+	for (i = 0; i < n; ++i) {
+		int res;
+		int ref = fib(i + 5);
+		test_exec_from_pc(&pCtxs[i]);
+		res = minion_get_a0(&pCtxs[i]);
+		minion_msg(pMi, "ctx[%d]: ref = %d, res = %d\n", i, ref, res);
+		if (ref != res) {
+			minion_msg(pMi, "!!! ctx result mismatch\n");
+		}
+	}
+	for (i = 0; i < n; ++i) {
+		minion_release(&pCtxs[i]);
+	}
+	minion_ctx_array_free(&pMi->pCfg->alloc, pCtxs);
+}
+
+typedef struct _TEST_ARENA {
+	uint8_t* pMem;
+	size_t size;
+	size_t used;
+	int nallocs;
+	int nfrees;
+} TEST_ARENA;
+
+static void* test_arena_alloc(void* pUser, size_t size) {
+	TEST_ARENA* pArena = (TEST_ARENA*)pUser;
+	void* p = NULL;
+	size = (size + 15) & ~(size_t)15;
+	if (pArena->used + size <= pArena->size) {
+		p = pArena->pMem + pArena->used;
+		pArena->used += size;
+		++pArena->nallocs;
+	}
+	return p;
+}
+
+static void test_arena_free(void* pUser, void* p) {
+	TEST_ARENA* pArena = (TEST_ARENA*)pUser;
+	++pArena->nfrees;
+}
+
+static void test_arena(MINION* pMi) {
+	TEST_ARENA arena;
+	MINION_BIN bin;
+	MINION_CFG cfg;
+	MINION ctx;
+	void* pStk;
+	int ifn, res;
+	memset(&arena, 0, sizeof(arena));
+	arena.size = (size_t)pMi->codeOrg + pMi->binSize + 0x10000;
+	arena.pMem = (uint8_t*)malloc(arena.size);
+	if (!arena.pMem) return;
+
+	memset(&bin, 0, sizeof(bin));
+	bin.alloc.alloc_fn = test_arena_alloc;
+	bin.alloc.free_fn = test_arena_free;
+	bin.alloc.pUser = &arena;
+	minion_bin_load(&bin, s_pBinPath);
+	minion_cfg_init(&cfg, &bin);
+	pStk = test_arena_alloc(&arena, bin.codeOrg);
+	minion_ctx_init_ext(&ctx, &cfg, pStk, bin.codeOrg);
+
+	ifn = minion_find_func(&ctx, "fib");
+	minion_set_a0(&ctx, 10);
+	minion_set_pc_to_func_idx(&ctx, ifn);
+	test_exec_from_pc(&ctx);
+	res = minion_get_a0(&ctx);
+	minion_msg(pMi, "arena: fib(10) = %d, %d allocs, 0x%X bytes used\n", res, arena.nallocs, (uint32_t)arena.used);
+	if (res != fib(10)) {
+		minion_msg(pMi, "!!! arena fib mismatch\n");
+	}
+
+	minion_release(&ctx);
+	minion_bin_free(&bin);
+	minion_msg(pMi, "arena: %d frees\n", arena.nfrees);
+	free(arena.pMem);
+}
+
+static void test_modules(MINION* pMi) {
+	int i, nunres;
+	MINION_BIN lib;
+	MINION_CFG cfg2;
+	MINION ctx2;
+	MINION* ctxs[2];
+	memset(&lib, 0, sizeof(lib));
+	minion_bin_load(&lib, s_pLibPath);
+	if (!lib.pBinMem) {
+		minion_err(pMi, "!!! can't load library module \"%s\"\n", s_pLibPath);
+		return;
+	}
+	nunres = minion_bin_link(pMi->pCfg->pBin, &lib);
+	minion_msg(pMi, "lib @ %X, %d funcs, %d unresolved imports\n", lib.codeOrg, lib.nfuncs, nunres);
+	if (nunres != 0) {
+		minion_msg(pMi, "!!! unresolved imports\n");
+	}
+	/* one copy of the library serves both instances */
+	minion_cfg_add_module(pMi->pCfg, &lib);
+	minion_cfg_init(&cfg2, pMi->pCfg->pBin);
+	minion_cfg_add_module(&cfg2, &lib);
+	minion_ctx_init(&ctx2, &cfg2);
+	ctxs[0] = pMi;
+	ctxs[1] = &ctx2;
+	for (i = 0; i < 2; ++i) {
+		MINION_FUNC_HANDLE hCall = minion_get_func(ctxs[i], "call_ext");
+		int res;
+		minion_set_a0(ctxs[i], 20 + i);
+		minion_set_pc_to_func_handle(ctxs[i], hCall);
+		test_exec_from_pc(ctxs[i]);
+		res = minion_get_a0(ctxs[i]);
+		minion_msg(pMi, "ctx[%d]: call_ext(%d) = %d\n", i, 20 + i, res);
+		if (res != (20 + i) * 2 + 1) {
+			minion_msg(pMi, "!!! cross-module call mismatch\n");
+		}
+	}
+	if (!minion_get_func(pMi, "ext_twice")) {
+		minion_msg(pMi, "!!! library export not visible\n");
+	}
+	minion_release(&ctx2);
+	if (minion_bin_unlink(pMi->pCfg->pBin, &lib) != 1 || minion_cfg_remove_module(pMi->pCfg, &lib) != 0 || minion_get_func(pMi, "ext_twice")) {
+		minion_msg(pMi, "!!! library module not unloaded\n");
+	}
+	minion_bin_free(&lib);
+}
+
+static int32_t host_triple(int32_t x) {
+	return x * 3;
+}
+
+static void host_raw_sub(MINION* pMi, const MINION_NATIVE* pNat) {
+	minion_set_a0(pMi, minion_get_a0(pMi) - *(int*)pNat->pUser);
+}
+
+static void test_natives(MINION* pMi) {
+	static int rawBias = 100;
+	uint32_t rawThunk;
+	int nunres, res;
+	minion_bind_native(pMi->pCfg, "ext_twice", "i(i)", (MINION_NATIVE_FN)host_triple);
+	rawThunk = minion_bind_native_raw(pMi->pCfg, "raw_sub", host_raw_sub, &rawBias);
+	nunres = minion_bin_link_natives(pMi->pCfg->pBin, pMi->pCfg);
+	minion_msg(pMi, "%d natives, %d unresolved imports\n", pMi->pCfg->nnatives, nunres);
+	if (nunres != 0) {
+		minion_msg(pMi, "!!! unresolved imports\n");
+	}
+
+	minion_set_a0(pMi, 7);
+	minion_set_pc_to_func(pMi, "call_ext");
+	test_exec_from_pc(pMi);
+	res = minion_get_a0(pMi);
+	minion_msg(pMi, "call_ext(7) = %d\n", res);
+	if (res != 7 * 3 + 1) {
+		minion_msg(pMi, "!!! native import mismatch\n");
+	}
+
+	minion_set_a0(pMi, (int32_t)rawThunk);
+	minion_set_a1(pMi, 150);
+	minion_set_pc_to_func(pMi, "call_fn_i");
+	test_exec_from_pc(pMi);
+	res = minion_get_a0(pMi);
+	minion_msg(pMi, "call_fn_i(%X, 150) = %d\n", rawThunk, res);
+	if (res != 150 - rawBias + 1) {
+		minion_msg(pMi, "!!! raw native mismatch\n");
+	}
+	pMi->pCfg->nnatives = 0;
+}
+
+static uint32_t host_fib(uint32_t x) {
+	return x < 2 ? x : host_fib(x - 1) + host_fib(x - 2);
+}
+
+static uint32_t host_fib_off(uint32_t x) {
+	return host_fib(x) + 1;
+}
+
+static void host_poke32(uint32_t vptr, int32_t val) {
+	(void)vptr;
+	(void)val;
+}
+
+static void test_replace(MINION* pMi) {
+	MINION_CFG* pCfg = pMi->pCfg;
+	int irep;
+	uint32_t res;
+
+	irep = minion_replace_func(pCfg, "fib", "u(u)", (MINION_NATIVE_FN)host_fib, 0);
+	pMi->instrsExecuted = 0;
+	minion_set_a0(pMi, 20);
+	minion_set_pc_to_func(pMi, "fib");
+	test_exec_from_pc(pMi);
+	res = minion_get_a0(pMi);
+	minion_msg(pMi, "native fib(20) = %d, %d instrs\n", res, pMi->instrsExecuted);
+	if (irep < 0 || res != 6765 || pMi->instrsExecuted != 1) {
+		minion_msg(pMi, "!!! replaced call mismatch\n");
+	}
+	minion_restore_funcs(pCfg);
+
+	/* a wrong native is caught by sampling and the guest result wins */
+	irep = minion_replace_func(pCfg, "fib", "u(u)", (MINION_NATIVE_FN)host_fib_off, 1);
+	minion_set_a0(pMi, 10);
+	minion_set_pc_to_func(pMi, "fib");
+	test_exec_from_pc(pMi);
+	res = minion_get_a0(pMi);
+	minion_msg(pMi, "checked fib(10) = %d, %d calls, %d checked, %d mismatches\n", res,
+	           pCfg->repls[irep].ncalls, pCfg->repls[irep].nchecked, pCfg->repls[irep].nmismatches);
+	if (res != 55 || pCfg->repls[irep].nmismatches == 0 || pCfg->repls[irep].nchecked != pCfg->repls[irep].ncalls) {
+		minion_msg(pMi, "!!! replacement check mismatch\n");
+	}
+	minion_restore_funcs(pCfg);
+
+	/* running both copies of a function with side effects would apply them twice */
+	if (minion_replace_func(pCfg, "poke32", "v(ii)", (MINION_NATIVE_FN)host_poke32, 1) >= 0) {
+		minion_msg(pMi, "!!! checked replacement of a void function\n");
+		minion_restore_funcs(pCfg);
+	}
+}
+
+static void test_hot_reload(MINION* pMi) {
+	MINION_PROG_SLOT slot;
+	MINION_PROG* pProgA = minion_prog_load(s_pBinPath, NULL);
+	MINION_PROG* pProgB = minion_prog_load(s_pBinPath, NULL);
+	MINION ctx2;
+	int res;
+	if (!pProgA || !pProgB) {
+		minion_err(pMi, "!!! can't load programs\n");
+		minion_prog_release(pProgA);
+		minion_prog_release(pProgB);
+		return;
+	}
+	minion_prog_slot_init(&slot, pProgA);
+	minion_ctx_init(&ctx2, pMi->pCfg);
+	minion_ctx_bind_slot(pMi, &slot);
+	minion_ctx_bind_slot(&ctx2, &slot);
+
+	/* ctx2 is mid-call on A when B is published */
+	minion_set_pc_to_func_handle(&ctx2, minion_get_func(&ctx2, "fib"));
+	minion_set_a0(&ctx2, 10);
+	minion_prog_slot_swap(&slot, pProgB);
+	minion_msg(pMi, "swap: A refs = %d, B refs = %d\n", pProgA->refs, pProgB->refs);
+
+	minion_ctx_bind_slot(pMi, &slot);
+	minion_set_pc_to_func_handle(pMi, minion_get_func(pMi, "fib"));
+	minion_set_a0(pMi, 12);
+	test_exec_from_pc(pMi);
+	res = minion_get_a0(pMi);
+	minion_msg(pMi, "new call on %s: fib(12) = %d\n", pMi->pBinMem == pProgB->bin.pBinMem ? "B" : "A", res);
+	if (pMi->pBinMem != pProgB->bin.pBinMem || res != fib(12)) {
+		minion_msg(pMi, "!!! new call didn't pick up B\n");
+	}
+
+	test_exec_from_pc(&ctx2);
+	res = minion_get_a0(&ctx2);
+	minion_msg(pMi, "in-flight call on %s: fib(10) = %d, A refs = %d\n", ctx2.pBinMem == pProgA->bin.pBinMem ? "A" : "B", res, pProgA->refs);
+	if (ctx2.pBinMem != pProgA->bin.pBinMem || res != fib(10) || pProgA->refs != 1) {
+		minion_msg(pMi, "!!! in-flight call lost A\n");
+	}
+	/* last user of A: freed here */
+	minion_release(&ctx2);
+	minion_ctx_unbind(pMi);
+	minion_prog_slot_reset(&slot);
+}
+
+static void test_call(MINION* pMi) {
+	MINION_VAL args[10];
+	MINION_VAL ret;
+	int32_t v[4] = { 1, -2, 3, 40000 };
+	int32_t r[4];
+	float p[5] = { 1.0f, 2.0f, 3.0f, 4.0f, 5.0f };
+	float q[5] = { 0.5f, 0.25f, -1.0f, 2.0f, 0.125f };
+	float vs[2];
+	double cd[10];
+	int i, ok;
+
+	for (i = 0; i < 10; ++i) args[i].i = i + 1;
+	ok = minion_call(pMi, minion_get_func(pMi, "sum10"), "i(iiiiiiiiii)", args, &ret);
+	minion_msg(pMi, "sum10: %d\n", ret.i);
+	if (!ok || ret.i != 55) minion_msg(pMi, "!!! sum10 mismatch\n");
+
+	args[0].l = 0x100000000LL + 0xFFFFFFFFLL;
+	args[1].l = -3;
+	ok = minion_call(pMi, minion_get_func(pMi, "add_i64"), "l(ll)", args, &ret);
+	minion_msg(pMi, "add_i64: 0x%llX\n", (unsigned long long)ret.l);
+	if (!ok || ret.l != 0x100000000LL + 0xFFFFFFFFLL - 3) minion_msg(pMi, "!!! add_i64 mismatch\n");
+
+	args[0].i = 3;
+	args[1].f = 0.5f;
+	ok = minion_call(pMi, minion_get_func(pMi, "mix_if"), "f(if)", args, &ret);
+	minion_msg(pMi, "mix_if: %f\n", ret.f);
+	if (!ok || ret.f != 3.5f) minion_msg(pMi, "!!! mix_if mismatch\n");
+
+	/* 64-bit value split between a7 and the stack */
+	for (i = 0; i < 7; ++i) args[i].i = i;
+	args[7].l = 0x123456789ABCDEFLL;
+	ok = minion_call(pMi, minion_get_func(pMi, "tail_i64"), "l(iiiiiiil)", args, &ret);
+	minion_msg(pMi, "tail_i64: 0x%llX\n", (unsigned long long)ret.l);
+	if (!ok || ret.l != 0x123456789ABCDEFLL) minion_msg(pMi, "!!! tail_i64 mismatch\n");
+
+	/* ninth float falls back to an integer register */
+	for (i = 0; i < 9; ++i) args[i].f = (float)(i + 1);
+	ok = minion_call(pMi, minion_get_func(pMi, "sum9f"), "f(fffffffff)", args, &ret);
+	minion_msg(pMi, "sum9f: %f\n", ret.f);
+	if (!ok || ret.f != 45.0f) minion_msg(pMi, "!!! sum9f mismatch\n");
+
+	/* 16-byte struct in by reference, out through sret */
+	args[0].mem.p = v;
+	args[0].mem.size = sizeof(v);
+	args[1].i = -3;
+	ret.mem.p = r;
+	ret.mem.size = sizeof(r);
+	ok = minion_call(pMi, minion_get_func(pMi, "vec4i_scale"), "s(si)", args, &ret);
+	minion_msg(pMi, "vec4i_scale: %d %d %d %d\n", r[0], r[1], r[2], r[3]);
+	if (!ok || r[0] != -3 || r[1] != 6 || r[2] != -9 || r[3] != -120000) minion_msg(pMi, "!!! vec4i_scale mismatch\n");
+
+	/* host arrays mapped just for the call */
+	args[0].mem.p = p;
+	args[0].mem.size = sizeof(p);
+	args[1].mem.p = q;
+	args[1].mem.size = sizeof(q);
+	args[2].i = 5;
+	ok = minion_call(pMi, minion_get_func(pMi, "dot_s"), "f(mmi)", args, &ret);
+	minion_msg(pMi, "dot_s: %f\n", ret.f);
+	if (!ok || ret.f != 6.625f) minion_msg(pMi, "!!! dot_s mismatch\n");
+	if (pMi->pCfg->memMap[0].vptr != 0) minion_msg(pMi, "!!! call left memory mapped\n");
+
+	/* float aggregates travel member by member in fa-regs, or in a-regs once those run out */
+	vs[0] = 2.0f;
+	vs[1] = 3.0f;
+	args[0].mem.p = vs;
+	args[0].mem.size = sizeof(vs);
+	args[1].f = 0.5f;
+	ret.mem.p = vs;
+	ret.mem.size = sizeof(vs);
+	ok = minion_call(pMi, minion_get_func(pMi, "vec2s_scale"), "F(Ff)", args, &ret);
+	minion_msg(pMi, "vec2s_scale: %f %f\n", vs[0], vs[1]);
+	if (!ok || vs[0] != 1.0f || vs[1] != 1.5f) minion_msg(pMi, "!!! vec2s_scale mismatch\n");
+
+	cd[0] = 1.0;
+	cd[1] = 2.0;
+	cd[2] = 3.0;
+	cd[3] = 4.0;
+	args[0].mem.p = &cd[0];
+	args[0].mem.size = 2 * sizeof(double);
+	args[1].mem.p = &cd[2];
+	args[1].mem.size = 2 * sizeof(double);
+	args[2].mem.p = &cd[4];
+	args[2].mem.size = 4 * sizeof(double);
+	ok = minion_call(pMi, minion_get_func(pMi, "cplxd_store"), "v(DDm)", args, &ret);
+	args[0].mem.p = &cd[6];
+	args[0].mem.size = 2 * sizeof(double);
+	ret.mem.p = &cd[8];
+	ret.mem.size = 2 * sizeof(double);
+	ok = ok && minion_call(pMi, minion_get_func(pMi, "cplxd_load"), "D(m)", args, &ret);
+	minion_msg(pMi, "cplxd_store/load: %f %f %f %f -> %f %f\n", cd[4], cd[5], cd[6], cd[7], cd[8], cd[9]);
+	if (!ok || cd[4] != 1.0 || cd[5] != 2.0 || cd[6] != 3.0 || cd[7] != 4.0 || cd[8] != 3.0 || cd[9] != 4.0) minion_msg(pMi, "!!! cplxd_store/load mismatch\n");
+
+	for (i = 0; i < 7; ++i) args[i].f = (float)i;
+	vs[0] = 5.0f;
+	vs[1] = 2.0f;
+	args[7].mem.p = vs;
+	args[7].mem.size = sizeof(vs);
+	ok = minion_call(pMi, minion_get_func(pMi, "vec2s_after7f"), "f(fffffffF)", args, &ret);
+	minion_msg(pMi, "vec2s_after7f: %f\n", ret.f);
+	if (!ok || ret.f != 3.0f) minion_msg(pMi, "!!! vec2s_after7f mismatch\n");
+
+	args[0].d = 1.0 / 3.0;
+	ok = minion_call(pMi, minion_get_func(pMi, "ident_d"), "d(d)", args, &ret);
+	minion_msg(pMi, "ident_d: %.17g\n", ret.d);
+	if (!ok || ret.d != 1.0 / 3.0) minion_msg(pMi, "!!! ident_d mismatch\n");
+	if ((uint32_t)minion_get_sp(pMi) != pMi->codeOrg) minion_msg(pMi, "!!! call moved sp\n");
+}
+
+static void test_call_batch(MINION* pMi) {
+	enum { N = 64 };
+	float x[N], y[N], r[N];
+	int32_t a[10][N];
+	int32_t ri[N];
+	int64_t l[N], rl[N];
+	const void* pIn[10];
+	uint32_t i, j, done;
+	int fails = 0;
+
+	for (i = 0; i < N; ++i) {
+		x[i] = (float)i * 0.5f;
+		y[i] = 100.0f - (float)i;
+		l[i] = ((int64_t)i << 40) | (i * 3);
+		for (j = 0; j < 10; ++j) {
+			a[j][i] = (int32_t)(i * (j + 1));
+		}
+	}
+	pIn[0] = x;
+	pIn[1] = y;
+	pMi->instrsExecuted = 0;
+	done = minion_call_batch(pMi, minion_get_func(pMi, "f_2op_add_s"), "f(ff)", pIn, r, N);
+	for (i = 0; i < N; ++i) fails += r[i] != x[i] + y[i];
+	minion_msg(pMi, "f_2op_add_s x %d: %d done, %d instrs\n", N, done, pMi->instrsExecuted);
+
+	/* two of the ten go to the stack */
+	for (j = 0; j < 10; ++j) pIn[j] = a[j];
+	done = minion_call_batch(pMi, minion_get_func(pMi, "sum10"), "i(iiiiiiiiii)", pIn, ri, N);
+	for (i = 0; i < N; ++i) fails += ri[i] != (int32_t)(i * 55);
+	minion_msg(pMi, "sum10 x %d: %d done, last = %d\n", N, done, ri[N - 1]);
+
+	for (j = 0; j < 7; ++j) pIn[j] = a[j];
+	pIn[7] = l;
+	done = minion_call_batch(pMi, minion_get_func(pMi, "tail_i64"), "l(iiiiiiil)", pIn, rl, N);
+	for (i = 0; i < N; ++i) fails += rl[i] != l[i];
+	minion_msg(pMi, "tail_i64 x %d: %d done\n", N, done);
+
+	if (fails || (uint32_t)minion_get_sp(pMi) != pMi->codeOrg) {
+		minion_msg(pMi, "!!! call_batch: %d mismatches\n", fails);
+	}
+
+	/* same stack guard as minion_call: no frame is built over the bottom of the stack */
+	minion_set_sp(pMi, 0x80);
+	if (minion_call_batch(pMi, minion_get_func(pMi, "tail_i64"), "l(iiiiiiil)", pIn, rl, 1) != 0) {
+		minion_msg(pMi, "!!! call_batch: stack overflow not caught\n");
+	}
+	minion_set_sp(pMi, pMi->codeOrg);
+}
+
 
 PERF_TEST_FN static void perf_sincos_s(MINION* pMi) {
 	int i;
@@ -481,31 +1072,61 @@ PERF_TEST_FN static void perf_sincos_s(MINION* pMi) {
 	float x = val0;
 	float sum = 0.0f;
 	double dt;
-	double t0 = time_millis();
+	double t0;
+	if (s_perfReplace >= 0) {
+		minion_replace_func(pMi->pCfg, "sin_s", "f(f)", (MINION_NATIVE_FN)sin_s, (uint32_t)s_perfReplace);
+		minion_replace_func(pMi->pCfg, "cos_s", "f(f)", (MINION_NATIVE_FN)cos_s, (uint32_t)s_perfReplace);
+	}
+	t0 = time_millis();
 	pMi->instrsExecuted = 0;
-	for (i = 0; i <= n; ++i) {
-		float s;
-		float c;
-		if (s_perfNative) {
-			s = sin_s(x);
-			c = cos_s(x);
-		} else {
-			minion_set_fa0_s(pMi, x);
-			minion_set_pc_to_func_idx(pMi, ifnSinS);
-			test_exec_from_pc(pMi);
-			s = minion_get_fa0_s(pMi);
-			minion_set_fa0_s(pMi, x);
-			minion_set_pc_to_func_idx(pMi, ifnCosS);
-			test_exec_from_pc(pMi);
-			c = minion_get_fa0_s(pMi);
+	if (s_perfBatch && !s_perfNative) {
+		float* pX = (float*)malloc((n + 1) * sizeof(float) * 3);
+		if (pX) {
+			float* pS = pX + n + 1;
+			float* pC = pS + n + 1;
+			const void* pIn[1];
+			for (i = 0; i <= n; ++i) {
+				pX[i] = x;
+				x += add;
+			}
+			pIn[0] = pX;
+			minion_call_batch(pMi, minion_get_func(pMi, "sin_s"), "f(f)", pIn, pS, n + 1);
+			minion_call_batch(pMi, minion_get_func(pMi, "cos_s"), "f(f)", pIn, pC, n + 1);
+			for (i = 0; i <= n; ++i) {
+				sum += pS[i]*pS[i] + pC[i]*pC[i];
+			}
+			free(pX);
+		}
+	} else {
+		for (i = 0; i <= n; ++i) {
+			float s;
+			float c;
+			if (s_perfNative) {
+				s = sin_s(x);
+				c = cos_s(x);
+			} else {
+				minion_set_fa0_s(pMi, x);
+				minion_set_pc_to_func_idx(pMi, ifnSinS);
+				test_exec_from_pc(pMi);
+				s = minion_get_fa0_s(pMi);
+				minion_set_fa0_s(pMi, x);
+				minion_set_pc_to_func_idx(pMi, ifnCosS);
+				test_exec_from_pc(pMi);
+				c = minion_get_fa0_s(pMi);
+			}
+			sum += s*s + c*c;
+			x += add;
 		}
-		sum += s*s + c*c;
-		x += add;
 	}
 	dt = time_millis() - t0;
-	minion_msg(pMi, "%s sum = %f\n", s_perfNative ? "native" : "minion", sum);
+	minion_msg(pMi, "%s sum = %f\n", s_perfNative ? "native" : s_perfBatch ? "minion batch" : "minion", sum);
 	minion_msg(pMi, "instrs executed: %d\n", pMi->instrsExecuted);
 	minion_msg(pMi, "dt: %.2f millis (%.3f sec)\n", dt, dt * 1e-3);
+	for (i = 0; i < pMi->pCfg->nrepls; ++i) {
+		MINION_REPLACED* pRep = &pMi->pCfg->repls[i];
+		minion_msg(pMi, "%s: %d checked, %d mismatches\n", pRep->nat.pName, pRep->nchecked, pRep->nmismatches);
+	}
+	minion_restore_funcs(pMi->pCfg);
 }
 
 PERF_TEST_FN static void perf_mtxinv_s(MINION* pMi) {
@@ -597,6 +1218,30 @@ PERF_TEST_FN static void perf_sort_i64(MINION* pMi) {
 			sort_i64(pWk, N);
 			acc += pWk[0] + pWk[1];
 		}
+	} else if (s_perfHarts > 1) {
+		MINION_HARTS harts;
+		int64_t* pMrg = (int64_t*)malloc(memSize);
+		uint32_t vptrMrg = minion_mem_map(pMi, pMrg, memSize);
+		int ifn = minion_find_func(pMi, "sort_i64_par");
+		minion_harts_register(pMi->pCfg, ECALL_HART_START);
+		if (minion_harts_init(&harts, pMi, s_perfHarts, 0) == 0) {
+			for (i = 0; i < cnt; ++i) {
+				memcpy(pWk, pVals, memSize);
+				minion_set_a0(pMi, vptrWk);
+				minion_set_a1(pMi, vptrMrg);
+				minion_set_a2(pMi, N);
+				minion_set_a3(pMi, s_perfHarts);
+				minion_set_pc_to_func_idx(pMi, ifn);
+				test_exec_from_pc(pMi);
+				acc += pWk[0] + pWk[1];
+			}
+			for (i = 1; i < s_perfHarts; ++i) {
+				pMi->instrsExecuted += harts.pCtxs[i].instrsExecuted;
+			}
+			minion_harts_release(&harts);
+		}
+		minion_mem_unmap(pMi, vptrMrg);
+		free(pMrg);
 	} else {
 		int ifn = minion_find_func(pMi, "sort_i64");
 		for (i = 0; i < cnt; ++i) {
@@ -634,70 +1279,809 @@ static void std_emath(MINION* pMi, EMATH_ARGS* pArgs) {
 		case EMATH_POW:
 			pArgs->res = powf(pArgs->x, pArgs->y);
 			break;
+		case EMATH_EXP:
+			pArgs->res = expf(pArgs->x);
+			break;
+		case EMATH_LOG:
+			pArgs->res = logf(pArgs->x);
+			break;
+		case EMATH_SQRT:
+			pArgs->res = sqrtf(pArgs->x);
+			break;
+		case EMATH_RSQRT:
+			pArgs->res = 1.0f / sqrtf(pArgs->x);
+			break;
+		case EMATH_MULADD:
+			pArgs->res = pArgs->x * pArgs->y + pArgs->res;
+			break;
 	}
 }
 
-static void std_ecalls(MINION* pMi) {
-	int fn = minion_get_a7(pMi);
-	uint32_t arg = minion_get_a0(pMi);
-	void* pNative;
-	switch (fn) {
-		case ECALL_OUTSTR:
-			pNative = minion_resolve_vptr(pMi, arg);
-			if (pNative) {
-				minion_msg(pMi, EOUT_F0 "%s" EOUT_F1, pNative);
-			}
+/* 4 lanes at a time, returns how many elements are done, the scalar loops take the rest */
+static uint32_t std_emathv_x4(int32_t func, float* pDst, const float* pX, const float* pY, uint32_t n) {
+	uint32_t i = 0;
+#ifdef EMATHV_SSE
+	const __m128 one = _mm_set1_ps(1.0f);
+	switch (func) {
+		case EMATH_SQRT:
+			for (; i + 4 <= n; i += 4) _mm_storeu_ps(pDst + i, _mm_sqrt_ps(_mm_loadu_ps(pX + i)));
 			break;
-		case ECALL_OUTINT:
-			pNative = minion_resolve_vptr(pMi, arg);
-			if (pNative) {
-				minion_msg(pMi, EOUT_F0 "%d" EOUT_F1, *(int32_t*)pNative);
-			}
+		case EMATH_RSQRT:
+			for (; i + 4 <= n; i += 4) _mm_storeu_ps(pDst + i, _mm_div_ps(one, _mm_sqrt_ps(_mm_loadu_ps(pX + i))));
 			break;
-		case ECALL_OUTHEX:
-			pNative = minion_resolve_vptr(pMi, arg);
-			if (pNative) {
-				minion_msg(pMi, EOUT_F0 "0x%X" EOUT_F1, *(int32_t*)pNative);
-			}
+		case EMATH_MULADD:
+			for (; i + 4 <= n; i += 4) _mm_storeu_ps(pDst + i, _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(pX + i), _mm_loadu_ps(pY + i)), _mm_loadu_ps(pDst + i)));
 			break;
-		case ECALL_OUTPTR:
-			minion_msg(pMi, EOUT_F0 "0x%x" EOUT_F1, (uint32_t)arg);
+	}
+#endif
+	return i;
+}
+
+/* one switch per batch, sqrt/rsqrt/muladd go through the SSE kernels, the rest are libm loops */
+/* 0 for an unknown func */
+static int std_emathv(int32_t func, float* pDst, const float* pX, const float* pY, uint32_t n) {
+	uint32_t i0 = std_emathv_x4(func, pDst, pX, pY, n);
+	uint32_t i;
+	switch (func) {
+		case EMATH_SIN:
+			for (i = i0; i < n; ++i) pDst[i] = sinf(pX[i]);
 			break;
-		case ECALL_OUTF32:
-			pNative = minion_resolve_vptr(pMi, arg);
-			if (pNative) {
-				minion_msg(pMi, EOUT_F0 "%f" EOUT_F1, *(float*)pNative);
-			}
+		case EMATH_COS:
+			for (i = i0; i < n; ++i) pDst[i] = cosf(pX[i]);
 			break;
-		case ECALL_ENVINFO:
-			pNative = minion_resolve_vptr(pMi, arg);
-			if (pNative) {
-				ENV_INFO* pEnvInfo = (ENV_INFO*)pNative;
-				pEnvInfo->codeOrg = pMi->codeOrg;
-			}
+		case EMATH_POW:
+			for (i = i0; i < n; ++i) pDst[i] = powf(pX[i], pY[i]);
 			break;
-		case ECALL_STRLEN:
-			pNative = minion_resolve_vptr(pMi, arg);
-			if (pNative) {
-				minion_set_a0(pMi, (uint32_t)strlen((const char*)pNative));
-			}
+		case EMATH_EXP:
+			for (i = i0; i < n; ++i) pDst[i] = expf(pX[i]);
 			break;
-		case ECALL_MATH:
-			pNative = minion_resolve_vptr(pMi, arg);
-			if (pNative) {
-				std_emath(pMi, (EMATH_ARGS*)pNative);
-			}
+		case EMATH_LOG:
+			for (i = i0; i < n; ++i) pDst[i] = logf(pX[i]);
+			break;
+		case EMATH_SQRT:
+			for (i = i0; i < n; ++i) pDst[i] = sqrtf(pX[i]);
+			break;
+		case EMATH_RSQRT:
+			for (i = i0; i < n; ++i) pDst[i] = 1.0f / sqrtf(pX[i]);
 			break;
+		case EMATH_MULADD:
+			for (i = i0; i < n; ++i) pDst[i] = pX[i] * pY[i] + pDst[i];
+			break;
+		default:
+			return 0;
+	}
+	return 1;
+}
+
+/* legacy ECALL_* ids pass a pointer in a0 */
+static void ecall_outstr(MINION* pMi, const MINION_NATIVE* pNat) {
+	void* pNative = minion_resolve_vptr(pMi, minion_get_a0(pMi));
+	if (pNative) {
+		minion_out_write(pMi, (const char*)pNative, (uint32_t)strlen((const char*)pNative));
+	}
+}
+
+static void ecall_outint(MINION* pMi, const MINION_NATIVE* pNat) {
+	void* pNative = minion_resolve_vptr(pMi, minion_get_a0(pMi));
+	if (pNative) {
+		minion_out_printf(pMi, "%d", *(int32_t*)pNative);
+	}
+}
+
+static void ecall_outhex(MINION* pMi, const MINION_NATIVE* pNat) {
+	void* pNative = minion_resolve_vptr(pMi, minion_get_a0(pMi));
+	if (pNative) {
+		minion_out_printf(pMi, "0x%X", *(int32_t*)pNative);
+	}
+}
+
+static void ecall_outptr(MINION* pMi, const MINION_NATIVE* pNat) {
+	minion_out_printf(pMi, "0x%x", (uint32_t)minion_get_a0(pMi));
+}
+
+static void ecall_outf32(MINION* pMi, const MINION_NATIVE* pNat) {
+	void* pNative = minion_resolve_vptr(pMi, minion_get_a0(pMi));
+	if (pNative) {
+		minion_out_printf(pMi, "%f", *(float*)pNative);
+	}
+}
+
+static void ecall_envinfo(MINION* pMi, const MINION_NATIVE* pNat) {
+	ENV_INFO* pEnvInfo = (ENV_INFO*)minion_resolve_vptr(pMi, minion_get_a0(pMi));
+	if (pEnvInfo) {
+		pEnvInfo->codeOrg = pMi->codeOrg;
+	}
+}
+
+static void ecall_strlen(MINION* pMi, const MINION_NATIVE* pNat) {
+	void* pNative = minion_resolve_vptr(pMi, minion_get_a0(pMi));
+	if (pNative) {
+		minion_set_a0(pMi, (uint32_t)strlen((const char*)pNative));
+	}
+}
+
+static void ecall_math(MINION* pMi, const MINION_NATIVE* pNat) {
+	void* pNative = minion_resolve_vptr(pMi, minion_get_a0(pMi));
+	if (pNative) {
+		std_emath(pMi, (EMATH_ARGS*)pNative);
+	}
+}
+
+/* register-based ids */
+static void ecall_putint(MINION* pMi, const MINION_NATIVE* pNat) {
+	minion_out_printf(pMi, "%d", minion_get_a0(pMi));
+}
+
+static void ecall_puthex(MINION* pMi, const MINION_NATIVE* pNat) {
+	minion_out_printf(pMi, "0x%X", minion_get_a0(pMi));
+}
+
+static void ecall_putf32(MINION* pMi, const MINION_NATIVE* pNat) {
+	minion_out_printf(pMi, "%f", minion_get_fa0_s(pMi));
+}
+
+/* each array is resolved once per batch, a0 returns the count processed */
+static void ecall_mathv(MINION* pMi, const MINION_NATIVE* pNat) {
+	int32_t func = minion_get_a0(pMi);
+	uint32_t n = (uint32_t)minion_get_a4(pMi);
+	uint32_t size = n * (uint32_t)sizeof(float);
+	float* pDst;
+	const float* pX;
+	const float* pY = NULL;
+	if (n == 0 || size / sizeof(float) != n) {
+		minion_set_a0(pMi, 0);
+		return;
+	}
+	pDst = (float*)minion_span_w(pMi, (uint32_t)minion_get_a1(pMi), size);
+	pX = (const float*)minion_span(pMi, (uint32_t)minion_get_a2(pMi), size);
+	if (func == EMATH_POW || func == EMATH_MULADD) {
+		pY = (const float*)minion_span(pMi, (uint32_t)minion_get_a3(pMi), size);
 	}
+	if (!pDst || !pX || ((func == EMATH_POW || func == EMATH_MULADD) && !pY)) {
+		minion_err(pMi, "mathv: bad span\n");
+		minion_set_a0(pMi, 0);
+		return;
+	}
+	if (!std_emathv(func, pDst, pX, pY, n)) {
+		minion_err(pMi, "mathv: unknown func %d\n", func);
+		minion_set_a0(pMi, 0);
+		return;
+	}
+	minion_set_a0(pMi, (int32_t)n);
+}
+
+static void ecall_cmdflush(MINION* pMi, const MINION_NATIVE* pNat) {
+	minion_cmd_flush(pMi);
+}
+
+static const struct {
+	uint32_t id;
+	MINION_NATIVE_RAW_FN fn;
+} s_stdEcalls[] = {
+	{ ECALL_OUTSTR, ecall_outstr },
+	{ ECALL_OUTINT, ecall_outint },
+	{ ECALL_OUTHEX, ecall_outhex },
+	{ ECALL_OUTPTR, ecall_outptr },
+	{ ECALL_OUTF32, ecall_outf32 },
+	{ ECALL_ENVINFO, ecall_envinfo },
+	{ ECALL_STRLEN, ecall_strlen },
+	{ ECALL_MATH, ecall_math },
+	{ ECALL_PUTINT, ecall_putint },
+	{ ECALL_PUTHEX, ecall_puthex },
+	{ ECALL_PUTF32, ecall_putf32 },
+	{ ECALL_MATHV, ecall_mathv },
+	{ ECALL_CMDFLUSH, ecall_cmdflush }
+};
+
+/* guest output is colored once per flushed chunk */
+static void std_out_sink(void* pUser, const char* pData, uint32_t len) {
+	minion_sys_msg(EOUT_F0 "%.*s" EOUT_F1, (int)len, pData);
+}
+
+static void std_out_attach(MINION* pMi) {
+	static char outMem[4096];
+	static MINION_OUTBUF out;
+	minion_out_init(&out, outMem, sizeof(outMem), std_out_sink, NULL);
+	minion_out_attach(pMi, &out);
+}
+
+static void std_ecalls_register(MINION_CFG* pCfg) {
+	size_t i;
+	for (i = 0; i < sizeof(s_stdEcalls) / sizeof(s_stdEcalls[0]); ++i) {
+		minion_register_ecall_raw(pCfg, s_stdEcalls[i].id, s_stdEcalls[i].fn, NULL);
+	}
+	minion_register_ecall(pCfg, ECALL_SINF, (MINION_NATIVE_FN)sinf, "f(f)");
+	minion_register_ecall(pCfg, ECALL_COSF, (MINION_NATIVE_FN)cosf, "f(f)");
+	minion_register_ecall(pCfg, ECALL_POWF, (MINION_NATIVE_FN)powf, "f(ff)");
+	minion_set_ecall_flags(pCfg, ECALL_MATHV, MINION_NATIVE_FLG_ASYNC_SAFE);
+	minion_set_ecall_flags(pCfg, ECALL_PUTF32, MINION_NATIVE_FLG_FLOAT_ARGS);
 }
 
 static void test_ecalls(MINION* pMi) {
+	static const int32_t vecFuncs[] = { EMATH_SQRT, EMATH_RSQRT, EMATH_MULADD };
+	float x[37], y[37], dst[37];
 	int ifn = minion_find_func(pMi, "test_ecalls");
-	pMi->ecall_fn = std_ecalls;
+	uint32_t id;
+	int32_t nbad;
+	int i, k;
+	/* the vector kernels and their scalar tails must agree with the one-at-a-time path, 37 leaves a tail */
+	for (k = 0; k < (int)(sizeof(vecFuncs) / sizeof(vecFuncs[0])); ++k) {
+		for (i = 0; i < 37; ++i) {
+			x[i] = (float)(i + 1);
+			y[i] = 0.5f * (float)i;
+			dst[i] = 3.0f;
+		}
+		std_emathv(vecFuncs[k], dst, x, y, 37);
+		for (i = 0; i < 37; ++i) {
+			EMATH_ARGS args;
+			args.func = vecFuncs[k];
+			args.x = x[i];
+			args.y = y[i];
+			args.res = 3.0f;
+			std_emath(pMi, &args);
+			if (dst[i] != args.res) {
+				minion_msg(pMi, "!!! mathv %d [%d]: %f != %f\n", vecFuncs[k], i, dst[i], args.res);
+				break;
+			}
+		}
+	}
+	std_ecalls_register(pMi->pCfg);
+	std_out_attach(pMi);
 	minion_set_pc_to_func_idx(pMi, ifn);
 	test_exec_from_pc(pMi);
+	nbad = minion_get_a0(pMi);
+	if (nbad != 0) {
+		minion_msg(pMi, "!!! test_ecalls: %d vector math mismatches\n", nbad);
+	}
+	for (id = 0; id < ECALL_MAX; ++id) {
+		if (minion_ecall_count(pMi, 1, id)) {
+			minion_msg(pMi, "ecall[%d]: %d\n", id, minion_ecall_count(pMi, 1, id));
+		}
+	}
+	if (!minion_ecall_count(pMi, 1, ECALL_OUTINT) || !minion_ecall_count(pMi, 1, ECALL_MATH)) {
+		minion_msg(pMi, "!!! legacy ecalls not exercised\n");
+	}
+	minion_out_attach(pMi, NULL);
+}
+
+static void test_cmds(MINION* pMi) {
+	static uint32_t cmdMem[(sizeof(MINION_RING) + 64*sizeof(MINION_CMD)) / 4];
+	MINION_RING* pCmds = minion_ring_init(cmdMem, sizeof(cmdMem), sizeof(MINION_CMD));
+	MINION_CMD cmds[4];
+	uint32_t vptr;
+	uint32_t nput, ntraps, nrun;
+	std_ecalls_register(pMi->pCfg);
+	std_out_attach(pMi);
+	vptr = minion_cmd_ring_attach(pMi, pCmds);
+	minion_set_a0(pMi, vptr);
+	minion_set_pc_to_func(pMi, "test_cmds");
+	test_exec_from_pc(pMi);
+	nput = minion_ecall_count(pMi, 1, ECALL_PUTINT);
+	ntraps = minion_ecall_count(pMi, 1, ECALL_CMDFLUSH);
+	minion_msg(pMi, "\ncmd ring @ %X: %d ints queued, %d flush traps, %d left\n", vptr, nput, ntraps, minion_ring_count(pCmds));
+	if (nput != 100 || minion_ring_count(pCmds) != 0) {
+		minion_msg(pMi, "!!! command ring mismatch\n");
+	}
+	/* only the int command runs, and the argument registers survive the drain */
+	memset(cmds, 0, sizeof(cmds));
+	cmds[0].id = ECALL_PUTF32;
+	cmds[1].id = MINION_MAX_ECALLS + 1;
+	cmds[2].id = ECALL_SINF;
+	cmds[3].id = ECALL_PUTINT;
+	cmds[3].args[0] = 7;
+	minion_ring_put(pCmds, cmds, 4);
+	pMi->regs[13] = 0x1234;
+	pMi->fregs[10] = 1.5;
+	nrun = minion_cmd_flush(pMi);
+	if (nrun != 1 || pMi->regs[13] != 0x1234 || pMi->fregs[10] != 1.5) {
+		minion_msg(pMi, "!!! command flush ran %d, a3 = %X, fa0 = %f\n", nrun, pMi->regs[13], pMi->fregs[10]);
+	}
+	minion_cmd_ring_detach(pMi, vptr);
+	minion_out_attach(pMi, NULL);
 }
 
+/* drains an output ring into pDst, returns the byte count */
+static uint32_t out_ring_drain(MINION_RING* pRing, char* pDst) {
+	MINION_OUT_CHUNK chunk;
+	uint32_t n = 0;
+	while (minion_ring_get(pRing, &chunk, 1)) {
+		memcpy(pDst + n, chunk.data, chunk.len);
+		n += chunk.len;
+	}
+	return n;
+}
+
+static void test_outbuf(MINION* pMi) {
+	static uint32_t ringMem[(sizeof(MINION_RING) + 8*sizeof(MINION_OUT_CHUNK)) / 4];
+	static const char text[] = "0123456789abcdefghijklmnopqrstuvwxyz";
+	MINION_RING* pRing = minion_ring_init(ringMem, sizeof(ringMem), sizeof(MINION_OUT_CHUNK));
+	MINION_OUTBUF out;
+	char outMem[16];
+	char got[128];
+	uint32_t n[3];
+	minion_out_init(&out, outMem, sizeof(outMem), minion_out_ring_sink, pRing);
+	minion_out_attach(pMi, &out);
+	/* flushSize: the second write crosses it */
+	out.flushSize = 8;
+	minion_out_write(pMi, text, 5);
+	n[0] = minion_ring_count(pRing);
+	minion_out_write(pMi, text + 5, 4);
+	n[1] = out_ring_drain(pRing, got);
+	if (n[0] != 0 || n[1] != 9 || out.used != 0 || memcmp(got, text, 9) != 0) {
+		minion_msg(pMi, "!!! outbuf: flushSize path %d, %d\n", n[0], n[1]);
+	}
+	/* overflow: pending output goes out before the write that doesn't fit */
+	out.flushSize = 0;
+	minion_out_write(pMi, text, 10);
+	minion_out_write(pMi, text + 10, 10);
+	n[0] = out_ring_drain(pRing, got);
+	if (n[0] != 10 || out.used != 10 || memcmp(got, text, 10) != 0) {
+		minion_msg(pMi, "!!! outbuf: overflow path %d, %d pending\n", n[0], out.used);
+	}
+	/* direct: larger than the buffer, goes to the sink after what is pending */
+	minion_out_write(pMi, text, 30);
+	n[0] = out_ring_drain(pRing, got);
+	if (n[0] != 40 || out.used != 0 || memcmp(got, text + 10, 10) != 0 || memcmp(got + 10, text, 30) != 0) {
+		minion_msg(pMi, "!!! outbuf: direct path %d, %d pending\n", n[0], out.used);
+	}
+	minion_out_write(pMi, text, 3);
+	minion_out_attach(pMi, NULL);
+	n[2] = out_ring_drain(pRing, got);
+	minion_msg(pMi, "outbuf: %d bytes on detach\n", n[2]);
+	if (n[2] != 3) {
+		minion_msg(pMi, "!!! outbuf: detach didn't flush\n");
+	}
+}
+
+static int32_t guest_ecall(MINION* pMi, uint32_t id, uint32_t a0, uint32_t a1, uint32_t a2, uint32_t a3) {
+	MINION_VAL args[7];
+	MINION_VAL ret;
+	memset(args, 0, sizeof(args));
+	args[0].i = (int32_t)a0;
+	args[1].i = (int32_t)a1;
+	args[2].i = (int32_t)a2;
+	args[3].i = (int32_t)a3;
+	args[6].i = (int32_t)id;
+	ret.l = -1;
+	minion_call(pMi, minion_get_func(pMi, "ecall_raw"), "l(iiiiiii)", args, &ret);
+	return (int32_t)ret.l;
+}
+
+static void test_files(MINION* pMi) {
+	static uint8_t data[0x6000];
+	static char name[] = "minion_fs_test.bin";
+	static char escName[] = "../minion_fs_test.bin";
+	static char absName[] = "/etc/hosts";
+	static uint32_t doneMem[(sizeof(MINION_RING) + 4*sizeof(MINION_ASYNC_DONE)) / 4];
+	static MINION_ASYNC async;
+	MINION_RING* pDone;
+	MINION_ASYNC_DONE done;
+	MINION_FS fs;
+	MINION_VAL args[2];
+	MINION_VAL ret;
+	uint32_t vName, vEsc, vAbs, vData, vMap;
+	uint32_t offs = 0x1234;
+	uint32_t word;
+	int32_t h, res;
+	int i;
+	for (i = 0; i < (int)sizeof(data); ++i) {
+		data[i] = (uint8_t)(i * 7 + (i >> 8));
+	}
+	if (minion_fs_init(&fs, s_pFsRoot) != 0) return;
+	minion_fs_register(pMi->pCfg, &fs, ECALL_FOPEN);
+	vName = minion_mem_map(pMi, name, sizeof(name));
+	vEsc = minion_mem_map(pMi, escName, sizeof(escName));
+	vAbs = minion_mem_map(pMi, absName, sizeof(absName));
+	vData = minion_mem_map(pMi, data, sizeof(data));
+
+	h = guest_ecall(pMi, ECALL_FOPEN, vName, EFILE_WRITE, 0, 0);
+	res = guest_ecall(pMi, ECALL_FWRITE, h, vData, sizeof(data), 0);
+	guest_ecall(pMi, ECALL_FCLOSE, h, 0, 0, 0);
+	minion_msg(pMi, "fs: wrote %d bytes to %s/%s\n", res, fs.root, name);
+	if (h < 0 || res != sizeof(data)) minion_msg(pMi, "!!! fs write failed\n");
+	res = guest_ecall(pMi, ECALL_FSTAT, vName, 0, 0, 0);
+	if (res != sizeof(data)) minion_msg(pMi, "!!! fs stat mismatch: %d\n", res);
+
+	if (guest_ecall(pMi, ECALL_FOPEN, vEsc, EFILE_READ, 0, 0) >= 0 || guest_ecall(pMi, ECALL_FOPEN, vAbs, EFILE_READ, 0, 0) >= 0) {
+		minion_msg(pMi, "!!! fs sandbox escape\n");
+	}
+#if !defined(_WIN32)
+	{
+		/* a dangling link inside the root must not create a file outside it */
+		static char linkName[] = "minion_fs_link.bin";
+		char linkPath[sizeof(fs.root) + sizeof(linkName)];
+		uint32_t vLink = minion_mem_map(pMi, linkName, sizeof(linkName));
+		snprintf(linkPath, sizeof(linkPath), "%s/%s", fs.root, linkName);
+		unlink(linkPath);
+		if (symlink("../minion_fs_escape.bin", linkPath) == 0) {
+			h = guest_ecall(pMi, ECALL_FOPEN, vLink, EFILE_WRITE, 0, 0);
+			if (h >= 0) {
+				minion_msg(pMi, "!!! fs symlink escape\n");
+				guest_ecall(pMi, ECALL_FCLOSE, h, 0, 0, 0);
+			}
+			unlink(linkPath);
+		}
+		minion_mem_unmap(pMi, vLink);
+	}
+#endif
+
+	h = guest_ecall(pMi, ECALL_FOPEN, vName, EFILE_READ, 0, 0);
+	vMap = (uint32_t)guest_ecall(pMi, ECALL_FMMAP, h, offs, 0x10000, EFILE_MAP_RO);
+	minion_msg(pMi, "fs: mmap @ %X\n", vMap);
+	if (!vMap || !minion_read(pMi, vMap + 3, &word, 4) || memcmp(&word, &data[offs + 3], 4) != 0) {
+		minion_msg(pMi, "!!! fs mmap contents mismatch\n");
+	}
+	if (minion_span(pMi, vMap, sizeof(data) - offs) == NULL || minion_span(pMi, vMap, sizeof(data) - offs + 1) != NULL) {
+		minion_msg(pMi, "!!! fs mmap window size mismatch\n");
+	}
+	args[0].i = (int32_t)vMap;
+	args[1].i = 0;
+	if (minion_call(pMi, minion_get_func(pMi, "poke32"), "v(ii)", args, &ret)) {
+		minion_msg(pMi, "!!! fs store to RO map went through\n");
+	}
+	if (minion_write(pMi, vMap, &word, 4) || guest_ecall(pMi, ECALL_FREAD, h, vMap, 4, 0) >= 0) {
+		minion_msg(pMi, "!!! fs host store to RO map went through\n");
+	}
+	guest_ecall(pMi, ECALL_FMUNMAP, vMap, 0, 0, 0);
+
+	vMap = (uint32_t)guest_ecall(pMi, ECALL_FMMAP, h, 0, 16, EFILE_MAP_COW);
+	args[0].i = (int32_t)vMap;
+	args[1].i = 0x55AA55AA;
+	if (!vMap || !minion_call(pMi, minion_get_func(pMi, "poke32"), "v(ii)", args, &ret)) {
+		minion_msg(pMi, "!!! fs store to COW map failed\n");
+	}
+	guest_ecall(pMi, ECALL_FMUNMAP, vMap, 0, 0, 0);
+	memset(data, 0, 16);
+	res = guest_ecall(pMi, ECALL_FREAD, h, vData, 16, 0);
+	if (res != 16 || data[5] != 5 * 7) {
+		minion_msg(pMi, "!!! fs COW map leaked into the file\n");
+	}
+	guest_ecall(pMi, ECALL_FCLOSE, h, 0, 0, 0);
+
+	/* reads are async-safe: run one on a worker and pick it up from the completion ring */
+	minion_async_register(pMi->pCfg, ECALL_ASYNC);
+	pDone = minion_ring_init(doneMem, sizeof(doneMem), sizeof(MINION_ASYNC_DONE));
+	if (minion_async_init(&async, pDone, 1) == 0) {
+		minion_async_attach(pMi, &async);
+		h = guest_ecall(pMi, ECALL_FOPEN, vName, EFILE_READ, 0, 0);
+		memset(data, 0, 64);
+		res = guest_ecall(pMi, ECALL_ASYNC, ECALL_FREAD, h, vData, 64);
+		guest_ecall(pMi, ECALL_AWAIT, 1, 0, 0, 0);
+		if (res == 0 || !minion_ring_get(pDone, &done, 1) || done.ticket != (uint32_t)res || done.res[0] != 64 || data[63] != (uint8_t)(63 * 7)) {
+			minion_msg(pMi, "!!! fs async read failed\n");
+		}
+		guest_ecall(pMi, ECALL_FCLOSE, h, 0, 0, 0);
+		minion_async_detach(pMi);
+		minion_async_release(&async);
+	}
+
+	minion_mem_unmap(pMi, vData);
+	minion_mem_unmap(pMi, vAbs);
+	minion_mem_unmap(pMi, vEsc);
+	minion_mem_unmap(pMi, vName);
+	minion_fs_release(pMi, &fs);
+}
+
+static void test_async(MINION* pMi) {
+	static uint32_t doneMem[(sizeof(MINION_RING) + 16*sizeof(MINION_ASYNC_DONE)) / 4];
+	static float src[4000];
+	static float dst[4000];
+	static MINION_ASYNC async;
+	MINION_RING* pDone = minion_ring_init(doneMem, sizeof(doneMem), sizeof(MINION_ASYNC_DONE));
+	MINION_ASYNC_DONE done;
+	uint32_t vSrc, vDst, vRing;
+	uint32_t tickets[4];
+	uint32_t chunk = 1000;
+	int32_t n;
+	int i, nfull, ndone;
+	for (i = 0; i < 4000; ++i) {
+		src[i] = (float)(i * i);
+	}
+	std_ecalls_register(pMi->pCfg);
+	minion_async_register(pMi->pCfg, ECALL_ASYNC);
+	if (minion_async_init(&async, pDone, 4) != 0) return;
+	vRing = minion_async_attach(pMi, &async);
+	vSrc = minion_mem_map(pMi, src, sizeof(src));
+	vDst = minion_mem_map(pMi, dst, sizeof(dst));
+	minion_msg(pMi, "async: completion ring @ %X\n", vRing);
+	for (i = 0; i < 4; ++i) {
+		MINION_VAL args[7];
+		MINION_VAL ret;
+		args[0].i = ECALL_MATHV;
+		args[1].i = EMATH_SQRT;
+		args[2].u = vDst + i*chunk*sizeof(float);
+		args[3].u = vSrc + i*chunk*sizeof(float);
+		args[4].i = 0;
+		args[5].u = chunk;
+		args[6].i = ECALL_ASYNC;
+		minion_call(pMi, minion_get_func(pMi, "ecall_raw"), "l(iiiiiii)", args, &ret);
+		tickets[i] = (uint32_t)ret.l;
+	}
+	n = guest_ecall(pMi, ECALL_AWAIT, 4, 0, 0, 0);
+	minion_msg(pMi, "async: tickets %d..%d, %d ready\n", tickets[0], tickets[3], n);
+	ndone = 0;
+	while (minion_ring_get(pDone, &done, 1)) {
+		if (done.id != ECALL_MATHV || done.res[0] != (int32_t)chunk || done.ticket < tickets[0] || done.ticket > tickets[3]) {
+			minion_msg(pMi, "!!! async: bad completion %d\n", done.ticket);
+		}
+		++ndone;
+	}
+	for (i = 0; i < 4000; ++i) {
+		if (dst[i] != (float)i) {
+			minion_msg(pMi, "!!! async: sqrt[%d] = %f\n", i, dst[i]);
+			break;
+		}
+	}
+	if (n != 4 || ndone != 4) {
+		minion_msg(pMi, "!!! async: %d completions\n", ndone);
+	}
+	/* never more in flight than the completion ring can take */
+	nfull = 0;
+	for (i = 0; i < 32; ++i) {
+		nfull += guest_ecall(pMi, ECALL_ASYNC, ECALL_MATHV, EMATH_SQRT, vDst, vSrc) == 0;
+	}
+	n = guest_ecall(pMi, ECALL_AWAIT, 32, 0, 0, 0);
+	minion_msg(pMi, "async: %d refused, %d ready\n", nfull, n);
+	if (nfull != 16 || n != 16) {
+		minion_msg(pMi, "!!! async: queue limit mismatch\n");
+	}
+	/* handlers not flagged async-safe stay on the calling thread */
+	if (guest_ecall(pMi, ECALL_ASYNC, ECALL_OUTINT, 1, 0, 0) != 0) {
+		minion_msg(pMi, "!!! async: unsafe ecall submitted\n");
+	}
+	minion_mem_unmap(pMi, vDst);
+	minion_mem_unmap(pMi, vSrc);
+	minion_async_detach(pMi);
+	minion_async_release(&async);
+}
+
+typedef struct _LOG_CAPTURE {
+	MINION ctx;
+	int nerr;
+	int nmsg;
+	char last[64];
+} LOG_CAPTURE;
+
+static void log_capture_fn(void* pUser, int level, const char* pMsg) {
+	LOG_CAPTURE* pCap = (LOG_CAPTURE*)pUser;
+	if (level == MINION_LOG_ERR) {
+		++pCap->nerr;
+	} else {
+		++pCap->nmsg;
+	}
+	strncpy(pCap->last, pMsg, sizeof(pCap->last) - 1);
+}
+
+static void* log_thread(void* pArg) {
+	LOG_CAPTURE* pCap = (LOG_CAPTURE*)pArg;
+	int i;
+	for (i = 0; i < 1000; ++i) {
+		minion_msg(&pCap->ctx, "msg %d\n", i);
+		minion_err(&pCap->ctx, "err %d\n", i);
+	}
+	return NULL;
+}
+
+static void test_log(MINION* pMi) {
+	static LOG_CAPTURE caps[2];
+#ifndef MINION_NO_THREADS
+	pthread_t threads[2];
+#endif
+	MINION_LOG log;
+	int i;
+	for (i = 0; i < 2; ++i) {
+		memset(&caps[i], 0, sizeof(LOG_CAPTURE));
+		minion_ctx_init(&caps[i].ctx, pMi->pCfg);
+		log.fn = log_capture_fn;
+		log.pUser = &caps[i];
+		log.level = i == 0 ? MINION_LOG_MSG : MINION_LOG_ERR;
+		log.flags = i == 0 ? 0 : MINION_LOG_STD_REGNAMES;
+		minion_set_log(&caps[i].ctx, &log);
+	}
+#ifndef MINION_NO_THREADS
+	for (i = 0; i < 2; ++i) {
+		pthread_create(&threads[i], NULL, log_thread, &caps[i]);
+	}
+	for (i = 0; i < 2; ++i) {
+		pthread_join(threads[i], NULL);
+	}
+#else
+	for (i = 0; i < 2; ++i) {
+		log_thread(&caps[i]);
+	}
+#endif
+	minion_msg(pMi, "log[0]: %d err, %d msg, last \"%.*s\"\n", caps[0].nerr, caps[0].nmsg, (int)strcspn(caps[0].last, "\n"), caps[0].last);
+	minion_msg(pMi, "log[1]: %d err, %d msg, a0 = %s\n", caps[1].nerr, caps[1].nmsg, minion_get_reg_name(&caps[1].ctx, 10));
+	if (caps[0].nerr != 1000 || caps[0].nmsg != 1000 || caps[1].nerr != 1000 || caps[1].nmsg != 0) {
+		minion_msg(pMi, "!!! log level mismatch\n");
+	}
+	if (strcmp(minion_get_reg_name(&caps[0].ctx, 10), "a0") != 0 || strcmp(minion_get_reg_name(&caps[1].ctx, 10), "x10") != 0) {
+		minion_msg(pMi, "!!! log reg name flags mismatch\n");
+	}
+	for (i = 0; i < 2; ++i) {
+		minion_release(&caps[i].ctx);
+	}
+}
+
+typedef struct _MAP_THREAD {
+	MINION ctx;
+	uint32_t data[2];
+	uint32_t vMem[2];
+	uint32_t vIO[2];
+} MAP_THREAD;
+
+static void* map_thread(void* pArg) {
+	MAP_THREAD* pMt = (MAP_THREAD*)pArg;
+	int i;
+	for (i = 0; i < 2; ++i) {
+		pMt->vMem[i] = minion_mem_map(&pMt->ctx, &pMt->data[i], sizeof(uint32_t));
+		pMt->vIO[i] = minion_io_map(&pMt->ctx, 4, NULL, NULL, pMt);
+	}
+	return NULL;
+}
+
+/* instances sharing a cfg map from several threads at once, every claim must get its own slot */
+static void test_maps(MINION* pMi) {
+	static MAP_THREAD mts[4];
+#ifndef MINION_NO_THREADS
+	pthread_t threads[4];
+#endif
+	uint32_t seen = 0;
+	int i, j, nbad = 0;
+	for (i = 0; i < 4; ++i) {
+		memset(&mts[i], 0, sizeof(MAP_THREAD));
+		minion_ctx_init(&mts[i].ctx, pMi->pCfg);
+	}
+#ifndef MINION_NO_THREADS
+	for (i = 0; i < 4; ++i) {
+		pthread_create(&threads[i], NULL, map_thread, &mts[i]);
+	}
+	for (i = 0; i < 4; ++i) {
+		pthread_join(threads[i], NULL);
+	}
+#else
+	for (i = 0; i < 4; ++i) {
+		map_thread(&mts[i]);
+	}
+#endif
+	for (i = 0; i < 4; ++i) {
+		for (j = 0; j < 2; ++j) {
+			uint32_t bit = 1U << ((mts[i].vMem[j] >> MINION_VPTR_BITS) & 0xF);
+			uint32_t ioBit = 1U << (16 + ((mts[i].vIO[j] >> MINION_VPTR_BITS) & 0xF));
+			if (!mts[i].vMem[j] || !mts[i].vIO[j] || (seen & (bit | ioBit))) ++nbad;
+			seen |= bit | ioBit;
+			if (minion_span(pMi, mts[i].vMem[j], sizeof(uint32_t)) != &mts[i].data[j]) ++nbad;
+			if (!minion_io_region(pMi, mts[i].vIO[j]) || minion_io_region(pMi, mts[i].vIO[j])->pCtx != &mts[i]) ++nbad;
+		}
+	}
+	minion_msg(pMi, "maps: 8 memory and 8 io slots from 4 threads, %d bad\n", nbad);
+	if (nbad) {
+		minion_msg(pMi, "!!! maps: slot claimed twice or not published\n");
+	}
+	for (i = 0; i < 4; ++i) {
+		for (j = 0; j < 2; ++j) {
+			minion_mem_unmap(pMi, mts[i].vMem[j]);
+			minion_io_unmap(pMi, mts[i].vIO[j]);
+		}
+		minion_release(&mts[i].ctx);
+	}
+}
+
+/* [0]: callbacks, [1]: bad results, checked here since the job is not waited on */
+static void pool_done_fn(MINION_POOL_JOB* pJob) {
+	uint32_t* pCounts = (uint32_t*)pJob->pUser;
+	if (!pJob->ok || pJob->ret.u != host_fib(pJob->args[0].u)) {
+		MINION_ATOMIC_INC(&pCounts[1]);
+	}
+	MINION_ATOMIC_INC(&pCounts[0]);
+}
+
+static void test_pool(MINION* pMi) {
+	static MINION_POOL_JOB jobs[400];
+	MINION_POOL pool;
+	MINION_POOL_STATS stats;
+	MINION_FUNC_HANDLE hFib = minion_get_func(pMi, "fib");
+	uint32_t cbCounts[2] = { 0, 0 };
+	int njobs = (int)(sizeof(jobs) / sizeof(jobs[0]));
+	int nworkers = 4;
+	int i, nbad = 0;
+	uint32_t nstolen = 0;
+	if (minion_pool_init(&pool, pMi->pCfg, nworkers) != 0) return;
+	/* every 4th job is heavy, so round-robin submission leaves one queue long and the others steal from it */
+	for (i = 0; i < njobs; ++i) {
+		MINION_POOL_JOB* pJob = &jobs[i];
+		memset(pJob, 0, sizeof(MINION_POOL_JOB));
+		pJob->hFn = hFib;
+		pJob->pSig = "u(u)";
+		pJob->args[0].u = (i & 3) == 0 ? 18 : 4 + (i % 7);
+		if (i >= njobs - 20) {
+			pJob->done_fn = pool_done_fn;
+			pJob->pUser = cbCounts;
+		}
+		while (!minion_pool_submit(&pool, pJob)) {}
+	}
+	for (i = 0; i < njobs - 20; ++i) {
+		minion_pool_wait(&pool, &jobs[i]);
+		if (!jobs[i].ok || jobs[i].ret.u != host_fib(jobs[i].args[0].u)) ++nbad;
+	}
+	while (MINION_LOAD_ACQ(&cbCounts[0]) < 20) {}
+	nbad += (int)MINION_LOAD_ACQ(&cbCounts[1]);
+	for (i = 0; i < nworkers; ++i) {
+		minion_pool_stats(&pool, i, &stats);
+		minion_msg(pMi, "pool worker[%d]: %d jobs, %d stolen, %.1f%% busy\n", i, stats.njobs, stats.nstolen, stats.utilization * 100.0);
+		nstolen += stats.nstolen;
+	}
+	if (nbad) {
+		minion_msg(pMi, "!!! pool: %d bad results\n", nbad);
+	}
+#ifndef MINION_NO_THREADS
+	if (nstolen == 0) {
+		minion_msg(pMi, "!!! pool: no jobs were stolen\n");
+	}
+#endif
+	minion_pool_release(&pool);
+	minion_msg(pMi, "pool: %d jobs, %d via callbacks\n", njobs, cbCounts[0]);
+}
+
+/* runs one instruction in place and reports whether it faulted */
+static int instr_faults(MINION* pMi, uint32_t instr) {
+	uint32_t pc = pMi->pc;
+	uint32_t pcStatus = pMi->pcStatus;
+	int faulted;
+	pMi->pc = pMi->codeOrg;
+	minion_instr(pMi, instr, MINION_IMODE_EXEC);
+	faulted = pMi->faultFlags != 0;
+	pMi->faultFlags = 0;
+	pMi->pc = pc;
+	pMi->pcStatus = pcStatus;
+	return faulted;
+}
+
+static void test_harts(MINION* pMi) {
+	static int32_t counters[2];
+	static uint8_t raw[12];
+	MINION_HARTS harts;
+	MINION_VAL args[1];
+	MINION_VAL ret;
+	MINION_FUNC_HANDLE hCount = minion_get_func(pMi, "hart_count");
+	uint32_t vCounters = minion_mem_map(pMi, counters, sizeof(counters));
+	int32_t res[4];
+	int i, nbad = 0;
+
+	counters[0] = 10;
+	args[0].u = vCounters;
+	if (!minion_call(pMi, minion_get_func(pMi, "amo_test"), "i(p)", args, &ret) || ret.i != 16 || counters[0] != 16) {
+		minion_msg(pMi, "!!! amo_test: %d, [%d]\n", ret.i, counters[0]);
+	}
+	/* amoadd.w a1, t0, (a0) on a misaligned host view; csrr a0, 0x7C0; csrw mhartid, a0 */
+	pMi->regs[10] = (int32_t)minion_mem_map(pMi, raw + 1, 8);
+	if (!instr_faults(pMi, 0x005525AF) || !instr_faults(pMi, 0x7C002573) || !instr_faults(pMi, 0xF1451073)) {
+		minion_msg(pMi, "!!! misaligned AMO or bad CSR access went through\n");
+	}
+	minion_mem_unmap(pMi, (uint32_t)pMi->regs[10]);
+
+	counters[0] = 0;
+	counters[1] = 0;
+	minion_harts_register(pMi->pCfg, ECALL_HART_START);
+	if (minion_harts_init(&harts, pMi, 4, 0) != 0 || !hCount) return;
+	minion_hart_start(&harts, 1, hCount->addr, vCounters);
+	minion_hart_start(&harts, 2, hCount->addr, vCounters);
+	if (guest_ecall(pMi, ECALL_HART_START, 3, hCount->addr, vCounters, 0) != 0) ++nbad;
+	if (minion_hart_start(&harts, 3, hCount->addr, vCounters) == 0) ++nbad;
+	res[0] = minion_call(pMi, hCount, "i(p)", args, &ret) ? ret.i : -1;
+	res[1] = minion_hart_join(&harts, 1);
+	res[2] = minion_hart_join(&harts, 2);
+	res[3] = guest_ecall(pMi, ECALL_HART_JOIN, 3, 0, 0, 0);
+	for (i = 0; i < 4; ++i) {
+		if (res[i] != i) ++nbad;
+	}
+	minion_msg(pMi, "harts: amoadd total %d, lr/sc total %d, ids %d %d %d %d\n", counters[0], counters[1], res[0], res[1], res[2], res[3]);
+	if (nbad || counters[0] != 4 * 1000 || counters[1] != 100 * (1 + 2 + 3 + 4)) {
+		minion_msg(pMi, "!!! harts mismatch\n");
+	}
+	minion_harts_release(&harts);
+	minion_mem_unmap(pMi, vCounters);
+}
 
 static void cli_opts(int argc, char* argv[]) {
 	int i;
@@ -707,7 +2091,7 @@ static void cli_opts(int argc, char* argv[]) {
 		size_t len = strlen(pOpt);
 		if (len > 2) {
 			if (strcmp(pOpt, "--silent") == 0) {
-				minion_set_silent(1);
+				s_log.level = MINION_LOG_NONE;
 			} else if (strcmp(pOpt, "--bin-info") == 0) {
 				s_binInfo = 1;
 			} else if (strcmp(pOpt, "--exec-dbg") == 0) {
@@ -725,13 +2109,13 @@ static void cli_opts(int argc, char* argv[]) {
 			} else if (strcmp(pOpt, "--no-echo-instrs") == 0) {
 				s_echoInstrs = 0;
 			} else if (strcmp(pOpt, "--alt-regnames") == 0) {
-				minion_enable_alt_regnames(1);
+				s_log.flags &= ~MINION_LOG_STD_REGNAMES;
 			} else if (strcmp(pOpt, "--no-alt-regnames") == 0) {
-				minion_enable_alt_regnames(0);
+				s_log.flags |= MINION_LOG_STD_REGNAMES;
 			} else if (strcmp(pOpt, "--alt-mnemonics") == 0) {
-				minion_enable_alt_mnemonics(1);
+				s_log.flags &= ~MINION_LOG_STD_MNEMONICS;
 			} else if (strcmp(pOpt, "--no-alt-mnemonics") == 0) {
-				minion_enable_alt_mnemonics(0);
+				s_log.flags |= MINION_LOG_STD_MNEMONICS;
 			} else if (strcmp(pOpt, "--bin-mem") == 0) {
 				s_binMem = 1;
 			} else if (strcmp(pOpt, "--bin-file") == 0) {
@@ -740,12 +2124,24 @@ static void cli_opts(int argc, char* argv[]) {
 				s_pDumpFuncName = pOpt + offs;
 			} else if ((offs = opt_prefix(pOpt, "--bin-path=")) > 0) {
 				s_pBinPath = pOpt + offs;
+			} else if ((offs = opt_prefix(pOpt, "--save-v2=")) > 0) {
+				s_pSaveV2Path = pOpt + offs;
+			} else if ((offs = opt_prefix(pOpt, "--fs-root=")) > 0) {
+				s_pFsRoot = pOpt + offs;
+			} else if ((offs = opt_prefix(pOpt, "--lib-path=")) > 0) {
+				s_pLibPath = pOpt + offs;
 			} else if ((offs = opt_prefix(pOpt, "--test=")) > 0) {
 				s_pTestName = pOpt + offs;
 			} else if (strcmp(pOpt,  "--perf-native") == 0) {
 				s_perfNative = 1;
+			} else if (strcmp(pOpt,  "--perf-batch") == 0) {
+				s_perfBatch = 1;
+			} else if ((offs = opt_prefix(pOpt, "--perf-replace=")) > 0) {
+				s_perfReplace = atoi(pOpt + offs);
 			} else if ((offs = opt_prefix(pOpt, "--perf-count=")) > 0) {
 				s_perfCount = atoi(pOpt + offs);
+			} else if ((offs = opt_prefix(pOpt, "--perf-harts=")) > 0) {
+				s_perfHarts = atoi(pOpt + offs);
 			}
 		}
 	}
@@ -754,15 +2150,16 @@ static void cli_opts(int argc, char* argv[]) {
 int main(int argc, char* argv[]) {
 	MINION_BIN miBin;
 	MINION mi;
-	s_pBinPath = "out/test.minion";
+	s_pBinPath = "out/test.elf";
 	s_pTestName = "fib";
 	cli_opts(argc, argv);
+	minion_set_default_log(&s_log);
 	memset(&miBin, 0, sizeof(miBin));
 	memset(&mi, 0, sizeof(mi));
 	if (s_binMem) {
 		s_pBinData = bin_load(s_pBinPath, &s_binDataSize);
 		minion_sys_msg("Loading binary via memory, path: \"%s\", p: %p, size = 0x%X \n", s_pBinPath, s_pBinData, s_binDataSize);
-		minion_bin_from_mem(&miBin, s_pBinData, s_binDataSize);
+		minion_bin_from_mem_inplace(&miBin, s_pBinData, s_binDataSize);
 	} else {
 		minion_sys_msg("Loading binary from file, path: \"%s\"\n", s_pBinPath);
 		minion_bin_load(&miBin, s_pBinPath);
@@ -770,6 +2167,15 @@ int main(int argc, char* argv[]) {
 	if (s_binInfo) {
 		minion_bin_info(&miBin);
 	}
+	if (s_pSaveV2Path) {
+		if (minion_bin_save_v2(&miBin, s_pSaveV2Path)) {
+			minion_sys_msg("Saved MINION v2 binary to \"%s\"\n", s_pSaveV2Path);
+		}
+	}
+	if (strcmp(s_pTestName, "replace") == 0 || s_perfReplace >= 0) {
+		/* replacements patch the image */
+		minion_bin_copy_image(&miBin);
+	}
 	minion_init(&mi, &miBin);
 
 	if (mi.codeOrg > 0) {
@@ -779,8 +2185,30 @@ int main(int argc, char* argv[]) {
 			test_inner_mem(&mi);
 		} else if (strcmp(s_pTestName,  "mapped_mem") == 0) {
 			test_mapped_mem(&mi);
+		} else if (strcmp(s_pTestName,  "bulk_mem") == 0) {
+			test_bulk_mem(&mi);
+		} else if (strcmp(s_pTestName,  "io_fifo") == 0) {
+			test_io_fifo(&mi);
+		} else if (strcmp(s_pTestName,  "ring") == 0) {
+			test_ring(&mi);
 		} else if (strcmp(s_pTestName,  "fib") == 0) {
 			test_fib(&mi);
+		} else if (strcmp(s_pTestName,  "ctx_array") == 0) {
+			test_ctx_array(&mi);
+		} else if (strcmp(s_pTestName,  "arena") == 0) {
+			test_arena(&mi);
+		} else if (strcmp(s_pTestName,  "modules") == 0) {
+			test_modules(&mi);
+		} else if (strcmp(s_pTestName,  "natives") == 0) {
+			test_natives(&mi);
+		} else if (strcmp(s_pTestName,  "replace") == 0) {
+			test_replace(&mi);
+		} else if (strcmp(s_pTestName,  "hot_reload") == 0) {
+			test_hot_reload(&mi);
+		} else if (strcmp(s_pTestName,  "call") == 0) {
+			test_call(&mi);
+		} else if (strcmp(s_pTestName,  "call_batch") == 0) {
+			test_call_batch(&mi);
 		} else if (strcmp(s_pTestName,  "f_2op_s") == 0) {
 			test_f_2op_s(&mi);
 		} else if (strcmp(s_pTestName,  "f_1op_s") == 0) {
@@ -791,8 +2219,24 @@ int main(int argc, char* argv[]) {
 			test_sin_s(&mi);
 		} else if (strcmp(s_pTestName,  "cos_s") == 0) {
 			test_cos_s(&mi);
+		} else if (strcmp(s_pTestName,  "cmds") == 0) {
+			test_cmds(&mi);
 		} else if (strcmp(s_pTestName,  "ecalls") == 0) {
 			test_ecalls(&mi);
+		} else if (strcmp(s_pTestName,  "files") == 0) {
+			test_files(&mi);
+		} else if (strcmp(s_pTestName,  "async") == 0) {
+			test_async(&mi);
+		} else if (strcmp(s_pTestName,  "outbuf") == 0) {
+			test_outbuf(&mi);
+		} else if (strcmp(s_pTestName,  "log") == 0) {
+			test_log(&mi);
+		} else if (strcmp(s_pTestName,  "maps") == 0) {
+			test_maps(&mi);
+		} else if (strcmp(s_pTestName,  "pool") == 0) {
+			test_pool(&mi);
+		} else if (strcmp(s_pTestName,  "harts") == 0) {
+			test_harts(&mi);
 		} else if (strcmp(s_pTestName,  "mtx_invert_s") == 0) {
 			test_mtx_invert_s(&mi);
 		} else if (strcmp(s_pTestName,  "perf_sincos_s") == 0) {